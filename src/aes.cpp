@@ -7,10 +7,241 @@
 #include <fstream>
 #include <cstring>
 #include <random>
+#include <thread>
+#include <vector>
+#include <new>
 
 #include "aes_config.h"
 #include "aes.h"
 
+#ifdef __linux__
+#include <sys/random.h>
+#include <cerrno>
+#endif
+
+#ifdef AES_FILE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * 	@brief File descriptor with an optional shared mapping of the whole file, both released on destruction
+*/
+struct AES_MAPPED_FILE {
+	int fd = -1;
+	uint8_t* data = nullptr;
+	size_t length = 0;
+
+	/**
+	 * 	@brief Map the whole file
+	 * 
+	 * 	@param writable  Map for writing instead of reading
+	 * 
+	 * 	@returns If the file was mapped
+	*/
+	bool Map(bool writable) {
+		if (!this->length)
+			return false;
+
+		void* mapped = mmap(nullptr, this->length, (writable ? PROT_READ | PROT_WRITE : PROT_READ), MAP_SHARED, this->fd, 0);
+		if (mapped == MAP_FAILED)
+			return false;
+
+		//Chunks are processed front to back
+		this->data = (uint8_t*)mapped;
+		madvise(this->data, this->length, MADV_SEQUENTIAL);
+		return true;
+	}
+
+	~AES_MAPPED_FILE() {
+		if (this->data)
+			munmap(this->data, this->length);
+		if (this->fd >= 0)
+			close(this->fd);
+	}
+};
+#endif
+
+#ifdef AES_FILE_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <cerrno>
+
+/**
+ * 	@brief Minimal io_uring instance on the raw system calls, one thread submits and reaps
+*/
+class AES_URING {
+private:
+
+	int fd = -1;
+
+	uint8_t* sqRing = nullptr;		//Submission ring indexes and array
+	size_t sqRingSize = 0;
+	uint8_t* cqRing = nullptr;		//Completion ring indexes and entries (the same mapping with IORING_FEAT_SINGLE_MMAP)
+	size_t cqRingSize = 0;
+	io_uring_sqe* sqes = nullptr;
+	size_t sqesSize = 0;
+
+	io_uring_params params = {};
+
+	unsigned queued = 0;		//Entries not handed to the kernel yet
+
+	bool registered = false;
+
+public:
+
+	~AES_URING() {
+		if (this->sqes)
+			munmap(this->sqes, this->sqesSize);
+		if (this->cqRing && this->cqRing != this->sqRing)
+			munmap(this->cqRing, this->cqRingSize);
+		if (this->sqRing)
+			munmap(this->sqRing, this->sqRingSize);
+		if (this->fd >= 0)
+			close(this->fd);
+	}
+
+	/**
+	 * 	@brief Create the rings
+	 * 
+	 * 	@param entries  Most requests in flight at once
+	 * 
+	 * 	@returns false if the kernel does not offer io_uring (too old, disabled or blocked)
+	*/
+	bool Setup(unsigned entries) {
+		this->fd = (int)syscall(__NR_io_uring_setup, entries, &this->params);
+		if (this->fd < 0)
+			return false;
+
+		this->sqRingSize = this->params.sq_off.array + this->params.sq_entries * sizeof(unsigned);
+		this->cqRingSize = this->params.cq_off.cqes + this->params.cq_entries * sizeof(io_uring_cqe);
+		this->sqesSize = this->params.sq_entries * sizeof(io_uring_sqe);
+
+		bool single = (this->params.features & IORING_FEAT_SINGLE_MMAP);
+		if (single && this->cqRingSize > this->sqRingSize)
+			this->sqRingSize = this->cqRingSize;
+
+		void* mapped = mmap(nullptr, this->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQ_RING);
+		if (mapped == MAP_FAILED)
+			return false;
+		this->sqRing = (uint8_t*)mapped;
+
+		if (single)
+			this->cqRing = this->sqRing;
+		else {
+			mapped = mmap(nullptr, this->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_CQ_RING);
+			if (mapped == MAP_FAILED)
+				return false;
+			this->cqRing = (uint8_t*)mapped;
+		}
+
+		mapped = mmap(nullptr, this->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQES);
+		if (mapped == MAP_FAILED)
+			return false;
+		this->sqes = (io_uring_sqe*)mapped;
+
+		return true;
+	}
+
+	/**
+	 * 	@brief Register buffers for the fixed read and write requests
+	 * 
+	 * 	@returns false if the kernel refused them (e.g. the locked memory limit), plain requests work without them
+	*/
+	bool Register(const iovec* buffers, unsigned count) {
+		this->registered = !syscall(__NR_io_uring_register, this->fd, IORING_REGISTER_BUFFERS, buffers, count);
+		return this->registered;
+	}
+
+	/**
+	 * 	@brief Drop the registered buffers
+	*/
+	void Unregister(void) {
+		if (this->registered)
+			syscall(__NR_io_uring_register, this->fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+		this->registered = false;
+	}
+
+	/**
+	 * 	@brief Queue a read or write, handed to the kernel by the next Wait()
+	 * 
+	 * 	@param write  Write instead of read
+	 * 	@param file  File descriptor
+	 * 	@param data  Buffer inside the registered buffer bufferIndex
+	 * 	@param length  Bytes to transfer
+	 * 	@param offset  File position
+	 * 	@param bufferIndex  Registered buffer holding data
+	 * 	@param userData  Returned with the completion
+	*/
+	void Queue(bool write, int file, uint8_t* data, unsigned length, uint64_t offset, uint16_t bufferIndex, uint64_t userData) {
+		unsigned* tail = (unsigned*)(this->sqRing + this->params.sq_off.tail);
+		unsigned mask = *(unsigned*)(this->sqRing + this->params.sq_off.ring_mask);
+		unsigned* array = (unsigned*)(this->sqRing + this->params.sq_off.array);
+
+		unsigned index = *tail & mask;
+		io_uring_sqe* sqe = &this->sqes[index];
+		memset(sqe, 0, sizeof(io_uring_sqe));
+
+		if (this->registered) {
+			sqe->opcode = (write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED);
+			sqe->buf_index = bufferIndex;
+		}
+		else
+			sqe->opcode = (write ? IORING_OP_WRITE : IORING_OP_READ);
+
+		sqe->fd = file;
+		sqe->addr = (uint64_t)(uintptr_t)data;
+		sqe->len = length;
+		sqe->off = offset;
+		sqe->user_data = userData;
+
+		array[index] = index;
+		__atomic_store_n(tail, *tail + 1, __ATOMIC_RELEASE);
+		this->queued++;
+	}
+
+	/**
+	 * 	@brief Submit the queued requests and wait for one completion
+	 * 
+	 * 	@param userData  userData of the finished request
+	 * 	@param result  Transferred bytes or -errno
+	 * 
+	 * 	@returns false if io_uring_enter failed
+	*/
+	bool Wait(uint64_t* userData, int* result) {
+		unsigned* head = (unsigned*)(this->cqRing + this->params.cq_off.head);
+		unsigned* tail = (unsigned*)(this->cqRing + this->params.cq_off.tail);
+		unsigned mask = *(unsigned*)(this->cqRing + this->params.cq_off.ring_mask);
+		io_uring_cqe* cqes = (io_uring_cqe*)(this->cqRing + this->params.cq_off.cqes);
+
+		while (true) {
+			//Hand new requests over before taking a completion, so the queue stays full
+			if (this->queued || *head == __atomic_load_n(tail, __ATOMIC_ACQUIRE)) {
+				bool ready = (*head != __atomic_load_n(tail, __ATOMIC_ACQUIRE));
+				int submitted = (int)syscall(__NR_io_uring_enter, this->fd, this->queued, (ready ? 0 : 1), (ready ? 0 : IORING_ENTER_GETEVENTS), nullptr, 0);
+				if (submitted < 0) {
+					if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+						continue;
+					return false;
+				}
+				this->queued -= (unsigned)submitted;
+			}
+
+			unsigned current = *head;
+			if (current != __atomic_load_n(tail, __ATOMIC_ACQUIRE)) {
+				io_uring_cqe* cqe = &cqes[current & mask];
+				*userData = cqe->user_data;
+				*result = cqe->res;
+				__atomic_store_n(head, current + 1, __ATOMIC_RELEASE);
+				return true;
+			}
+		}
+	}
+};
+#endif
+
 /*
  * ************************************
  * ************************************
@@ -23,7 +254,9 @@
 //	#	Public functions
 //	#
 
-AES_KEYSET::AES_KEYSET(const uint8_t* key) {
+AES_KEYSET::AES_KEYSET(const uint8_t* key, AES_KEYSIZE keySize) {
+	this->keySize = keySize;
+	this->rounds = keySize / 4 + 6;
 	CalculateKeys(key);
 }
 
@@ -33,118 +266,157 @@ void AES_KEYSET::ChangeSecretKey(const uint8_t* key) {
 }
 
 //
-void AES_KEYSET::EraseSecretkey() {
-	CalculateKeys(nullptr);
+AES_KEYSIZE AES_KEYSET::GetKeySize() const {
+	return this->keySize;
 }
 
 //
-void AES_KEYSET::ChangeIV(const uint8_t* iv) {
-	if (iv)		//Only copy if *iv is not nullptr
-		memcpy(this->iv, iv, 16);
+uint8_t AES_KEYSET::GetRounds() const {
+	return this->rounds;
 }
 
 //
-void AES_KEYSET::GetIV(uint8_t* dst) const {
-	if (dst)	//Only copy if *dst is not nullptr
-		memcpy(dst, this->iv, 16);
+void AES_KEYSET::EraseSecretkey() {
+	CalculateKeys(nullptr);
 }
 
 //
-void AES_KEYSET::ClearIV() {
-	for (uint8_t i = 0; i < 16; i++)
-		this->iv[i] = rand() % 256;
+void AES_KEYSET::AddRoundKey(uint32_t* state, uint8_t keyNum) const {
+	state[0] ^= roundKeys[keyNum][0];
+	state[1] ^= roundKeys[keyNum][1];
+	state[2] ^= roundKeys[keyNum][2];
+	state[3] ^= roundKeys[keyNum][3];
 }
 
 //
-void AES_KEYSET::AddRoundKey(uint8_t* block, uint8_t keyNum) {
-	if (!block)		//Return if *block is a nullptr
-		return;
-	
-	if(keyNum > 10)		//Return if key number is too big
-		return;
-
-	for (uint8_t i = 0; i < 4; i++)
-		for (uint8_t j = 0; j < 4; j++)
-			block[j * 4 + i] = block[j * 4 + i] ^ keyset[keyNum][i * 4 + j];
+const uint32_t* AES_KEYSET::GetRoundKey(uint8_t keyNum) const {
+	return this->roundKeys[keyNum];
 }
 
 //
-void AES_KEYSET::XORIV(uint8_t* block) {
-	if(!block)		//Return if *block is a nullptr
-		return;
+const uint32_t* AES_KEYSET::GetDecryptRoundKey(uint8_t keyNum) const {
+	return this->decRoundKeys[keyNum];
+}
 
-	for (uint8_t i = 0; i < 16; i++)
-		block[i] = block[i] ^ this->iv[i];
+//
+const uint32_t* AES_KEYSET::GetVpermRoundKeys(bool decrypt) const {
+	return (decrypt ? this->vpermDecRoundKeys[0] : this->vpermRoundKeys[0]);
 }
 
+// 	#
+//	#	Private functions
+//	#
+
 //
-void AES_KEYSET::XORIV(uint8_t* block, uint8_t* iv) {
-	if (!block)		//Return if *block is a nullptr
-		return;
+void AES_KEYSET::CalculateKeys(const uint8_t* key) {
+	uint8_t keyArr[AES_KEY_256] = { 0 };
+	const uint8_t keyWords = keySize / 4;
+	const uint8_t totalWords = (rounds + 1) * 4;
 
-	if (!iv) {		//If *iv is nullptr add the stored IV to the block
-		XORIV(block);
-		return;
+	//The key is read like a string, missing characters are zero
+	if (key)
+		for (uint8_t i = 0; i < keySize && key[i] != '\0'; i++)
+			keyArr[i] = key[i];
+
+	//The stages are one continuous word schedule
+	uint32_t* w = &roundKeys[0][0];
+
+	//Every 4 characters form one column
+	for (uint8_t i = 0; i < keyWords; i++)
+		w[i] = (uint32_t)keyArr[i * 4] | (uint32_t)keyArr[i * 4 + 1] << 8 | (uint32_t)keyArr[i * 4 + 2] << 16 | (uint32_t)keyArr[i * 4 + 3] << 24;
+
+	for (uint8_t i = keyWords; i < totalWords; i++) {
+		uint32_t temp = w[i - 1];
+
+		//RotWord moves row 1 into row 0, which is a right rotation of a column word
+		if (i % keyWords == 0)
+			temp = SubWord((temp >> 8) | (temp << 24)) ^ rcon_table[i / keyWords - 1];
+		else if (keyWords > 6 && i % keyWords == 4)
+			temp = SubWord(temp);
+
+		w[i] = w[i - keyWords] ^ temp;
 	}
 
-	for (uint8_t i = 0; i < 16; i++)
-		block[i] = block[i] ^ this->iv[i];
+	//The equivalent inverse cipher adds the key after InvMixColumns, so the middle stages are transformed once here
+	for (uint8_t col = 0; col < 4; col++) {
+		decRoundKeys[0][col] = roundKeys[0][col];
+		decRoundKeys[rounds][col] = roundKeys[rounds][col];
+	}
+	for (uint8_t i = 1; i < rounds; i++)
+		for (uint8_t col = 0; col < 4; col++)
+			decRoundKeys[i][col] = InvMixColumn(roundKeys[i][col]);
+
+#ifdef AES_KERNEL_X86
+	AES_KERNEL_VPERM::ConvertKeys(this, vpermRoundKeys, vpermDecRoundKeys);
+#endif
 }
 
 //
-void AES_KEYSET::SetIVMode(bool mode) {
-	this->IVmode = mode;
+uint32_t AES_KEYSET::SubWord(uint32_t word) const {
+	return (uint32_t)Te4[word & 0xFF] | (uint32_t)Te4[(word >> 8) & 0xFF] << 8 | (uint32_t)Te4[(word >> 16) & 0xFF] << 16 | (uint32_t)Te4[word >> 24] << 24;
 }
 
-//
-bool AES_KEYSET::GetIVMode() const {
-	return this->IVmode;
+//Td tables hold InvMixColumns of the inverse S-box, so undo the inverse S-box with Te4 first
+uint32_t AES_KEYSET::InvMixColumn(uint32_t word) const {
+	return Td0[Te4[word & 0xFF]] ^ Td1[Te4[(word >> 8) & 0xFF]] ^ Td2[Te4[(word >> 16) & 0xFF]] ^ Td3[Te4[word >> 24]];
 }
 
+
+/*
+ * ************************************
+ * ************************************
+ *				AES_BUFFER_POOL
+ * ************************************
+ * ************************************
+*/
+
 // 	#
-//	#	Private functions
+//	#	Public functions
 //	#
 
 //
-void AES_KEYSET::ExpandKey(uint8_t keyNum) {
-	if (keyNum < 1 || keyNum > 10)
-		return;
-	uint8_t prevKeyNum = keyNum - 1;
-	keyset[keyNum][0] = SubByteSingle(keyset[prevKeyNum][7]) ^ keyset[prevKeyNum][0] ^ rcon_table[keyNum - 1];
-	keyset[keyNum][4] = SubByteSingle(keyset[prevKeyNum][11]) ^ keyset[prevKeyNum][4];
-	keyset[keyNum][8] = SubByteSingle(keyset[prevKeyNum][15]) ^ keyset[prevKeyNum][8];
-	keyset[keyNum][12] = SubByteSingle(keyset[prevKeyNum][3]) ^ keyset[prevKeyNum][12];
-	for (uint8_t i = 1; i < 4; i++) {
-		keyset[keyNum][i] = keyset[keyNum][i - 1] ^ keyset[prevKeyNum][i];
-		keyset[keyNum][i + 4] = keyset[keyNum][i + 3] ^ keyset[prevKeyNum][i + 4];
-		keyset[keyNum][i + 8] = keyset[keyNum][i + 7] ^ keyset[prevKeyNum][i + 8];
-		keyset[keyNum][i + 12] = keyset[keyNum][i + 11] ^ keyset[prevKeyNum][i + 12];
-	}
+AES_BUFFER_POOL::~AES_BUFFER_POOL() {
+	Release();
 }
 
 //
-void AES_KEYSET::CalculateKeys(const uint8_t* key) {
-	char keyArr[16] = { 0 };
+bool AES_BUFFER_POOL::Reserve(size_t count, size_t size) {
+	//Round up so every buffer starts on its own page
+	size = (size + AES_POOL_ALIGN - 1) / AES_POOL_ALIGN * AES_POOL_ALIGN;
 
-	uint8_t i;
-	for (i = 0; i < 16 && key[i] != '\0'; i++)
-		keyArr[i] = key[i];
+	if (this->memory && count <= this->bufferCount && size <= this->bufferSize)
+		return true;
 
-	for (; i < 16; i++)
-		keyArr[i] = 0;
+	//Grow to cover both the old and the new request, so alternating sizes do not reallocate every time
+	if (count < this->bufferCount)
+		count = this->bufferCount;
+	if (size < this->bufferSize)
+		size = this->bufferSize;
 
-	//Arrange characters like it's a 4x4 matrix
-	for (uint8_t i = 0; i < 4; i++)
-		for (uint8_t j = 0; j < 4; j++)
-			keyset[0][j * 4 + i] = keyArr[i * 4 + j];
+	Release();
+
+	this->memory = static_cast<uint8_t*>(::operator new[](count * size, std::align_val_t(AES_POOL_ALIGN), std::nothrow));
+	if (!this->memory)
+		return false;
+
+	this->bufferSize = size;
+	this->bufferCount = count;
+	return true;
+}
 
-	for (uint8_t i = 1; i < 11; i++)
-		ExpandKey(i);
+//
+uint8_t* AES_BUFFER_POOL::Get(size_t index) const {
+	return this->memory + index * this->bufferSize;
 }
 
 //
-uint8_t AES_KEYSET::SubByteSingle(uint8_t byte) {
-	return sBox[byte >> 4][byte & 0x0F];
+void AES_BUFFER_POOL::Release() {
+	if (this->memory)
+		::operator delete[](this->memory, std::align_val_t(AES_POOL_ALIGN));
+
+	this->memory = nullptr;
+	this->bufferSize = 0;
+	this->bufferCount = 0;
 }
 
 
@@ -173,43 +445,172 @@ bool AES_BASE::SetBufferLimit(const size_t limit) {
 	return true;
 }
 
+//
+void AES_BASE::ReleaseBuffers() {
+	this->bufferPool.Release();
+}
+
+//
+AES_FILE_IO AES_BASE::GetFileIO() const {
+	return this->fileIO;
+}
+
+//
+bool AES_BASE::SetFileIO(AES_FILE_IO io) {
+#ifndef AES_FILE_MMAP
+	if (io == AES_IO_MMAP)
+		return false;
+#endif
+#ifndef AES_FILE_URING
+	if (io == AES_IO_URING)
+		return false;
+#endif
+#ifndef AES_FILE_DIRECT
+	if (io == AES_IO_DIRECT)
+		return false;
+#endif
+	this->fileIO = io;
+	return true;
+}
+
+//
+const char* AES_BASE::GetKernelName() const {
+	return this->kernel->GetName();
+}
+
+//
+bool AES_BASE::SetKernel(const char* name) {
+	const AES_KERNEL* selected = AES_KERNEL::Find(name);
+	if (!selected)
+		return false;
+	this->kernel = selected;
+	return true;
+}
+
+//
+void AES_BASE::SetThreadCount(unsigned count) {
+	this->threadCount = count;
+}
+
+//
+bool AES_BASE::IsParallel(bool decrypt) const {
+	return false;
+}
+
 //
 uint8_t* AES_BASE::EncryptBuffer(const uint8_t* src, size_t length, size_t* streamLength) {
-	
-	//Generate new IV for this encrypt
-	this->keyset->ClearIV();
-	
-	uint8_t* encrypted = Encrypt(src, length, streamLength, true);
+	if (!src || !length) {
+		std::cerr << "[ERROR] AES Encrypt: Source was nullptr or empty!\n";
+		return nullptr;
+	}
 
-	if (this->keyset->GetIVMode()) {
-		uint8_t* temp = new uint8_t[*streamLength + 16];
-		this->keyset->GetIV(temp);
-		memcpy(temp + 16, encrypted, *streamLength);
-		*streamLength += 16;
+	//The only copy, the rest happens in place
+	size_t capacity = GetEncryptedLength(length);
+	uint8_t* encrypted = new uint8_t[capacity];
+	memcpy(encrypted + GetFrameOffset(), src, length);
+
+	if (!EncryptInPlace(encrypted, length, capacity, streamLength)) {
 		delete[] encrypted;
-		encrypted = temp;
+		return nullptr;
 	}
 
 	return encrypted;
 	
 }
 
+//
+uint8_t* AES_BASE::EncryptBuffer(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity, size_t* streamLength) {
+	if (!src || !dst) {
+		std::cerr << "[ERROR] AES Encrypt: Pointer to source or destination was nullptr!\n";
+		return nullptr;
+	}
+
+	if (capacity < GetEncryptedLength(length)) {
+		std::cerr << "[ERROR] AES Encrypt: Destination is shorter than the encrypted length!\n";
+		return nullptr;
+	}
+
+	if (src != dst + GetFrameOffset())
+		memmove(dst + GetFrameOffset(), src, length);
+
+	return EncryptInPlace(dst, length, capacity, streamLength);
+}
+
+//
+uint8_t* AES_BASE::EncryptInPlace(uint8_t* buffer, size_t length, size_t capacity, size_t* streamLength) {
+	if (!buffer || !streamLength) {
+		std::cerr << "[ERROR] AES Encrypt: Pointer to buffer or streamLength was nullptr!\n";
+		return nullptr;
+	}
+
+	if (capacity < GetEncryptedLength(length)) {
+		std::cerr << "[ERROR] AES Encrypt: Buffer is shorter than the encrypted length!\n";
+		return nullptr;
+	}
+
+	//Generate new IV for this encrypt
+	if (!ClearIV()) {
+		std::cerr << "[ERROR] AES Encrypt: Cannot generate a random IV!\n";
+		return nullptr;
+	}
+	ResetChain();
+
+	size_t offset = GetFrameOffset();
+	size_t dataLength = 0;
+
+	if (!EncryptData(buffer + offset, length, &dataLength, true))
+		return nullptr;
+
+	//Frame the ciphertext with the header and the IV before and the authentication tag after it
+	GetHeader(buffer);
+	GetIV(this->IVmode ? buffer + GetHeaderLength() : nullptr);
+	GetTag(buffer + offset + dataLength);
+
+	*streamLength = offset + dataLength + GetTagLength();
+	return buffer;
+}
+
+//
+size_t AES_BASE::GetFrameOffset() const {
+	return GetHeaderLength() + (this->IVmode ? 16 : 0);
+}
+
+//
+size_t AES_BASE::GetEncryptedLength(size_t length) const {
+	if (GetMode() < AES_CFB_M)
+		length += ((length & 0x0F) == 0 ? 16 : 16 - (length & 0x0F));
+
+	return GetFrameOffset() + length + GetTagLength();
+}
+
 //
 void AES_BASE::EncryptFile(const char* inputFileName, const char* outputFileName) {
 
 	std::fstream inputFile;
 	std::fstream outputFile;
 
-	uint8_t* rawData = nullptr;
-	uint8_t* encryptedData = nullptr;
-
-	//Generate new IV for this encrypt
-	this->keyset->ClearIV();
-	
 	try {
 		if (!inputFileName || !outputFileName)
 			throw("filename was nullptr!\n");
 
+		//Generate new IV for this encrypt
+		if (!ClearIV())
+			throw("Cannot generate a random IV!");
+		ResetChain();
+
+		if (this->fileIO == AES_IO_MMAP) {
+			EncryptMapped(inputFileName, outputFileName);
+			return;
+		}
+
+		if (this->fileIO == AES_IO_URING && EncryptRing(inputFileName, outputFileName))
+			return;
+
+		if (this->fileIO == AES_IO_DIRECT) {
+			EncryptDirect(inputFileName, outputFileName);
+			return;
+		}
+
 		//Open input file
 		inputFile.open(inputFileName, std::ios::in | std::ios::binary);
 
@@ -219,72 +620,39 @@ void AES_BASE::EncryptFile(const char* inputFileName, const char* outputFileName
 		if (!streamLen)
 			throw("File stream was 0!\n");	//Empty input file
 
+		if (GetMode() == AES_XTS_M && streamLen < 16)
+			throw("XTS needs at least one whole block!");
+
+		if (streamLen > GetMaxLength())
+			throw("File is too long for one IV of the mode!");
+
 		//Create output file
 		outputFile.open(outputFileName, std::ios::out | std::ios::binary);
 
 		if (!outputFile)
 			throw("Cannot create output file!");
 
-		if (this->keyset->GetIVMode()) {
-			uint8_t iv[16] = { 0 };
-			this->keyset->GetIV(iv);
-			outputFile.write((char*)iv, 16);
+		if (GetHeaderLength()) {
+			uint8_t header[16];
+			GetHeader(header);
+			outputFile.write((char*)header, GetHeaderLength());
 		}
 
-		//The maximum ammount of data (bytes) to work on at once
-		size_t dataChunkSize = (streamLen > this->bufferLimit ? this->bufferLimit : streamLen);
-
-		size_t encryptedChunkSize = 0;
-
-		//Encrypting without padding
-		//TODO Redesign loop without constant reallocation
-		while (streamLen > dataChunkSize) {
-
-			//Store data from file
-			rawData = new uint8_t[dataChunkSize * sizeof(uint8_t)];
-
-			//Check memory allocation
-			if (!rawData)
-				throw("Memory allocation failed!");
-
-			//Read data from file into buffer
-			inputFile.read((char*)rawData, dataChunkSize);
-
-			encryptedData = Encrypt(rawData, dataChunkSize, &encryptedChunkSize, false);
-
-			//Check memory allocation
-			if (!encryptedData)
-				throw("Failed to encrypt data!");
-
-			delete[] rawData;
-
-			outputFile.write((char*)encryptedData, dataChunkSize);
-			outputFile.flush();
-
-			encryptedChunkSize = 0;
-			streamLen -= dataChunkSize;
-
-			delete[] encryptedData;
+		if (this->IVmode) {
+			outputFile.write((char*)this->iv, 16);
 		}
 
-		//Last round with padding
-		rawData = new uint8_t[streamLen * sizeof(uint8_t)];
-
-		//Check memory allocation
-		if (!rawData)
-				throw("Memory allocation failed!");
-
-		//Read data from file into buffer
-		inputFile.read((char*)rawData, streamLen);
+		//Encrypt in chunks, the last one with padding
+		if (!PipeChunks(inputFile, outputFile, streamLen, false))
+			throw("Failed to encrypt the file!");
 
-		encryptedData = Encrypt(rawData, streamLen, &encryptedChunkSize, true);
-
-		//Check memory allocation
-		if (!encryptedData)
-				throw("Failed to encrypt data!");
+		//Authenticated modes close the file with the tag
+		if (GetTagLength()) {
+			uint8_t tag[16];
+			GetTag(tag);
+			outputFile.write((char*)tag, GetTagLength());
+		}
 
-		//Write data to file
-		outputFile.write((char*)encryptedData, encryptedChunkSize);
 		outputFile.flush();
 	}
 	catch (const char* e) {
@@ -299,23 +667,51 @@ void AES_BASE::EncryptFile(const char* inputFileName, const char* outputFileName
 		outputFile.close();
 	if(inputFile.is_open())
 		inputFile.close();
-	if (rawData)
-		delete[] rawData;
-	if (encryptedData)	
-		delete[] encryptedData;
 }
 
 //
 uint8_t* AES_BASE::DecryptBuffer(const uint8_t* src, size_t length, size_t* streamLength) {
+	size_t dataLength = 0;
+
+	if (!ReadFrame(src, length, &dataLength))
+		return nullptr;
+
+	return Decrypt(src + GetFrameOffset(), dataLength, streamLength, true);
+
+}
+
+//
+uint8_t* AES_BASE::DecryptBuffer(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity, size_t* streamLength) {
+	size_t dataLength = 0;
+
+	if (!dst) {
+		std::cerr << "[ERROR] AES Decrypt: Pointer to destination was nullptr!\n";
+		return nullptr;
+	}
 
-	if (this->keyset->GetIVMode()) {
-		this->keyset->ChangeIV(src);
-		src += 16;
-		length -= 16;
+	if (!ReadFrame(src, length, &dataLength))
+		return nullptr;
+
+	if (capacity < dataLength) {
+		std::cerr << "[ERROR] AES Decrypt: Destination is shorter than the encrypted data!\n";
+		return nullptr;
 	}
 
-	return Decrypt(src, length, streamLength, true);
+	memmove(dst, src + GetFrameOffset(), dataLength);
+
+	return (DecryptData(dst, dataLength, streamLength, true) ? dst : nullptr);
+}
+
+//
+uint8_t* AES_BASE::DecryptInPlace(uint8_t* buffer, size_t length, size_t* streamLength) {
+	size_t dataLength = 0;
+
+	if (!ReadFrame(buffer, length, &dataLength))
+		return nullptr;
+
+	uint8_t* data = buffer + GetFrameOffset();
 
+	return (DecryptData(data, dataLength, streamLength, true) ? data : nullptr);
 }
 
 //
@@ -324,14 +720,23 @@ void AES_BASE::DecryptFile(const char* inputFileName, const char* outputFileName
 	std::fstream inputFile;
 	std::fstream outputFile;
 
-	uint8_t* rawData = nullptr;
-	uint8_t* decryptedData = nullptr;
-
 	try {	
 	
 		if (!inputFileName || !outputFileName)
 			throw("filename was nullptr!\n");
 
+		if (this->fileIO == AES_IO_MMAP) {
+			DecryptMapped(inputFileName, outputFileName);
+			return;
+		}
+
+		if (this->fileIO == AES_IO_URING && DecryptRing(inputFileName, outputFileName))
+			return;
+
+		if (this->fileIO == AES_IO_DIRECT) {
+			DecryptDirect(inputFileName, outputFileName);
+			return;
+		}
 		
 		inputFile.open(inputFileName, std::ios::in | std::ios::binary);
 
@@ -341,70 +746,54 @@ void AES_BASE::DecryptFile(const char* inputFileName, const char* outputFileName
 		if (!streamLen)
 			throw("File stream was 0!\n");	//Empty input file
 
-		if ((streamLen & 0x0F) != 0x00)
-			throw("Bad file stream size!");	//Bad file size
-
-		if (this->keyset->GetIVMode()) {
-			uint8_t iv[16] = { 0 };
-			inputFile.read((char*)iv, 16);
-			this->keyset->ChangeIV(iv);
-			streamLen -= 16;
-		}
-
-		//Create output file
-		outputFile.open(outputFileName, std::ios::out | std::ios::binary);
-
-		//The maximum ammount of data (bytes) to work on at once
-		size_t dataChunkSize = (streamLen > this->bufferLimit ? this->bufferLimit : streamLen);
-
-		size_t decryptedChunkSize = 0;
-
-		//Encrypting without padding
-		while (streamLen > dataChunkSize) {
-
-			//Store data from file
-			rawData = new uint8_t[dataChunkSize * sizeof(uint8_t)];
-
-			//Check memory allocation
-			if (!rawData)
+		if (GetMode() < AES_CFB_M && (streamLen & 0x0F) != 0x00)
+			throw("Bad file stream size!");	//Bad file size, only the block modes are padded
+
+		//Header and IV are read once and parsed in memory
+		uint8_t frame[AES_FRAME_MAX];
+		inputFile.read((char*)frame, (streamLen < AES_FRAME_MAX ? streamLen : AES_FRAME_MAX));
+		const char* frameError = ParseFrame(frame, (size_t)inputFile.gcount(), &streamLen);
+		if (frameError)
+			throw(frameError);
+		inputFile.clear();
+		inputFile.seekg((std::streamoff)GetFrameOffset(), std::ios::beg);
+
+		//Authenticated modes check the tag over the whole ciphertext before any plaintext is written
+		if (GetTagLength()) {
+			uint8_t tag[16];
+			std::streampos dataStart = inputFile.tellg();
+			inputFile.seekg(dataStart + (std::streamoff)streamLen);
+			inputFile.read((char*)tag, GetTagLength());
+			inputFile.seekg(dataStart);
+
+			size_t authChunkSize = (streamLen > this->bufferLimit ? this->bufferLimit : streamLen);
+			if (authChunkSize > AES_PIPE_CHUNK)
+				authChunkSize = AES_PIPE_CHUNK;
+
+			if (!this->bufferPool.Reserve(1, authChunkSize))
 				throw("Memory allocation failed!");
+			uint8_t* authData = this->bufferPool.Get(0);
 
-			//Read data from file into buffer
-			inputFile.read((char*)rawData, dataChunkSize);
-
-			decryptedData = Decrypt(rawData, dataChunkSize, &decryptedChunkSize, false);
-
-			//Check memory allocation
-			if (!decryptedData)
-				throw("Failed to decrypt data!");
-
-			outputFile.write((char*)decryptedData, dataChunkSize);
-			outputFile.flush();
+			for (size_t left = streamLen; left; ) {
+				size_t chunk = (left > authChunkSize ? authChunkSize : left);
+				inputFile.read((char*)authData, chunk);
+				AuthenticateStream(authData, chunk);
+				left -= chunk;
+			}
 
-			decryptedChunkSize = 0;
-			streamLen -= dataChunkSize;
+			if (!VerifyTag(tag))
+				throw("Authentication failed, the file was modified or the key is wrong!");
 
-			delete[] rawData;
-			delete[] decryptedData;
+			inputFile.seekg(dataStart);
 		}
 
-		//Last round with padding
-		rawData = new uint8_t[streamLen * sizeof(uint8_t)];
-
-		//Check memory allocation
-		if (!rawData)
-			throw("Memory allocation failed!");
-
-		//Read data from file into buffer
-		inputFile.read((char*)rawData, streamLen);
-
-		decryptedData = Decrypt(rawData, streamLen, &decryptedChunkSize, true);
+		//Create output file
+		outputFile.open(outputFileName, std::ios::out | std::ios::binary);
 
-		//Check memory allocation
-			if (!decryptedData)
-				throw("Failed to decrypt data!");
+		//Decrypt in chunks, the last one without padding
+		if (!PipeChunks(inputFile, outputFile, streamLen, true))
+			throw("Failed to decrypt the file!");
 
-		outputFile.write((char*)decryptedData, decryptedChunkSize);
 		outputFile.flush();
 
 	} catch (const char* e) {
@@ -419,28 +808,124 @@ void AES_BASE::DecryptFile(const char* inputFileName, const char* outputFileName
 		outputFile.close();
 	if(inputFile.is_open())
 		inputFile.close();
-	if (rawData)
-		delete[] rawData;
-	if (decryptedData)	
-		delete[] decryptedData;
 }
 
 //
-size_t AES_BASE::GetFileSizeBytes(FILE* file) {
-	if (!file)
-		return 0;
-	size_t filePointerPos = (size_t)ftell(file);
-	fseek(file, 0, SEEK_END);
-	size_t fileSize = ftell(file);
-	fseek(file, filePointerPos, SEEK_SET);
-	return fileSize;
-}
+bool AES_BASE::EncryptStreams(AES_BASE* const* ciphers, uint8_t* const* streams, const size_t* lengths, size_t count) {
+	if (!ciphers || !streams || !lengths || !count || !ciphers[0])
+		return false;
 
-//
-size_t AES_BASE::GetFileSizeBytes(std::fstream& fs) {
-	std::streampos originalPos = fs.tellg();
-	fs.seekg(0, std::ios::beg);
-	std::streampos startPos = fs.tellg();
+	/*
+	 *
+	 *	Note: 	CBC, CFB and OFB encryption is serial within a stream, every
+	 *			block waits for the one before it. Taking one block from each of
+	 *			several streams gives the backend independent blocks to
+	 *			interleave. A lane takes the next stream as soon as its stream ends.
+	 * 
+	*/
+
+	const AES_BASE* lead = ciphers[0];
+	const AES_MODE mode = lead->GetMode();
+
+	struct Lane {
+		AES_BASE* cipher;
+		uint8_t* stream;
+		size_t length;
+		size_t done;
+	};
+
+	Lane lanes[AES_MULTI_LANES];
+	bool encrypted = true;
+	uint8_t blocks[AES_MULTI_LANES * 16];
+	size_t active = 0;
+	size_t next = 0;
+
+	while (true) {
+		//Fill the free lanes, streams that cannot share the kernel call are encrypted on their own
+		while (active < AES_MULTI_LANES && next < count) {
+			AES_BASE* cipher = ciphers[next];
+			uint8_t* stream = streams[next];
+			size_t length = lengths[next];
+			next++;
+
+			bool fits = cipher && stream && length && cipher->GetMode() == mode && cipher->keyset == lead->keyset && cipher->kernel == lead->kernel &&
+				((mode == AES_CBC_M && !(length & 0x0F) && !cipher->IsParallel(false)) || mode == AES_CFB_M || (mode == AES_OFB_M && !static_cast<AES_OFB*>(cipher)->HasKeystream()));
+
+			if (!fits) {
+				if (!cipher || !cipher->EncryptStream(stream, length))
+					encrypted = false;
+				continue;
+			}
+
+			lanes[active++] = { cipher, stream, length, 0 };
+		}
+
+		if (!active)
+			break;
+
+		//Block cipher input of every lane
+		for (size_t l = 0; l < active; l++) {
+			uint8_t* block = blocks + l * 16;
+			if (mode == AES_CBC_M) {
+				memcpy(block, lanes[l].stream + lanes[l].done, 16);
+				lead->BlockXOR(block, lanes[l].cipher->chainBlock);
+			}
+			else
+				memcpy(block, lanes[l].cipher->chainBlock, 16);
+		}
+
+		lead->EncryptBlocks(blocks, blocks, active);
+
+		//Chain and output of every lane, finished lanes are replaced by the last one
+		for (size_t l = active; l-- > 0; ) {
+			Lane& lane = lanes[l];
+			uint8_t* block = blocks + l * 16;
+			uint8_t* data = lane.stream + lane.done;
+			size_t bytes = (lane.length - lane.done < 16 ? lane.length - lane.done : 16);
+
+			switch (mode) {
+			case AES_CBC_M:
+				memcpy(data, block, 16);
+				memcpy(lane.cipher->chainBlock, block, 16);
+				break;
+
+			case AES_CFB_M:
+				lead->BlockXOR(block, data, bytes);
+				memcpy(data, block, bytes);
+				memcpy(lane.cipher->chainBlock, block, 16);
+				break;
+
+			default:
+				memcpy(lane.cipher->chainBlock, block, 16);
+				lead->BlockXOR(data, block, bytes);
+				break;
+			}
+
+			lane.done += bytes;
+			if (lane.done == lane.length)
+				lanes[l] = lanes[--active];
+		}
+	}
+
+	return encrypted;
+}
+
+//
+size_t AES_BASE::GetFileSizeBytes(FILE* file) {
+	if (!file)
+		return 0;
+	size_t filePointerPos = (size_t)ftell(file);
+	fseek(file, 0, SEEK_END);
+	size_t fileSize = ftell(file);
+	fseek(file, filePointerPos, SEEK_SET);
+	return fileSize;
+}
+
+//
+size_t AES_BASE::GetFileSizeBytes(std::fstream& fs) {
+	std::streampos originalPos = fs.tellg();
+	fs.seekg(0, std::ios::beg);
+	std::streampos startPos = fs.tellg();
 	fs.seekg(0, std::ios::end);
 	std::streampos endPos = fs.tellg();
 	fs.seekg(originalPos, std::ios::beg);
@@ -449,16 +934,56 @@ size_t AES_BASE::GetFileSizeBytes(std::fstream& fs) {
 
 //
 void AES_BASE::SetIV(const uint8_t* iv) {
-	// No check needed here, because ChangeIV() checks for nullptr
-	this->keyset->ChangeIV(iv);
+	if (iv)		//Only copy if *iv is not nullptr
+		memcpy(this->iv, iv, 16);
+	ResetChain();
 }
 
 //
 void AES_BASE::GetIV(uint8_t* dst) const {
-	// No check needed here, because GetIV() checks for nullptr
-	this->keyset->GetIV(dst);
+	if (dst)	//Only copy if *dst is not nullptr
+		memcpy(dst, this->iv, 16);
+}
+
+//
+void AES_BASE::SetIVMode(bool mode) {
+	this->IVmode = mode;
+}
+
+//
+bool AES_BASE::GetIVMode() const {
+	return this->IVmode;
+}
+
+//
+std::shared_ptr<const AES_KEYSET> AES_BASE::GetKeyset() const {
+	return this->keyset;
+}
+
+//
+uint8_t AES_BASE::GetTagLength() const {
+	return 0;
+}
+
+//
+void AES_BASE::SetTextLength(size_t length) {}
+
+//
+size_t AES_BASE::GetMaxLength() const {
+	return SIZE_MAX;
+}
+
+//
+void AES_BASE::GetTag(uint8_t* dst) {}
+
+//
+uint8_t AES_BASE::GetHeaderLength() const {
+	return 0;
 }
 
+//
+void AES_BASE::GetHeader(uint8_t* dst) const {}
+
 //
 const inline AES_MODE AES_BASE::GetMode() const {
 	return this->aesMode;
@@ -482,6 +1007,15 @@ const inline char* AES_BASE::GetModeStr() const {
 
 	case AES_OFB_M:
 		return "AES OFB";
+
+	case AES_CTR_M:
+		return "AES CTR";
+
+	case AES_GCM_M:
+		return "AES GCM";
+
+	case AES_XTS_M:
+		return "AES XTS";
 	
 	default:
 		return "AES UNKNOWN";
@@ -493,20 +1027,15 @@ const inline char* AES_BASE::GetModeStr() const {
 //	#
 
 //
-inline void AES_BASE::EncryptBlock(uint8_t* block) {
+inline void AES_BASE::EncryptBlock(uint8_t* block) const {
 	if (!block)
 		return;
-	keyset->AddRoundKey(block, 0);
-	for (uint8_t i = 1; i < 10; i++)
-	{
-		SubBytes(block);
-		ShiftRowsLeft(block);
-		MixColumns(block);
-		keyset->AddRoundKey(block, i);
-	}
-	SubBytes(block);
-	ShiftRowsLeft(block);
-	keyset->AddRoundKey(block, 10);
+	kernel->EncryptBlock(keyset.get(), block);
+}
+
+//
+inline void AES_BASE::EncryptBlocks(const uint8_t* src, uint8_t* dst, size_t count) const {
+	kernel->EncryptBlocks(keyset.get(), src, dst, count);
 }
 
 //
@@ -516,382 +1045,2101 @@ uint8_t* AES_BASE::Encrypt(const uint8_t* src, size_t length, size_t* streamLeng
 		return nullptr;
 	}
 
-	if (!length) {
-		std::cerr << "[ERROR] AES Encrypt: Source length was 0!\n";
-		return nullptr;
-	}
-
-	if(!streamLength) {
-		std::cerr << "[ERROR] AES Encrypt: streamLength variable was nullptr!\n";
-		return nullptr;
-	}
-
-	*streamLength = length + (attachPadding ? ((length & 0x0F) == 0 ? 16 : 16 - (length & 0x0F)) : 0);
+	//Room for the padding
+	uint8_t* dstStream = new uint8_t[length + 16];
 
-	size_t allocLength = *streamLength;
+	std::memcpy(dstStream, src, length);
 
-	uint8_t* dstStream = new uint8_t[allocLength];
-	
-	if (!dstStream)	{
-		std::cout << "[ERROR] AES Encrypt: Memory allocation failed!\n"; //Mem. allocation falied
+	if (!EncryptData(dstStream, length, streamLength, attachPadding)) {
 		delete[] dstStream;
 		return nullptr;
 	}
 
-	std::memcpy(dstStream, src, length);
-
-	//Padding block with #PKCS7 standard
-	if (this->GetMode() < AES_CFB_M && attachPadding)
-		for (size_t i = (*streamLength) - 1; i >= length; i--)
-			dstStream[i] = ((length & 0x0F) == 0 ? 16 : 16 - (length & 0x0F));
-
-	EncryptStream(dstStream, *streamLength);
-
 	return dstStream;
 }
 
 //
-inline void AES_BASE::DecryptBlock(uint8_t* block) {
-	if (!block)
-		return;
-	keyset->AddRoundKey(block, 10);
-	for (uint8_t i = 9; i > 0; i--) {
-		ShiftRowsRight(block);
-		SubBytesInv(block);
-		keyset->AddRoundKey(block, i);
-		MixColumnsInv(block);
-	}
-	ShiftRowsRight(block);
-	SubBytesInv(block);
-	keyset->AddRoundKey(block, 0);
-}
-
-//
-uint8_t* AES_BASE::Decrypt(const uint8_t* src, size_t length, size_t* streamLength, bool removePadding) {
-	if (!src) {
-		std::cerr << "[ERROR] AES Decrypt: Pointer to source was nullptr!\0";		//Define error	->	__null src or length
-		return nullptr;
+bool AES_BASE::EncryptData(uint8_t* data, size_t length, size_t* streamLength, bool attachPadding) {
+	if (!data) {
+		std::cerr << "[ERROR] AES Encrypt: Pointer to source was nullptr!\n";
+		return false;
 	}
 
 	if (!length) {
-		std::cerr << "[ERROR] AES Decrypt: Source length was 0!\n";
-		return nullptr;
-	}
-
-	if ((length & 0x0F) != 0) {
-		std::cerr << "[ERROR] AES Decrypt: Bad file stream size!\n";	//Bad file size
-		return nullptr;
+		std::cerr << "[ERROR] AES Encrypt: Source length was 0!\n";
+		return false;
 	}
 
 	if(!streamLength) {
-		std::cerr << "[ERROR] AES Decrypt: streamLength variable was nullptr!\n";
-		return nullptr;
+		std::cerr << "[ERROR] AES Encrypt: streamLength variable was nullptr!\n";
+		return false;
 	}
 
-	uint8_t* dstStream = new uint8_t[length];
-
-	//Check memory allocation
-	if (!dstStream)	{
-		std::cerr << "[ERROR] AES Decrypt: Memory allocation failed!\n";		//Define error	->	Mem. allocation falied
-		return nullptr;
+	if (GetMode() == AES_XTS_M && length < 16) {
+		std::cerr << "[ERROR] AES Encrypt: XTS needs at least one whole block!\n";
+		return false;
 	}
 
-	std::memcpy(dstStream, src, length);
-
-	DecryptStream(dstStream, length);
+	if (length > GetMaxLength()) {
+		std::cerr << "[ERROR] AES Encrypt: Source is too long for one IV of the mode!\n";
+		return false;
+	}
 
-	if (this->GetMode() < AES_CFB_M && removePadding)
-		*streamLength = length - dstStream[length - 1];
+	//Only the block modes are padded, the stream modes keep the source length
+	*streamLength = (attachPadding && this->GetMode() < AES_CFB_M ? AttachPadding(data, length) : length);
 
-	return dstStream;
+	return EncryptStream(data, *streamLength);
 }
 
 //
-inline void AES_BASE::SubBytes(uint8_t* block) {
-	for (uint8_t i = 0; i < 16; i++)
-		block[i] = sBox[block[i] >> 4][block[i] & 0x0F];
+inline void AES_BASE::DecryptBlock(uint8_t* block) const {
+	if (!block)
+		return;
+	kernel->DecryptBlock(keyset.get(), block);
 }
 
 //
-inline void AES_BASE::SubBytesInv(uint8_t* block) {
-	for (uint8_t i = 0; i < 16; i++)
-		block[i] = sBoxInv[block[i] >> 4][block[i] & 0x0F];
+inline void AES_BASE::DecryptBlocks(const uint8_t* src, uint8_t* dst, size_t count) const {
+	kernel->DecryptBlocks(keyset.get(), src, dst, count);
 }
 
 //
-inline void AES_BASE::ShiftRowsLeft(uint8_t* block) {
-	procArray[0] = block[0];
-	procArray[1] = block[5];
-	procArray[2] = block[10];
-	procArray[3] = block[15];
-	procArray[4] = block[4];
-	procArray[5] = block[9];
-	procArray[6] = block[14];
-	procArray[7] = block[3];
-	procArray[8] = block[8];
-	procArray[9] = block[13];
-	procArray[10] = block[2];
-	procArray[11] = block[7];
-	procArray[12] = block[12];
-	procArray[13] = block[1];
-	procArray[14] = block[6];
-	procArray[15] = block[11];
-	std::memcpy(block, procArray, 16);
-}
+bool AES_BASE::ClearIV() {
+	//A repeated IV repeats the CTR and GCM keystream, so it has to come from a CSPRNG
+	uint8_t fresh[16];
+
+#ifdef __linux__
+	for (size_t done = 0; done < 16; ) {
+		ssize_t result = getrandom(fresh + done, 16 - done, 0);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+			return false;
+		done += (size_t)result;
+	}
+#else
+	try {
+		std::random_device source;
+		for (uint8_t i = 0; i < 16; i += 4) {
+			uint32_t word = source();
+			memcpy(fresh + i, &word, 4);
+		}
+	}
+	catch (const std::exception&) {
+		return false;
+	}
+#endif
 
-//
-inline void AES_BASE::ShiftRowsRight(uint8_t* block) {
-	procArray[0] = block[0];
-	procArray[1] = block[13];
-	procArray[2] = block[10];
-	procArray[3] = block[7];
-	procArray[4] = block[4];
-	procArray[5] = block[1];
-	procArray[6] = block[14];
-	procArray[7] = block[11];
-	procArray[8] = block[8];
-	procArray[9] = block[5];
-	procArray[10] = block[2];
-	procArray[11] = block[15];
-	procArray[12] = block[12];
-	procArray[13] = block[9];
-	procArray[14] = block[6];
-	procArray[15] = block[3];
-	std::memcpy(block, procArray, 16);
+	memcpy(this->iv, fresh, 16);
+	return true;
 }
 
 //
-inline void AES_BASE::MixColumns(uint8_t* block) {
-	for (uint8_t i = 0; i < 4; i++)
-		for (uint8_t mult = 0; mult < 4; mult++)
-			procArray[i * 4 + mult] = GFMult(constMatrix[mult][0], block[i * 4]) ^ GFMult(constMatrix[mult][1], block[i * 4 + 1]) ^ GFMult(constMatrix[mult][2], block[i * 4 + 2]) ^ GFMult(constMatrix[mult][3], block[i * 4 + 3]);
-	std::memcpy(block, procArray, 16);
+void AES_BASE::ResetChain() {
+	memcpy(this->chainBlock, this->iv, 16);
 }
 
 //
-inline void AES_BASE::MixColumnsInv(uint8_t* block) {
-	for (uint8_t i = 0; i < 4; i++)
-		for (uint8_t mult = 0; mult < 4; mult++)
-			procArray[i * 4 + mult] = GFMult(constMatrixInv[mult][0], block[i * 4]) ^ GFMult(constMatrixInv[mult][1], block[i * 4 + 1]) ^ GFMult(constMatrixInv[mult][2], block[i * 4 + 2]) ^ GFMult(constMatrixInv[mult][3], block[i * 4 + 3]);
-	std::memcpy(block, procArray, 16);
-}
+void AES_BASE::AuthenticateStream(const uint8_t* stream, size_t length) {}
 
 //
-inline uint8_t AES_BASE::GFMult(uint8_t multiplier, uint8_t multiplicant) {
-	switch (multiplier)
-	{
-	case 1:
-		return multiplicant;
-	case 2:
-		return mul_2[multiplicant];
-	case 3:
-		return mul_3[multiplicant];
-	case 9:
-		return mul_9[multiplicant];
-	case 11:
-		return mul_11[multiplicant];
-	case 13:
-		return mul_13[multiplicant];
-	case 14:
-		return mul_14[multiplicant];
-	default:
-		return 0;
-	}
-	return (uint8_t)(multiplicant >= GF_MULT_OVERFLOW ? (multiplicant - GF_MULT_OVERFLOW) ^ 0x1B : multiplicant);
+bool AES_BASE::SetHeader(const uint8_t* header) {
+	return true;
 }
 
 //
-inline void AES_BASE::BlockXOR(uint8_t* block_a, const uint8_t* block_b, const size_t length) {
-	if (!block_a || !block_b || !length)
-		return;
-	
-	for (size_t i = 0; i < length; i++)
-		block_a[i] = block_a[i] ^ block_b[i];
+bool AES_BASE::DetectHeader(const uint8_t* start, size_t length) {
+	return true;
 }
 
-/*
- * ************************************
- * ************************************
- *				AES_ECB
- * ************************************
- * ************************************
-*/
-
-// 
-//	Public functions
 //
+bool AES_BASE::VerifyTag(const uint8_t* tag) {
+	uint8_t expected[16];
+	GetTag(expected);
 
-//
-AES_ECB::AES_ECB(const uint8_t* key) {
-	this->keyset = new AES_KEYSET(key);
-	
-	//Never embed or read IV from file, because ECB uses no IV
-	keyset->SetIVMode(false);
+	//Compare every byte, the position of the first mismatch must not show in the timing
+	uint8_t diff = 0;
+	for (uint8_t i = 0; i < GetTagLength(); i++)
+		diff |= expected[i] ^ tag[i];
+
+	return diff == 0;
 }
 
 //
-void AES_ECB::EncryptStream(uint8_t* stream, size_t length) {
-	
-	if (!stream) {
-		std::cout << "AES ECB - EncryptStream: stream was NULL.\n";
-		return;
+uint8_t* AES_BASE::Decrypt(const uint8_t* src, size_t length, size_t* streamLength, bool removePadding) {
+	if (!src) {
+		std::cerr << "[ERROR] AES Decrypt: Pointer to source was nullptr!\n";
+		return nullptr;
 	}
 
-	if (!length) {
-		std::cout << "AES ECB - EncryptStream: length was 0.";
-		return;
-	}
+	uint8_t* dstStream = new uint8_t[length ? length : 1];
 
-	if (length & 16) {
-		std::cout << "AES ECB - EncryptStream: wrong stream length. Must be a multiple of 16.";
-		return;
-	}
+	std::memcpy(dstStream, src, length);
 
-	//Calculate block count
-	size_t blcks = length / 16;
+	if (!DecryptData(dstStream, length, streamLength, removePadding)) {
+		delete[] dstStream;
+		return nullptr;
+	}
 
-	//Encrypt blocks
-	for (size_t i = 0; i < blcks; i++)
-		EncryptBlock(stream + i * 16);
+	return dstStream;
 }
 
 //
-void AES_ECB::DecryptStream(uint8_t* stream, size_t length) {
-	if (!stream) {
-		std::cout << "AES ECB - DecryptStream: stream was NULL.\n";
-		return;
+bool AES_BASE::DecryptData(uint8_t* data, size_t length, size_t* streamLength, bool removePadding) {
+	if (!data) {
+		std::cerr << "[ERROR] AES Decrypt: Pointer to source was nullptr!\n";
+		return false;
 	}
 
 	if (!length) {
-		std::cout << "AES ECB - DecryptStream: length was 0.";
-		return;
+		std::cerr << "[ERROR] AES Decrypt: Source length was 0!\n";
+		return false;
 	}
 
-	if (length & 16) {
-		std::cout << "AES ECB - DecryptStream: wrong stream length. Must be a multiple of 16.";
-		return;
+	if (GetMode() < AES_CFB_M && (length & 0x0F) != 0) {
+		std::cerr << "[ERROR] AES Decrypt: Bad file stream size!\n";	//Bad file size
+		return false;
 	}
 
-	//Calculate block count
-	size_t blcks = length / 16;
+	if(!streamLength) {
+		std::cerr << "[ERROR] AES Decrypt: streamLength variable was nullptr!\n";
+		return false;
+	}
 
-	//Decrypt blocks
-	for (size_t i = 0; i < blcks; i++)
-		DecryptBlock(stream + i * 16);
-}
+	if (GetMode() == AES_XTS_M && length < 16) {
+		std::cerr << "[ERROR] AES Decrypt: XTS needs at least one whole block!\n";
+		return false;
+	}
 
-//
-AES_ECB::~AES_ECB() {
-	delete keyset;
-}
+	if (!DecryptStream(data, length))
+		return false;
 
-// 
-//	Private functions
-//
+	*streamLength = length;
 
+	//Remove the #PKCS7 padding of the last block
+	if (this->GetMode() < AES_CFB_M && removePadding) {
+		//The pad value is 1 - 16 and every pad byte holds it. All 16 bytes are compared without branching on the data.
+		uint32_t pad = data[length - 1];
+		uint32_t bad = ((pad - 1) >> 31) | ((16 - pad) >> 31);
 
+		for (uint32_t i = 1; i <= 16; i++) {
+			uint32_t inside = ~((pad - i) >> 31) & 1;
+			bad |= inside * (uint32_t)(data[length - i] ^ pad);
+		}
 
-/*
- * ************************************
- * ************************************
- *				AES_CBC
- * ************************************
- * ************************************
-*/
+		if (bad) {
+			std::cerr << "[ERROR] AES Decrypt: Bad padding!\n";
+			return false;
+		}
 
-// 	#
-//	#	Public functions
-//	#
+		*streamLength = length - pad;
+	}
 
-//
-AES_CBC::AES_CBC(const uint8_t* key, const uint8_t* iv) {
-	this->keyset = new AES_KEYSET(key);
-	keyset->ChangeIV(iv);
+	return true;
 }
 
 //
-void AES_CBC::EncryptStream(uint8_t* stream, size_t length) {
-	if (!stream) {
-		std::cerr << "[ERROR] AES CBC Encrypt Stream: EncryptStream: stream was NULL.\n";
-		return;
-	}
+const char* AES_BASE::ParseFrame(const uint8_t* frame, size_t frameLength, size_t* streamLength) {
+	//The first bytes tell if there is a header, e.g. of segmented CBC
+	if (!DetectHeader(frame, frameLength))
+		return "Bad format header!";
 
-	if (!length) {
-		std::cerr << "[ERROR] AES CBC Encrypt stream: EncryptStream: length was 0.";
-		return;
-	}
+	//The header selects the format of the rest, e.g. the CBC segment size
+	size_t headerLength = GetHeaderLength();
+	size_t offset = GetFrameOffset();
 
-	if (length & 0x0F) {
-		std::cerr << "[ERROR] AES CBC EncryptStream: wrong stream length. Must be a multiple of 16.";
-		return;
-	}
+	if (*streamLength < offset || frameLength < offset)
+		return "Bad stream size!";
 
-	//Calculate block count
-	size_t blcks = length / 16;
+	if (headerLength && !SetHeader(frame))
+		return "Bad format header!";
 
-	//Encrypt first block with the keyset IV
-	this->keyset->XORIV(stream);
-	EncryptBlock(stream);
+	if (this->IVmode)
+		memcpy(this->iv, frame + headerLength, 16);
 
-	//Encrypt remaining blocks with the previous block as IV
-	for (size_t i = 1; i < blcks; i++) {
-		this->keyset->XORIV(stream + i * 16, stream + (i - 1) * 16);
-		EncryptBlock(stream + i * 16);
-	}
+	ResetChain();
+	size_t length = *streamLength - offset;
+
+	//Authenticated modes end with the tag, there must be data before it
+	if (length <= GetTagLength())
+		return "Bad stream size!";
+	length -= GetTagLength();
+
+	//Only the block modes are padded, XTS needs one whole block
+	if ((GetMode() < AES_CFB_M && (length & 0x0F)) || (GetMode() == AES_XTS_M && length < 16))
+		return "Bad stream size!";
+
+	*streamLength = length;
+	return nullptr;
 }
 
 //
-void AES_CBC::DecryptStream(uint8_t* stream, size_t length) {
-	if (!stream) {
-		std::cerr << "[ERROR] AES CBC Decrypt Stream: DecryptStream: stream was NULL.\n";
-		return;
-	}
-
-	if (!length) {
-		std::cerr << "[ERROR] AES CBC Decrypt Stream: DecryptStream: length was 0.";
-		return;
+bool AES_BASE::ReadFrame(const uint8_t* src, size_t length, size_t* dataLength) {
+	if (!src) {
+		std::cerr << "[ERROR] AES Decrypt: Pointer to source was nullptr!\n";
+		return false;
 	}
 
-	if (length & 0x0F) {
-		std::cerr << "[ERROR] AES CBC Decrypt Stream: DecryptStream: wrong stream length. Must be a multiple of 16.";
-		return;
+	const char* frameError = ParseFrame(src, (length < AES_FRAME_MAX ? length : AES_FRAME_MAX), &length);
+	if (frameError) {
+		std::cerr << "[ERROR] " << GetModeStr() << " Decrypt: " << frameError << "\n";
+		return false;
 	}
 
-	//Calculate block count
-	size_t blcks = length / 16;
-
-	//Array to store the original previous block 
-	uint8_t prevBlock[16] = { 0 };
-	this->keyset->GetIV(prevBlock);
-
-	//Encrypt remaining blocks with the previous block as IV
-	size_t i = 0;
-	for (; i < blcks; i++) {
-		//Save current block's original state to the processing array
-		memcpy(this->procArray, stream + i * 16, 16);
+	src += GetFrameOffset();
 
-		DecryptBlock(stream + i * 16);
-		this->keyset->XORIV(stream + i * 16, prevBlock);
+	//Check the tag over the whole ciphertext before decrypting anything
+	if (GetTagLength()) {
+		AuthenticateStream(src, length);
 
-		//Copy the current block's original form to the previous block array for the next round
-		memcpy(prevBlock, this->procArray, 16);
+		if (!VerifyTag(src + length)) {
+			std::cerr << "[ERROR] " << GetModeStr() << " Decrypt: Authentication failed!\n";
+			return false;
+		}
 	}
+
+	*dataLength = length;
+	return true;
 }
 
 //
-AES_CBC::~AES_CBC() {
-	delete keyset;
+size_t AES_BASE::AttachPadding(uint8_t* stream, size_t length) const {
+	//Padding block with #PKCS7 standard
+	uint8_t padding = ((length & 0x0F) == 0 ? 16 : 16 - (length & 0x0F));
+	memset(stream + length, padding, padding);
+	return length + padding;
+}
+
+//
+size_t AES_BASE::SplitChunks(size_t length, size_t* chunkSize, size_t* lastSize, size_t align) const {
+	//The maximum ammount of data (bytes) to work on at once
+	*chunkSize = (this->bufferLimit < AES_PIPE_CHUNK ? this->bufferLimit : AES_PIPE_CHUNK);
+	*chunkSize = (*chunkSize > align ? *chunkSize / align * align : align);
+
+	size_t chunks = (length > *chunkSize + 16 ? (length - 17) / *chunkSize : 0) + 1;
+	*lastSize = length - (chunks - 1) * *chunkSize;
+	return chunks;
+}
+
+//
+bool AES_BASE::CryptChunk(uint8_t* chunk, size_t length, bool last, size_t* streamLength, bool decrypt) {
+	//The last chunk is checked and padded like a whole buffer
+	if (last)
+		return (decrypt ? DecryptData(chunk, length, streamLength, true) : EncryptData(chunk, length, streamLength, true));
+
+	*streamLength = length;
+	return (decrypt ? DecryptStream(chunk, length) : EncryptStream(chunk, length));
+}
+
+//
+bool AES_BASE::PipeChunks(std::fstream& inputFile, std::fstream& outputFile, size_t length, bool decrypt) {
+	return PipeStages(length, 16, 0,
+		[&](uint8_t* buffer, uint64_t position, size_t bytes) {
+			inputFile.read((char*)buffer, bytes);
+			return (bool)inputFile;
+		},
+		[&](uint8_t* buffer, size_t bytes, bool last, size_t* outputLength) {
+			return CryptChunk(buffer, bytes, last, outputLength, decrypt);
+		},
+		[&](uint8_t* buffer, size_t bytes, bool last) {
+			outputFile.write((char*)buffer, bytes);
+			return (bool)outputFile;
+		});
+}
+
+//
+bool AES_BASE::PipeStages(size_t length, size_t align, size_t slack,
+	const std::function<bool(uint8_t* buffer, uint64_t position, size_t length)>& reader,
+	const std::function<bool(uint8_t* buffer, size_t length, bool last, size_t* outputLength)>& processor,
+	const std::function<bool(uint8_t* buffer, size_t length, bool last)>& writer) {
+	/*
+	 *
+	 *	Note: 	The buffers go round from the reader thread to the cipher on
+	 *			this thread, to the writer thread and back to the reader.
+	 *			Chunk k uses buffer k % AES_PIPE_BUFFERS, every stage only
+	 *			waits for the stage before it, so reading, processing and
+	 *			writing different chunks overlap.
+	 * 
+	*/
+
+	size_t chunkSize = 0;
+	size_t lastSize = 0;
+	size_t chunks = SplitChunks(length, &chunkSize, &lastSize, align);
+
+	//The whole text is known here, e.g. OFB generates its keystream ahead up to it
+	SetTextLength(length);
+
+	const size_t bufferCount = (chunks < AES_PIPE_BUFFERS ? chunks : AES_PIPE_BUFFERS);
+
+	//Room for the longer last chunk and its padding
+	if (!this->bufferPool.Reserve(bufferCount, (chunks > 1 ? chunkSize + 16 : lastSize) + 16 + slack))
+		return false;
+
+	size_t outputLengths[AES_PIPE_BUFFERS];
+
+	//Chunks finished by each stage
+	size_t read = 0;
+	size_t processed = 0;
+	size_t written = 0;
+	bool failed = false;
+
+	std::mutex lock;
+	std::condition_variable moved;
+
+	auto ReadChunk = [&](size_t k) {
+		return reader(this->bufferPool.Get(k % bufferCount), k * chunkSize, (k + 1 < chunks ? chunkSize : lastSize));
+	};
+
+	auto ProcessChunk = [&](size_t k) {
+		return processor(this->bufferPool.Get(k % bufferCount), (k + 1 < chunks ? chunkSize : lastSize), k + 1 == chunks, &outputLengths[k % bufferCount]);
+	};
+
+	auto WriteChunk = [&](size_t k) {
+		return writer(this->bufferPool.Get(k % bufferCount), outputLengths[k % bufferCount], k + 1 == chunks);
+	};
+
+	//One chunk has nothing to overlap
+	if (chunks == 1)
+		return ReadChunk(0) && ProcessChunk(0) && WriteChunk(0);
+
+	//Let the waiting stages know a chunk moved on (or the pipeline stopped)
+	auto Finish = [&](size_t& counter, bool ok) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (ok)
+				counter++;
+			else
+				failed = true;
+		}
+		moved.notify_all();
+	};
+
+	auto Wait = [&](const size_t& counter, size_t target) {
+		std::unique_lock<std::mutex> guard(lock);
+		moved.wait(guard, [&] { return counter >= target || failed; });
+		return !failed;
+	};
+
+	std::thread readThread([&] {
+		for (size_t k = 0; k < chunks; k++) {
+			//Wait until the writer gives the buffer back
+			if (k >= bufferCount && !Wait(written, k - bufferCount + 1))
+				return;
+
+			Finish(read, ReadChunk(k));
+		}
+	});
+
+	std::thread writeThread([&] {
+		for (size_t k = 0; k < chunks; k++) {
+			if (!Wait(processed, k + 1))
+				return;
+
+			Finish(written, WriteChunk(k));
+		}
+	});
+
+	for (size_t k = 0; k < chunks; k++) {
+		if (!Wait(read, k + 1))
+			break;
+
+		Finish(processed, ProcessChunk(k));
+	}
+
+	readThread.join();
+	writeThread.join();
+
+	return !failed;
+}
+
+//
+void AES_BASE::EncryptMapped(const char* inputFileName, const char* outputFileName) {
+#ifdef AES_FILE_MMAP
+	AES_MAPPED_FILE inputFile;
+	AES_MAPPED_FILE outputFile;
+	struct stat info;
+
+	inputFile.fd = open(inputFileName, O_RDONLY);
+	if (inputFile.fd < 0 || fstat(inputFile.fd, &info))
+		throw("Cannot open input file!");
+
+	inputFile.length = (size_t)info.st_size;
+
+	if (!inputFile.length)
+		throw("File stream was 0!\n");	//Empty input file
+
+	if (GetMode() == AES_XTS_M && inputFile.length < 16)
+		throw("XTS needs at least one whole block!");
+
+	if (inputFile.length > GetMaxLength())
+		throw("File is too long for one IV of the mode!");
+
+	//The padding rules give the final length, so the output is sized before anything is written
+	outputFile.fd = open(outputFileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	outputFile.length = GetEncryptedLength(inputFile.length);
+	if (outputFile.fd < 0 || ftruncate(outputFile.fd, (off_t)outputFile.length))
+		throw("Cannot create output file!");
+
+	if (!inputFile.Map(false) || !outputFile.Map(true))
+		throw("Cannot map the files into memory!");
+
+	size_t offset = GetFrameOffset();
+	size_t dataLength = 0;
+
+	if (!CryptMapped(inputFile.data, outputFile.data + offset, inputFile.length, &dataLength, false))
+		throw("Failed to encrypt data!");
+
+	//Frame the ciphertext with the header and the IV before and the authentication tag after it
+	GetHeader(outputFile.data);
+	GetIV(this->IVmode ? outputFile.data + GetHeaderLength() : nullptr);
+	GetTag(outputFile.data + offset + dataLength);
+#else
+	throw("Memory mapped files are not supported on this platform!");
+#endif
+}
+
+//
+void AES_BASE::DecryptMapped(const char* inputFileName, const char* outputFileName) {
+#ifdef AES_FILE_MMAP
+	AES_MAPPED_FILE inputFile;
+	AES_MAPPED_FILE outputFile;
+	struct stat info;
+
+	inputFile.fd = open(inputFileName, O_RDONLY);
+	if (inputFile.fd < 0 || fstat(inputFile.fd, &info))
+		throw("Cannot open input file!");
+
+	inputFile.length = (size_t)info.st_size;
+
+	if (!inputFile.length)
+		throw("File stream was 0!\n");	//Empty input file
+
+	if (GetMode() < AES_CFB_M && (inputFile.length & 0x0F) != 0x00)
+		throw("Bad file stream size!");	//Bad file size, only the block modes are padded
+
+	if (!inputFile.Map(false))
+		throw("Cannot map the input file into memory!");
+
+	//Header, IV and the tag over the whole mapped ciphertext
+	size_t dataLength = 0;
+	if (!ReadFrame(inputFile.data, inputFile.length, &dataLength))
+		throw("Bad file or authentication failed!");
+
+	//Sized for the data with padding, cut to the plaintext length at the end
+	outputFile.fd = open(outputFileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	outputFile.length = dataLength;
+	if (outputFile.fd < 0 || ftruncate(outputFile.fd, (off_t)outputFile.length))
+		throw("Cannot create output file!");
+
+	if (!outputFile.Map(true))
+		throw("Cannot map the output file into memory!");
+
+	size_t streamLength = 0;
+
+	if (!CryptMapped(inputFile.data + GetFrameOffset(), outputFile.data, dataLength, &streamLength, true))
+		throw("Failed to decrypt data!");
+
+	if (streamLength != dataLength && ftruncate(outputFile.fd, (off_t)streamLength))
+		throw("Cannot remove the padding from the output file!");
+#else
+	throw("Memory mapped files are not supported on this platform!");
+#endif
+}
+
+//
+bool AES_BASE::CryptMapped(const uint8_t* src, uint8_t* dst, size_t length, size_t* streamLength, bool decrypt) {
+	for (size_t done = 0; ; ) {
+		size_t left = length - done;
+		bool last = (left <= AES_PIPE_CHUNK + 16);
+
+		//Whole chunks go from the source straight to the destination mapping, the last one up to its final block or two
+		size_t bytes = (!last ? AES_PIPE_CHUNK : left > 32 ? (left - 17) / 16 * 16 : 0);
+
+		if (bytes && !CryptStream(src + done, dst + done, bytes, decrypt))
+			return false;
+		done += bytes;
+
+		//The rest keeps a whole block before a partial one (XTS ciphertext stealing), it is copied, checked and padded in place
+		if (last) {
+			size_t chunkLength = 0;
+			memcpy(dst + done, src + done, length - done);
+
+			if (!CryptChunk(dst + done, length - done, true, &chunkLength, decrypt))
+				return false;
+
+			*streamLength = done + chunkLength;
+			return true;
+		}
+	}
+}
+
+//
+bool AES_BASE::CryptStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt) {
+	if (src != dst)
+		memcpy(dst, src, length);
+	return (decrypt ? DecryptStream(dst, length) : EncryptStream(dst, length));
+}
+
+//
+bool AES_BASE::EncryptRing(const char* inputFileName, const char* outputFileName) {
+#ifdef AES_FILE_URING
+	//Room for every request of every buffer, the last chunk can take one more
+	AES_URING ring;
+	if (!ring.Setup(AES_PIPE_BUFFERS * (AES_PIPE_CHUNK / AES_RING_REQUEST + 1)))
+		return false;
+
+	AES_MAPPED_FILE inputFile;
+	AES_MAPPED_FILE outputFile;
+	struct stat info;
+
+	inputFile.fd = open(inputFileName, O_RDONLY);
+	if (inputFile.fd < 0 || fstat(inputFile.fd, &info))
+		throw("Cannot open input file!");
+
+	size_t streamLen = (size_t)info.st_size;
+
+	if (!streamLen)
+		throw("File stream was 0!\n");	//Empty input file
+
+	if (GetMode() == AES_XTS_M && streamLen < 16)
+		throw("XTS needs at least one whole block!");
+
+	if (streamLen > GetMaxLength())
+		throw("File is too long for one IV of the mode!");
+
+	outputFile.fd = open(outputFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (outputFile.fd < 0)
+		throw("Cannot create output file!");
+
+	//Header and IV before the data
+	uint8_t frame[32];
+	size_t offset = GetFrameOffset();
+	GetHeader(frame);
+	GetIV(this->IVmode ? frame + GetHeaderLength() : nullptr);
+
+	if (pwrite(outputFile.fd, frame, offset, 0) != (ssize_t)offset)
+		throw("Failed to write the file!");
+
+	size_t dataLength = 0;
+	if (!RingChunks(ring, inputFile.fd, outputFile.fd, 0, offset, streamLen, &dataLength, false))
+		throw("Failed to encrypt the file!");
+
+	//Authenticated modes close the file with the tag
+	if (GetTagLength()) {
+		uint8_t tag[16];
+		GetTag(tag);
+		if (pwrite(outputFile.fd, tag, GetTagLength(), offset + dataLength) != (ssize_t)GetTagLength())
+			throw("Failed to write the file!");
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+//
+bool AES_BASE::DecryptRing(const char* inputFileName, const char* outputFileName) {
+#ifdef AES_FILE_URING
+	//Room for every request of every buffer, the last chunk can take one more
+	AES_URING ring;
+	if (!ring.Setup(AES_PIPE_BUFFERS * (AES_PIPE_CHUNK / AES_RING_REQUEST + 1)))
+		return false;
+
+	AES_MAPPED_FILE inputFile;
+	AES_MAPPED_FILE outputFile;
+	struct stat info;
+
+	inputFile.fd = open(inputFileName, O_RDONLY);
+	if (inputFile.fd < 0 || fstat(inputFile.fd, &info))
+		throw("Cannot open input file!");
+
+	size_t streamLen = (size_t)info.st_size;
+
+	if (!streamLen)
+		throw("File stream was 0!\n");	//Empty input file
+
+	if (GetMode() < AES_CFB_M && (streamLen & 0x0F) != 0x00)
+		throw("Bad file stream size!");	//Bad file size, only the block modes are padded
+
+	uint8_t tag[16];
+	ReadFileFrame(inputFile.fd, &streamLen, tag);
+	size_t offset = GetFrameOffset();
+
+	size_t dataLength = 0;
+
+	//Authenticated modes check the tag over the whole ciphertext before any plaintext is written
+	if (GetTagLength()) {
+		if (!RingChunks(ring, inputFile.fd, -1, offset, 0, streamLen, &dataLength, false))
+			throw("Failed to read the file!");
+
+		if (!VerifyTag(tag))
+			throw("Authentication failed, the file was modified or the key is wrong!");
+	}
+
+	outputFile.fd = open(outputFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (outputFile.fd < 0)
+		throw("Cannot create output file!");
+
+	if (!RingChunks(ring, inputFile.fd, outputFile.fd, offset, 0, streamLen, &dataLength, true))
+		throw("Failed to decrypt the file!");
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+//
+bool AES_BASE::RingChunks(AES_URING& ring, int inputFd, int outputFd, uint64_t inputOffset, uint64_t outputOffset, size_t length, size_t* streamLength, bool decrypt) {
+#ifdef AES_FILE_URING
+	/*
+	 *
+	 *	Note: 	Chunk k uses buffer k % AES_PIPE_BUFFERS, like PipeChunks().
+	 *			Every chunk is read and written in AES_RING_REQUEST pieces
+	 *			that are all in flight at once, and a buffer is read again
+	 *			as soon as its chunk is written. The cipher runs on every
+	 *			chunk that has arrived while the rest of the requests wait
+	 *			in the kernel.
+	 * 
+	*/
+
+	size_t chunkSize = 0;
+	size_t lastSize = 0;
+	size_t chunks = SplitChunks(length, &chunkSize, &lastSize);
+
+	SetTextLength(length);
+
+	const size_t bufferCount = (chunks < AES_PIPE_BUFFERS ? chunks : AES_PIPE_BUFFERS);
+	const size_t bufferSize = (chunks > 1 ? chunkSize + 16 : lastSize) + 16;
+
+	if (!this->bufferPool.Reserve(bufferCount, bufferSize))
+		return false;
+
+	iovec buffers[AES_PIPE_BUFFERS];
+	for (size_t i = 0; i < bufferCount; i++) {
+		buffers[i].iov_base = this->bufferPool.Get(i);
+		buffers[i].iov_len = bufferSize;
+	}
+
+	//Plain requests if the buffers cannot be pinned
+	ring.Register(buffers, (unsigned)bufferCount);
+
+	struct Slot {
+		size_t chunk;		//Chunk in the buffer
+		size_t length;		//Bytes to read or write
+		size_t pending;		//Requests in flight
+		bool writing;		//Written instead of read
+		bool ready;			//Read and waiting for the cipher
+	};
+
+	Slot slots[AES_PIPE_BUFFERS];
+	size_t nextRead = 0;
+	size_t nextCrypt = 0;
+	size_t finished = 0;
+	size_t total = 0;
+	bool failed = false;
+
+	//Split the rest of a buffer from a position into requests, the user data holds the buffer and the position
+	auto QueueRange = [&](size_t slot, size_t from) {
+		Slot& current = slots[slot];
+		uint64_t position = (current.writing ? outputOffset : inputOffset) + current.chunk * chunkSize;
+
+		for (size_t start = from; start < current.length; start = (start / AES_RING_REQUEST + 1) * AES_RING_REQUEST) {
+			size_t end = (start / AES_RING_REQUEST + 1) * AES_RING_REQUEST;
+			if (end > current.length)
+				end = current.length;
+
+			ring.Queue(current.writing, (current.writing ? outputFd : inputFd), this->bufferPool.Get(slot) + start, (unsigned)(end - start), position + start, (uint16_t)slot, ((uint64_t)start << 8) | slot);
+			current.pending++;
+		}
+	};
+
+	auto ReadNext = [&](size_t slot) {
+		if (nextRead >= chunks)
+			return;
+
+		slots[slot] = { nextRead, (nextRead + 1 < chunks ? chunkSize : lastSize), 0, false, false };
+		nextRead++;
+		QueueRange(slot, 0);
+	};
+
+	for (size_t i = 0; i < bufferCount; i++)
+		ReadNext(i);
+
+	while (finished < chunks && !failed) {
+		Slot& next = slots[nextCrypt % bufferCount];
+
+		//Process the next chunk in order as soon as it arrived
+		if (nextCrypt < chunks && next.ready && next.chunk == nextCrypt) {
+			uint8_t* chunk = this->bufferPool.Get(nextCrypt % bufferCount);
+			next.ready = false;
+
+			if (outputFd < 0) {
+				AuthenticateStream(chunk, next.length);
+				finished++;
+				ReadNext(nextCrypt % bufferCount);
+			}
+			else {
+				size_t outputLength = 0;
+				if (!CryptChunk(chunk, next.length, nextCrypt + 1 == chunks, &outputLength, decrypt)) {
+					failed = true;
+					break;
+				}
+
+				total += outputLength;
+				next.writing = true;
+				next.length = outputLength;
+				QueueRange(nextCrypt % bufferCount, 0);
+
+				//Nothing left after removing a whole padding block
+				if (!next.pending) {
+					finished++;
+					ReadNext(nextCrypt % bufferCount);
+				}
+			}
+
+			nextCrypt++;
+			continue;
+		}
+
+		uint64_t userData = 0;
+		int result = 0;
+		if (!ring.Wait(&userData, &result)) {
+			failed = true;
+			break;
+		}
+
+		size_t slot = userData & 0xFF;
+		size_t start = userData >> 8;
+		Slot& current = slots[slot];
+		current.pending--;
+
+		//An error or the end of the file before the chunk was complete
+		if (result <= 0) {
+			failed = true;
+			break;
+		}
+
+		//Short transfers continue where they stopped
+		size_t end = (start / AES_RING_REQUEST + 1) * AES_RING_REQUEST;
+		if (end > current.length)
+			end = current.length;
+
+		if (start + (size_t)result < end) {
+			ring.Queue(current.writing, (current.writing ? outputFd : inputFd), this->bufferPool.Get(slot) + start + result, (unsigned)(end - start - result),
+				(current.writing ? outputOffset : inputOffset) + current.chunk * chunkSize + start + result, (uint16_t)slot, ((uint64_t)(start + result) << 8) | slot);
+			current.pending++;
+			continue;
+		}
+
+		if (current.pending)
+			continue;
+
+		if (current.writing) {
+			finished++;
+			ReadNext(slot);
+		}
+		else
+			current.ready = true;
+	}
+
+	//Requests still in flight use the buffers, wait for them before giving the buffers back
+	if (failed) {
+		for (size_t i = 0; i < bufferCount; i++)
+			while (slots[i].pending) {
+				uint64_t userData = 0;
+				int result = 0;
+				if (!ring.Wait(&userData, &result))
+					break;
+				slots[userData & 0xFF].pending--;
+			}
+	}
+
+	ring.Unregister();
+
+	*streamLength = total;
+	return !failed;
+#else
+	return false;
+#endif
+}
+
+//
+void AES_BASE::ReadFileFrame(int fd, size_t* streamLength, uint8_t* tag) {
+#ifdef AES_FILE_MMAP
+	//Header and IV are read once and parsed in memory
+	uint8_t frame[AES_FRAME_MAX];
+	ssize_t frameLength = pread(fd, frame, (*streamLength < AES_FRAME_MAX ? *streamLength : AES_FRAME_MAX), 0);
+	if (frameLength < 0)
+		throw("Failed to read the file!");
+
+	const char* frameError = ParseFrame(frame, (size_t)frameLength, streamLength);
+	if (frameError)
+		throw(frameError);
+
+	//Authenticated modes end with the tag
+	if (GetTagLength()) {
+		if (pread(fd, tag, GetTagLength(), GetFrameOffset() + *streamLength) != (ssize_t)GetTagLength())
+			throw("Failed to read the file!");
+	}
+#else
+	throw("File descriptors are not supported on this platform!");
+#endif
+}
+
+#ifdef AES_FILE_DIRECT
+/**
+ * 	@brief Open a file with O_DIRECT, or without it where the file system does not support it (e.g. tmpfs)
+*/
+static int OpenDirect(const char* fileName, int flags) {
+	int fd = open(fileName, flags | O_DIRECT, 0644);
+	if (fd < 0 && errno == EINVAL)
+		fd = open(fileName, flags, 0644);
+	return fd;
+}
+
+/**
+ * 	@brief Switch O_DIRECT of an open file, for the few bytes at the start and the end that are not whole blocks
+*/
+static void SetDirect(int fd, bool direct) {
+	int flags = fcntl(fd, F_GETFL);
+	if (flags >= 0)
+		fcntl(fd, F_SETFL, (direct ? flags | O_DIRECT : flags & ~O_DIRECT));
+}
+#endif
+
+//
+void AES_BASE::EncryptDirect(const char* inputFileName, const char* outputFileName) {
+#ifdef AES_FILE_DIRECT
+	AES_MAPPED_FILE inputFile;
+	AES_MAPPED_FILE outputFile;
+	struct stat info;
+
+	inputFile.fd = OpenDirect(inputFileName, O_RDONLY);
+	if (inputFile.fd < 0 || fstat(inputFile.fd, &info))
+		throw("Cannot open input file!");
+
+	size_t streamLen = (size_t)info.st_size;
+
+	if (!streamLen)
+		throw("File stream was 0!\n");	//Empty input file
+
+	if (GetMode() == AES_XTS_M && streamLen < 16)
+		throw("XTS needs at least one whole block!");
+
+	if (streamLen > GetMaxLength())
+		throw("File is too long for one IV of the mode!");
+
+	outputFile.fd = OpenDirect(outputFileName, O_WRONLY | O_CREAT | O_TRUNC);
+	if (outputFile.fd < 0)
+		throw("Cannot create output file!");
+
+	//Header and IV go out with the first block of data
+	uint8_t frame[32];
+	GetHeader(frame);
+	GetIV(this->IVmode ? frame + GetHeaderLength() : nullptr);
+
+	if (!DirectChunks(inputFile.fd, outputFile.fd, 0, frame, GetFrameOffset(), streamLen, false))
+		throw("Failed to encrypt the file!");
+#else
+	throw("O_DIRECT is not supported on this platform!");
+#endif
+}
+
+//
+void AES_BASE::DecryptDirect(const char* inputFileName, const char* outputFileName) {
+#ifdef AES_FILE_DIRECT
+	AES_MAPPED_FILE inputFile;
+	AES_MAPPED_FILE outputFile;
+	struct stat info;
+
+	inputFile.fd = OpenDirect(inputFileName, O_RDONLY);
+	if (inputFile.fd < 0 || fstat(inputFile.fd, &info))
+		throw("Cannot open input file!");
+
+	size_t streamLen = (size_t)info.st_size;
+
+	if (!streamLen)
+		throw("File stream was 0!\n");	//Empty input file
+
+	if (GetMode() < AES_CFB_M && (streamLen & 0x0F) != 0x00)
+		throw("Bad file stream size!");	//Bad file size, only the block modes are padded
+
+	//The frame and the tag are not whole blocks
+	uint8_t tag[16];
+	SetDirect(inputFile.fd, false);
+	ReadFileFrame(inputFile.fd, &streamLen, tag);
+	SetDirect(inputFile.fd, true);
+
+	//Authenticated modes check the tag over the whole ciphertext before any plaintext is written
+	if (GetTagLength()) {
+		if (!DirectChunks(inputFile.fd, -1, GetFrameOffset(), nullptr, 0, streamLen, false))
+			throw("Failed to read the file!");
+
+		if (!VerifyTag(tag))
+			throw("Authentication failed, the file was modified or the key is wrong!");
+	}
+
+	outputFile.fd = OpenDirect(outputFileName, O_WRONLY | O_CREAT | O_TRUNC);
+	if (outputFile.fd < 0)
+		throw("Cannot create output file!");
+
+	if (!DirectChunks(inputFile.fd, outputFile.fd, GetFrameOffset(), nullptr, 0, streamLen, true))
+		throw("Failed to decrypt the file!");
+#else
+	throw("O_DIRECT is not supported on this platform!");
+#endif
+}
+
+//
+bool AES_BASE::DirectChunks(int inputFd, int outputFd, uint64_t inputOffset, const uint8_t* frame, size_t frameLength, size_t length, bool decrypt) {
+#ifdef AES_FILE_DIRECT
+	/*
+	 *
+	 *	Note: 	O_DIRECT only moves whole AES_POOL_ALIGN blocks between
+	 *			aligned buffers and aligned file positions. Whole chunks are
+	 *			a multiple of the block, so the data of every chunk starts
+	 *			inputSkew bytes into its buffer, after the part of the
+	 *			block it shares with the chunk before it.
+	 *			The output is written behind the bytes of the last block
+	 *			that were not written yet (at first the header and the IV).
+	 *			When the data lands at a different distance from a block
+	 *			start than it was read from, it is moved in the writer thread.
+	 *			The unaligned end is written without O_DIRECT.
+	 * 
+	*/
+
+	const size_t inputSkew = inputOffset % AES_POOL_ALIGN;
+
+	uint8_t carry[AES_POOL_ALIGN];		//Output of the last, not yet whole block
+	size_t carryLength = frameLength;
+	uint64_t outputPosition = 0;		//File position of carry
+
+	if (frameLength)
+		memcpy(carry, frame, frameLength);
+
+	auto Transfer = [](int fd, uint8_t* data, size_t bytes, uint64_t position, bool write) {
+		for (size_t done = 0; done < bytes; ) {
+			ssize_t result = (write ? pwrite(fd, data + done, bytes - done, position + done) : pread(fd, data + done, bytes - done, position + done));
+			if (result < 0 && errno == EINTR)
+				continue;
+			if (result <= 0)
+				return done;
+			done += (size_t)result;
+		}
+		return bytes;
+	};
+
+	return PipeStages(length, AES_POOL_ALIGN, 2 * AES_POOL_ALIGN + 16,
+		[&](uint8_t* buffer, uint64_t position, size_t bytes) {
+			//Whole blocks around the chunk, the file may end inside the last one
+			uint64_t start = inputOffset + position - inputSkew;
+			size_t blocks = (inputSkew + bytes + AES_POOL_ALIGN - 1) / AES_POOL_ALIGN * AES_POOL_ALIGN;
+			return Transfer(inputFd, buffer, blocks, start, false) >= inputSkew + bytes;
+		},
+		[&](uint8_t* buffer, size_t bytes, bool last, size_t* outputLength) {
+			if (outputFd < 0) {
+				AuthenticateStream(buffer + inputSkew, bytes);
+				*outputLength = bytes;
+				return true;
+			}
+
+			return CryptChunk(buffer + inputSkew, bytes, last, outputLength, decrypt);
+		},
+		[&](uint8_t* buffer, size_t bytes, bool last) {
+			if (outputFd < 0)
+				return true;
+
+			//Line the output up behind the unwritten bytes of the last block
+			if (inputSkew != carryLength)
+				memmove(buffer + carryLength, buffer + inputSkew, bytes);
+			memcpy(buffer, carry, carryLength);
+
+			size_t total = carryLength + bytes;
+
+			//Authenticated modes close the encrypted file with the tag
+			if (last && !decrypt && GetTagLength()) {
+				GetTag(buffer + total);
+				total += GetTagLength();
+			}
+
+			size_t whole = total / AES_POOL_ALIGN * AES_POOL_ALIGN;
+			if (Transfer(outputFd, buffer, whole, outputPosition, true) != whole)
+				return false;
+
+			outputPosition += whole;
+			carryLength = total - whole;
+
+			if (!last) {
+				memcpy(carry, buffer + whole, carryLength);
+				return true;
+			}
+
+			//The end of the file is not a whole block
+			SetDirect(outputFd, false);
+			return Transfer(outputFd, buffer + whole, carryLength, outputPosition, true) == carryLength;
+		});
+#else
+	return false;
+#endif
+}
+
+//
+inline void AES_BASE::BlockXOR(uint8_t* block_a, const uint8_t* block_b, const size_t length) const {
+	if (!block_a || !block_b || !length)
+		return;
+	
+	//XOR a machine word at a time, then the remaining bytes
+	size_t i = 0;
+	for (; i + 8 <= length; i += 8) {
+		uint64_t word_a, word_b;
+		memcpy(&word_a, block_a + i, 8);
+		memcpy(&word_b, block_b + i, 8);
+		word_a ^= word_b;
+		memcpy(block_a + i, &word_a, 8);
+	}
+
+	for (; i < length; i++)
+		block_a[i] = block_a[i] ^ block_b[i];
+}
+
+//
+inline void AES_BASE::BlockXOR(uint8_t* dst, const uint8_t* block_a, const uint8_t* block_b, const size_t length) const {
+	//XOR a machine word at a time, then the remaining bytes
+	size_t i = 0;
+	for (; i + 8 <= length; i += 8) {
+		uint64_t word_a, word_b;
+		memcpy(&word_a, block_a + i, 8);
+		memcpy(&word_b, block_b + i, 8);
+		word_a ^= word_b;
+		memcpy(dst + i, &word_a, 8);
+	}
+
+	for (; i < length; i++)
+		dst[i] = block_a[i] ^ block_b[i];
+}
+
+//
+size_t AES_BASE::ParallelShare(size_t blcks) const {
+	//Small streams stay on the calling thread without asking for the hardware thread count
+	if (blcks < 2 * AES_THREAD_MIN_BLOCKS)
+		return blcks;
+
+	size_t workers = WorkerCount();
+	if (workers > blcks / AES_THREAD_MIN_BLOCKS)
+		workers = blcks / AES_THREAD_MIN_BLOCKS;
+	if (workers <= 1)
+		return blcks;
+
+	return (blcks + workers - 1) / workers;
+}
+
+//
+void AES_BASE::ParallelBlocks(size_t blcks, size_t share, const std::function<void(size_t, size_t)>& worker) const {
+	if (!share || share >= blcks) {
+		worker(0, blcks);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	for (size_t first = share; first < blcks; first += share)
+		threads.emplace_back(worker, first, (blcks - first < share ? blcks - first : share));
+
+	worker(0, share);
+
+	for (std::thread& t : threads)
+		t.join();
+}
+
+//
+unsigned AES_BASE::WorkerCount() const {
+	return (this->threadCount ? this->threadCount : std::thread::hardware_concurrency());
+}
+
+//
+void AES_BASE::ParallelStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt, uint8_t* lastInput, size_t alignBlocks) {
+	//Blocks including a partial last block
+	size_t blcks = (length + 15) / 16;
+	size_t share = (IsParallel(decrypt) ? ParallelShare(blcks) : blcks);
+
+	if (alignBlocks > 1 && share < blcks)
+		share = (share + alignBlocks - 1) / alignBlocks * alignBlocks;
+
+	/*
+	 *
+	 *	Note: 	Processing in place overwrites the input, so the input block
+	 *			before every range is copied out before any thread starts. The
+	 *			chained modes decrypt with it, the others ignore it. Out of
+	 *			place the ranges read src and write dst in the same pass.
+	 * 
+	*/
+
+	if (share >= blcks) {
+		uint8_t chain[16];
+		memcpy(chain, this->chainBlock, 16);
+		if (lastInput)
+			memcpy(lastInput, src + (blcks - 1) * 16, 16);
+
+		CryptRange(src, dst, length, 0, chain, decrypt);
+		return;
+	}
+
+	std::vector<uint8_t> chains(((blcks + share - 1) / share) * 16);
+
+	memcpy(chains.data(), this->chainBlock, 16);
+	for (size_t first = share; first < blcks; first += share)
+		memcpy(chains.data() + (first / share) * 16, src + (first - 1) * 16, 16);
+
+	if (lastInput)
+		memcpy(lastInput, src + (blcks - 1) * 16, 16);
+
+	ParallelBlocks(blcks, share, [&](size_t first, size_t count) {
+		size_t bytes = (first + count < blcks ? count * 16 : length - first * 16);
+		CryptRange(src + first * 16, dst + first * 16, bytes, first, chains.data() + (first / share) * 16, decrypt);
+	});
+}
+
+//
+void AES_BASE::CryptRange(const uint8_t* src, uint8_t* dst, size_t length, size_t firstBlock, uint8_t* chain, bool decrypt) const {}
+
+/*
+ * ************************************
+ * ************************************
+ *				AES_ECB
+ * ************************************
+ * ************************************
+*/
+
+// 
+//	Public functions
+//
+
+//
+AES_ECB::AES_ECB(const uint8_t* key, AES_KEYSIZE keySize)
+	: AES_ECB(std::make_shared<const AES_KEYSET>(key, keySize)) {}
+
+//
+AES_ECB::AES_ECB(std::shared_ptr<const AES_KEYSET> keyset) : AES_BASE(AES_ECB_M) {
+	this->keyset = keyset;
+	
+	//Never embed or read IV from file, because ECB uses no IV
+	this->IVmode = false;
+}
+
+//
+bool AES_ECB::EncryptStream(uint8_t* stream, size_t length) {
+	
+	if (!stream) {
+		std::cout << "AES ECB - EncryptStream: stream was NULL.\n";
+		return false;
+	}
+
+	if (!length) {
+		std::cout << "AES ECB - EncryptStream: length was 0.";
+		return false;
+	}
+
+	if (length & 0x0F) {
+		std::cout << "AES ECB - EncryptStream: wrong stream length. Must be a multiple of 16.";
+		return false;
+	}
+
+	return CryptStream(stream, stream, length, false);
+}
+
+//
+bool AES_ECB::DecryptStream(uint8_t* stream, size_t length) {
+	if (!stream) {
+		std::cout << "AES ECB - DecryptStream: stream was NULL.\n";
+		return false;
+	}
+
+	if (!length) {
+		std::cout << "AES ECB - DecryptStream: length was 0.";
+		return false;
+	}
+
+	if (length & 0x0F) {
+		std::cout << "AES ECB - DecryptStream: wrong stream length. Must be a multiple of 16.";
+		return false;
+	}
+
+	return CryptStream(stream, stream, length, true);
+}
+
+//
+bool AES_ECB::IsParallel(bool decrypt) const {
+	return true;
+}
+
+//
+AES_ECB::~AES_ECB() {}
+
+// 	#
+//	#	Protected functions
+//	#
+
+//
+bool AES_ECB::CryptStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt) {
+	//Blocks split between the worker threads
+	ParallelStream(src, dst, length, decrypt, nullptr);
+	return true;
+}
+
+//
+void AES_ECB::CryptRange(const uint8_t* src, uint8_t* dst, size_t length, size_t firstBlock, uint8_t* chain, bool decrypt) const {
+	if (decrypt)
+		DecryptBlocks(src, dst, length / 16);
+	else
+		EncryptBlocks(src, dst, length / 16);
+}
+
+// 
+//	Private functions
+//
+
+
+
+/*
+ * ************************************
+ * ************************************
+ *				AES_CBC
+ * ************************************
+ * ************************************
+*/
+
+// 	#
+//	#	Public functions
+//	#
+
+//
+AES_CBC::AES_CBC(const uint8_t* key, const uint8_t* iv, AES_KEYSIZE keySize)
+	: AES_CBC(std::make_shared<const AES_KEYSET>(key, keySize), iv) {}
+
+//
+AES_CBC::AES_CBC(std::shared_ptr<const AES_KEYSET> keyset, const uint8_t* iv) : AES_BASE(AES_CBC_M) {
+	this->keyset = keyset;
+	SetIV(iv);
+}
+
+//
+bool AES_CBC::EncryptStream(uint8_t* stream, size_t length) {
+	if (!stream) {
+		std::cerr << "[ERROR] AES CBC Encrypt Stream: EncryptStream: stream was NULL.\n";
+		return false;
+	}
+
+	if (!length) {
+		std::cerr << "[ERROR] AES CBC Encrypt stream: EncryptStream: length was 0.";
+		return false;
+	}
+
+	if (length & 0x0F) {
+		std::cerr << "[ERROR] AES CBC EncryptStream: wrong stream length. Must be a multiple of 16.";
+		return false;
+	}
+
+	return CryptStream(stream, stream, length, false);
+}
+
+//
+bool AES_CBC::DecryptStream(uint8_t* stream, size_t length) {
+	if (!stream) {
+		std::cerr << "[ERROR] AES CBC Decrypt Stream: DecryptStream: stream was NULL.\n";
+		return false;
+	}
+
+	if (!length) {
+		std::cerr << "[ERROR] AES CBC Decrypt Stream: DecryptStream: length was 0.";
+		return false;
+	}
+
+	if (length & 0x0F) {
+		std::cerr << "[ERROR] AES CBC Decrypt Stream: DecryptStream: wrong stream length. Must be a multiple of 16.";
+		return false;
+	}
+
+	return CryptStream(stream, stream, length, true);
+}
+
+//
+bool AES_CBC::IsParallel(bool decrypt) const {
+	return decrypt || this->segmentSize;
+}
+
+//
+size_t AES_CBC::GetSegmentSize() const {
+	return this->segmentSize;
+}
+
+//
+bool AES_CBC::SetSegmentSize(size_t size) {
+	if ((size & 0x0F) || size > 0xFFFFFFF0)
+		return false;
+	this->segmentSize = size;
+	ResetChain();
+	return true;
+}
+
+//
+uint8_t AES_CBC::GetHeaderLength() const {
+	return (this->segmentSize ? 16 : 0);
+}
+
+//
+void AES_CBC::GetHeader(uint8_t* dst) const {
+	memcpy(dst, AES_CBC_HEADER, 4);
+	for (uint8_t i = 0; i < 4; i++)
+		dst[4 + i] = (uint8_t)(this->segmentSize >> (8 * i));
+	memset(dst + 8, 0, 8);
+}
+
+//
+AES_CBC::~AES_CBC() {}
+
+// 	#
+//	#	Protected functions
+//	#
+
+//
+void AES_CBC::ResetChain() {
+	AES_BASE::ResetChain();
+	this->segmentPos = 0;
+}
+
+//
+bool AES_CBC::DetectHeader(const uint8_t* start, size_t length) {
+	//Segmented data starts with the header, anything else is plain CBC starting with the IV
+	if (length < 4 || memcmp(start, AES_CBC_HEADER, 4)) {
+		this->segmentSize = 0;
+		return true;
+	}
+
+	return (length >= 16 && SetHeader(start));
+}
+
+//
+bool AES_CBC::SetHeader(const uint8_t* header) {
+	if (memcmp(header, AES_CBC_HEADER, 4))
+		return false;
+
+	size_t size = 0;
+	for (uint8_t i = 0; i < 4; i++)
+		size |= (size_t)header[4 + i] << (8 * i);
+
+	uint8_t reserved = 0;
+	for (uint8_t i = 8; i < 16; i++)
+		reserved |= header[i];
+
+	if (!size || (size & 0x0F) || reserved)
+		return false;
+
+	this->segmentSize = size;
+	return true;
+}
+
+//
+bool AES_CBC::CryptStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt) {
+	//Every block only depends on the ciphertext block before it, so each worker thread takes a contiguous range.
+	//Continue from the last ciphertext block on the next call.
+	if (decrypt) {
+		ParallelStream(src, dst, length, true, this->chainBlock);
+		this->segmentPos += length;
+		return true;
+	}
+
+	/*
+	 *
+	 *	Note: 	Plain CBC chains the whole stream on the calling thread.
+	 *			Segmented CBC finishes the current segment here, the whole
+	 *			segments after it start from their own IVs and are split
+	 *			between the worker threads.
+	 * 
+	*/
+
+	size_t lead = length;
+	if (this->segmentSize) {
+		lead = (this->segmentSize - this->segmentPos % this->segmentSize) % this->segmentSize;
+		if (lead > length)
+			lead = length;
+	}
+
+	//Continue from the chaining value (IV or last block of the previous call)
+	if (lead)
+		CryptRange(src, dst, lead, 0, this->chainBlock, false);
+	this->segmentPos += lead;
+
+	if (lead < length) {
+		ParallelStream(src + lead, dst + lead, length - lead, false, nullptr, this->segmentSize / 16);
+
+		//Continue from the last ciphertext block on the next call
+		memcpy(this->chainBlock, dst + length - 16, 16);
+		this->segmentPos += length - lead;
+	}
+
+	return true;
+}
+
+//
+void AES_CBC::CryptRange(const uint8_t* src, uint8_t* dst, size_t length, size_t firstBlock, uint8_t* chain, bool decrypt) const {
+	size_t blcks = length / 16;
+	size_t segBlocks = this->segmentSize / 16;
+
+	//Block number of the range start counted from the IV, and the first segment start within the range
+	uint64_t block = this->segmentPos / 16 + firstBlock;
+	uint64_t next = (segBlocks ? (block + segBlocks - 1) / segBlocks * segBlocks - block : UINT64_MAX);
+
+	uint8_t segIV[16];
+
+	if (!decrypt) {
+		const uint8_t* prev = chain;
+
+		//Every block is chained to the previous ciphertext block, segments start from their own IV
+		for (size_t i = 0; i < blcks; i++) {
+			uint8_t* current = dst + i * 16;
+
+			if (i == next) {
+				SegmentIV((block + i) / segBlocks, segIV);
+				prev = segIV;
+				next += segBlocks;
+			}
+
+			BlockXOR(current, src + i * 16, prev, 16);
+			EncryptBlock(current);
+			prev = current;
+		}
+
+		memcpy(chain, dst + (blcks - 1) * 16, 16);
+		return;
+	}
+
+	//Decrypted blocks before the XOR with the previous ciphertext block
+	uint8_t batch[AES_BATCH_BLOCKS * 16];
+
+	//Every block only depends on the ciphertext before it, so blocks are decrypted in batches
+	for (size_t i = 0; i < blcks; i += AES_BATCH_BLOCKS) {
+		size_t count = (blcks - i < AES_BATCH_BLOCKS ? blcks - i : AES_BATCH_BLOCKS);
+		const uint8_t* current = src + i * 16;
+
+		DecryptBlocks(current, batch, count);
+
+		//XOR with the previous ciphertext blocks while they are still in the source
+		BlockXOR(batch, chain);
+		BlockXOR(batch + 16, current, (count - 1) * 16);
+
+		//Segment starts take their own IV instead
+		for (; next < i + count; next += segBlocks) {
+			size_t j = next - i;
+			BlockXOR(batch + j * 16, (j ? current + (j - 1) * 16 : chain));
+			SegmentIV((block + next) / segBlocks, segIV);
+			BlockXOR(batch + j * 16, segIV);
+		}
+
+		//Save the last ciphertext block of the batch before overwriting it
+		memcpy(chain, current + (count - 1) * 16, 16);
+		memcpy(dst + i * 16, batch, count * 16);
+	}
+}
+
+// 	#
+//	#	Private functions
+//	#
+
+//
+void AES_CBC::SegmentIV(uint64_t index, uint8_t* dst) const {
+	//IV + index as 128 bit big endian numbers, encrypted so neighbouring segments get unrelated IVs
+	memcpy(dst, this->iv, 16);
+
+	uint64_t carry = index;
+	for (int8_t i = 15; i >= 0 && carry; i--) {
+		carry += dst[i];
+		dst[i] = (uint8_t)carry;
+		carry >>= 8;
+	}
+
+	EncryptBlock(dst);
+}
+
+
+/*
+ * ************************************
+ * ************************************
+ *				AES_CFB
+ * ************************************
+ * ************************************
+*/
+
+// 	#
+//	#	Public functions
+//	#
+
+//
+AES_CFB::AES_CFB(const uint8_t* key, const uint8_t* iv, AES_KEYSIZE keySize)
+	: AES_CFB(std::make_shared<const AES_KEYSET>(key, keySize), iv) {}
+
+//
+AES_CFB::AES_CFB(std::shared_ptr<const AES_KEYSET> keyset, const uint8_t* iv) : AES_BASE(AES_CFB_M) {
+	this->keyset = keyset;
+	SetIV(iv);
+}
+
+//
+bool AES_CFB::EncryptStream(uint8_t* stream, size_t length) {
+	if (!stream) {
+		std::cerr << "AES CFB - EncryptStream: stream was NULL.\n";
+		return false;
+	}
+
+	if (!length) {
+		std::cerr << "AES CFB - EncryptStream: length was 0.";
+		return false;
+	}
+
+	return CryptStream(stream, stream, length, false);
+}
+
+//
+bool AES_CFB::DecryptStream(uint8_t* stream, size_t length) {
+	if (!stream) {
+		std::cerr << "AES CFB - DecryptStream: stream was NULL.\n";
+		return false;
+	}
+
+	if (!length) {
+		std::cerr << "AES CFB - DecryptStream: length was 0.";
+		return false;
+	}
+
+	return CryptStream(stream, stream, length, true);
+}
+
+//
+bool AES_CFB::IsParallel(bool decrypt) const {
+	return decrypt;
+}
+
+//
+AES_CFB::~AES_CFB() {}
+
+// 	#
+//	#	Protected functions
+//	#
+
+//
+bool AES_CFB::CryptStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt) {
+	size_t blcks = length / 16;
+
+	uint8_t* lastBlock = this->chainBlock;
+
+	if (!decrypt) {
+		size_t i = 0;
+		for (; i < blcks; i++) {
+			EncryptBlock(lastBlock);
+			BlockXOR(lastBlock, src + i * 16);
+			memcpy(dst + i * 16, lastBlock, 16);
+		}
+
+		//Check if there is remaining data that is less than a block
+		if (length & 0x0F) {
+			EncryptBlock(lastBlock);
+			BlockXOR(lastBlock, src + i * 16, length & 0x0F);
+			memcpy(dst + i * 16, lastBlock, length & 0x0F);
+		}
+
+		return true;
+	}
+
+	/*
+	 *
+	 *	Note: 	In AES CFB mode the decription process also uses the
+	 *			block encryption functions.
+	 *			Every keystream block is the encrypted ciphertext block before it,
+	 *			so each worker thread takes a contiguous range of whole blocks.
+	 *			The chaining values are copied out before the ciphertext is overwritten.
+	 * 
+	*/
+
+	if (blcks)
+		ParallelStream(src, dst, blcks * 16, true, lastBlock);
+
+	//Check if there is remaining data that is less than a block, its keystream is the last whole ciphertext block encrypted
+	if (length & 0x0F) {
+		EncryptBlock(lastBlock);
+		BlockXOR(dst + blcks * 16, src + blcks * 16, lastBlock, length & 0x0F);
+	}
+
+	return true;
+}
+
+//
+void AES_CFB::CryptRange(const uint8_t* src, uint8_t* dst, size_t length, size_t firstBlock, uint8_t* chain, bool decrypt) const {
+	size_t blcks = length / 16;
+	uint8_t keystream[AES_BATCH_BLOCKS * 16];
+
+	//A whole batch of keystream is made at once
+	for (size_t i = 0; i < blcks; i += AES_BATCH_BLOCKS) {
+		size_t count = (blcks - i < AES_BATCH_BLOCKS ? blcks - i : AES_BATCH_BLOCKS);
+		const uint8_t* current = src + i * 16;
+
+		memcpy(keystream, chain, 16);
+		memcpy(keystream + 16, current, (count - 1) * 16);
+		memcpy(chain, current + (count - 1) * 16, 16);
+
+		EncryptBlocks(keystream, keystream, count);
+		BlockXOR(dst + i * 16, current, keystream, count * 16);
+	}
+}
+
+
+/*
+ * ************************************
+ * ************************************
+ *				AES_OFB
+ * ************************************
+ * ************************************
+*/
+
+// 	#
+//	#	Public functions
+//	#
+
+//
+AES_OFB::AES_OFB(const uint8_t* key, const uint8_t* iv, AES_KEYSIZE keySize)
+	: AES_OFB(std::make_shared<const AES_KEYSET>(key, keySize), iv) {}
+
+//
+AES_OFB::AES_OFB(std::shared_ptr<const AES_KEYSET> keyset, const uint8_t* iv) : AES_BASE(AES_OFB_M) {
+	this->keyset = keyset;
+	SetIV(iv);
+}
+
+//
+bool AES_OFB::EncryptStream(uint8_t* stream, size_t length) {
+	if (!stream) {
+		std::cerr << "AES OFB - EncryptStream: stream was NULL.\n";
+		return false;
+	}
+
+	if (!length) {
+		std::cerr << "AES OFB - EncryptStream: length was 0.";
+		return false;
+	}
+
+	ApplyKeystream(stream, length);
+
+	return true;
+}
+
+//
+bool AES_OFB::DecryptStream(uint8_t* stream, size_t length) {
+	if (!stream) {
+		std::cerr << "AES OFB - DecryptStream: stream was NULL.\n";
+		return false;
+	}
+
+	if (!length) {
+		std::cerr << "AES OFB - DecryptStream: length was 0.";
+		return false;
+	}
+
+	ApplyKeystream(stream, length);
+
+	return true;
+}
+
+//
+void AES_OFB::Precompute(size_t length) {
+	if (this->producer.joinable())
+		return;
+
+	//Keystream already in the ring counts towards the length
+	size_t ahead = 0;
+	for (size_t i = 0; i < this->ringCount; i++)
+		ahead += this->ringFill[(this->ringHead + i) % AES_OFB_RING];
+	ahead -= this->ringOffset;
+
+	size_t missing = (length > ahead ? ((length - ahead + 15) & ~(size_t)0x0F) : 0);
+
+	while (missing && this->ringCount < AES_OFB_RING) {
+		size_t slot = (this->ringHead + this->ringCount) % AES_OFB_RING;
+		size_t fill = (missing > AES_OFB_SEGMENT ? AES_OFB_SEGMENT : missing);
+
+		FillSlot(this->kernel, slot, fill);
+		this->ringCount++;
+		this->keystreamLeft -= (fill < this->keystreamLeft ? fill : this->keystreamLeft);
+		missing -= fill;
+	}
+}
+
+//
+bool AES_OFB::HasKeystream() const {
+	std::lock_guard<std::mutex> guard(this->ringLock);
+	return this->ringCount || (this->producer.joinable() && !this->producerDone);
+}
+
+//
+void AES_OFB::SetTextLength(size_t length) {
+	std::lock_guard<std::mutex> guard(this->ringLock);
+
+	//Keystream already in the ring counts towards the length, a partial last block uses a whole keystream block
+	uint64_t ahead = 0;
+	for (size_t i = 0; i < this->ringCount; i++)
+		ahead += this->ringFill[(this->ringHead + i) % AES_OFB_RING];
+	ahead -= this->ringOffset;
+
+	uint64_t needed = ((uint64_t)length + 15) & ~(uint64_t)0x0F;
+	this->keystreamLeft = (needed > ahead ? needed - ahead : 0);
+}
+
+AES_OFB::~AES_OFB() {
+	StopKeystream();
+}
+
+// 	#
+//	#	Protected functions
+//	#
+
+//
+void AES_OFB::ResetChain() {
+	StopKeystream();
+	AES_BASE::ResetChain();
+	memcpy(this->aheadBlock, this->chainBlock, 16);
+	this->keystreamLeft = UINT64_MAX;
+}
+
+// 	#
+//	#	Private functions
+//	#
+
+//
+void AES_OFB::ApplyKeystream(uint8_t* stream, size_t length) {
+
+	/*
+	 *
+	 *	Note: 	The OFB keystream does not depend on the data. When more
+	 *			text is announced after a large stream, a thread generates
+	 *			the keystream into a ring of slots and the stream itself is
+	 *			only XORed. The thread keeps filling the ring after the call
+	 *			returns, so the keystream of the next chunk is generated
+	 *			while the caller reads it. It stops at the announced length.
+	 *			Without a known length the thread could only run ahead of a
+	 *			stream call waiting for it, so the call generates inline.
+	 * 
+	*/
+
+	uint64_t needed = ((uint64_t)length + 15) & ~(uint64_t)0x0F;
+	if (length >= AES_OFB_SEGMENT && !this->producer.joinable() && this->keystreamLeft != UINT64_MAX && this->keystreamLeft > needed) {
+		if (WorkerCount() > 1)
+			this->producer = std::thread(&AES_OFB::ProduceKeystream, this, this->kernel);
+	}
+
+	size_t done = 0;
+	while (done < length) {
+		std::unique_lock<std::mutex> lock(this->ringLock);
+		if (!this->ringCount) {
+			if (!this->producer.joinable())
+				break;
+			this->ringSignal.wait(lock, [this] { return this->ringCount > 0 || this->producerDone; });
+			if (!this->ringCount)
+				break;
+		}
+		lock.unlock();
+
+		//Filled slots belong to this thread until they are released
+		const uint8_t* keystream = this->ringSlots[this->ringHead].get() + this->ringOffset;
+		size_t available = this->ringFill[this->ringHead] - this->ringOffset;
+		size_t take = (length - done < available ? length - done : available);
+		size_t used = (take + 15) & ~(size_t)0x0F;
+
+		BlockXOR(stream + done, keystream, take);
+		memcpy(this->chainBlock, keystream + used - 16, 16);
+
+		done += take;
+		this->ringOffset += used;
+
+		if (this->ringOffset == this->ringFill[this->ringHead]) {
+			lock.lock();
+			this->ringHead = (this->ringHead + 1) % AES_OFB_RING;
+			this->ringOffset = 0;
+			this->ringCount--;
+			lock.unlock();
+			this->ringSignal.notify_all();
+		}
+	}
+
+	if (done == length)
+		return;
+
+	//Ring is empty and no thread runs, generate the rest in place
+	uint8_t* lastBlock = this->chainBlock;
+	stream += done;
+	length -= done;
+
+	uint64_t generated = ((uint64_t)length + 15) & ~(uint64_t)0x0F;
+	this->keystreamLeft -= (generated < this->keystreamLeft ? generated : this->keystreamLeft);
+
+	size_t blcks = length / 16;
+
+	size_t i = 0;
+	for (; i < blcks; i++) {
+		EncryptBlock(lastBlock);
+		BlockXOR(stream + i * 16, lastBlock);
+	}
+
+	//Check if there is remaining data that is less than a block
+	if (length & 0x0F) {
+		EncryptBlock(lastBlock);
+		BlockXOR(stream + i * 16, lastBlock, length & 0x0F);
+	}
+
+	memcpy(this->aheadBlock, lastBlock, 16);
+}
+
+//
+void AES_OFB::FillSlot(const AES_KERNEL* kernel, size_t slot, size_t length) {
+	if (!this->ringSlots[slot])
+		this->ringSlots[slot].reset(new uint8_t[AES_OFB_SEGMENT]);
+
+	uint8_t* keystream = this->ringSlots[slot].get();
+	const uint8_t* previous = this->aheadBlock;
+
+	for (size_t i = 0; i < length; i += 16) {
+		memcpy(keystream + i, previous, 16);
+		kernel->EncryptBlock(this->keyset.get(), keystream + i);
+		previous = keystream + i;
+	}
+
+	memcpy(this->aheadBlock, previous, 16);
+	this->ringFill[slot] = length;
+}
+
+//
+void AES_OFB::ProduceKeystream(const AES_KERNEL* kernel) {
+	std::unique_lock<std::mutex> lock(this->ringLock);
+
+	while (true) {
+		this->ringSignal.wait(lock, [this] { return this->producerStop || this->ringCount < AES_OFB_RING; });
+		if (this->producerStop)
+			return;
+
+		//Nothing is generated past the announced text
+		if (!this->keystreamLeft) {
+			this->producerDone = true;
+			this->ringSignal.notify_all();
+			return;
+		}
+
+		size_t fill = (this->keystreamLeft < AES_OFB_SEGMENT ? (size_t)this->keystreamLeft : AES_OFB_SEGMENT);
+		this->keystreamLeft -= fill;
+
+		//The slot after the filled ones is not touched by the stream calls
+		size_t slot = (this->ringHead + this->ringCount) % AES_OFB_RING;
+		lock.unlock();
+
+		FillSlot(kernel, slot, fill);
+
+		lock.lock();
+		this->ringCount++;
+		this->ringSignal.notify_all();
+	}
+}
+
+//
+void AES_OFB::StopKeystream() {
+	if (this->producer.joinable()) {
+		{
+			std::lock_guard<std::mutex> guard(this->ringLock);
+			this->producerStop = true;
+		}
+		this->ringSignal.notify_all();
+		this->producer.join();
+		this->producerStop = false;
+		this->producerDone = false;
+	}
+
+	this->ringHead = 0;
+	this->ringOffset = 0;
+	this->ringCount = 0;
+}
+
+
+/*
+ * ************************************
+ * ************************************
+ *				AES_CTR
+ * ************************************
+ * ************************************
+*/
+
+// 	#
+//	#	Public functions
+//	#
+
+//
+AES_CTR::AES_CTR(const uint8_t* key, const uint8_t* iv, AES_KEYSIZE keySize)
+	: AES_CTR(std::make_shared<const AES_KEYSET>(key, keySize), iv) {}
+
+//
+AES_CTR::AES_CTR(std::shared_ptr<const AES_KEYSET> keyset, const uint8_t* iv) : AES_BASE(AES_CTR_M) {
+	this->keyset = keyset;
+	SetIV(iv);
+}
+
+//
+bool AES_CTR::EncryptStream(uint8_t* stream, size_t length) {
+	if (!stream) {
+		std::cerr << "AES CTR - EncryptStream: stream was NULL.\n";
+		return false;
+	}
+
+	if (!length) {
+		std::cerr << "AES CTR - EncryptStream: length was 0.";
+		return false;
+	}
+
+	return CryptStream(stream, stream, length, false);
+}
+
+//
+bool AES_CTR::DecryptStream(uint8_t* stream, size_t length) {
+	if (!stream) {
+		std::cerr << "AES CTR - DecryptStream: stream was NULL.\n";
+		return false;
+	}
+
+	if (!length) {
+		std::cerr << "AES CTR - DecryptStream: length was 0.";
+		return false;
+	}
+
+	return CryptStream(stream, stream, length, true);
+}
+
+//
+void AES_CTR::Seek(uint64_t block) {
+	ResetChain();
+	AddCounter(this->chainBlock, block);
+}
+
+//
+bool AES_CTR::IsParallel(bool decrypt) const {
+	return true;
+}
+
+//
+AES_CTR::~AES_CTR() {}
+
+// 	#
+//	#	Protected functions
+//	#
+
+//
+bool AES_CTR::CryptStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt) {
+	//A counter used twice under one key gives away the XOR of both plaintexts
+	if (!decrypt && !ReserveCounters((length + 15) / 16)) {
+		std::cerr << "AES CTR - EncryptStream: counter range overlaps an earlier encryption.\n";
+		return false;
+	}
+
+	ApplyKeystream(src, dst, length);
+
+	return true;
+}
+
+//
+void AES_CTR::CryptRange(const uint8_t* src, uint8_t* dst, size_t length, size_t firstBlock, uint8_t* chain, bool decrypt) const {
+	uint8_t counter[16];
+	uint8_t keystream[AES_BATCH_BLOCKS * 16];
+
+	memcpy(counter, this->chainBlock, 16);
+	AddCounter(counter, firstBlock);
+
+	//Count in native integers, the block stores the two halves big endian
+	uint64_t high, low;
+	memcpy(&high, counter, 8);
+	memcpy(&low, counter + 8, 8);
+	high = __builtin_bswap64(high);
+	low = __builtin_bswap64(low);
+
+	for (size_t done = 0; done < length; done += AES_BATCH_BLOCKS * 16) {
+		size_t bytes = (length - done < AES_BATCH_BLOCKS * 16 ? length - done : AES_BATCH_BLOCKS * 16);
+		size_t count = (bytes + 15) / 16;
+
+		for (size_t i = 0; i < count; i++) {
+			uint64_t half = __builtin_bswap64(high);
+			memcpy(keystream + i * 16, &half, 8);
+			half = __builtin_bswap64(low);
+			memcpy(keystream + i * 16 + 8, &half, 8);
+			if (!++low)
+				high++;
+		}
+
+		EncryptBlocks(keystream, keystream, count);
+		BlockXOR(dst + done, src + done, keystream, bytes);
+	}
 }
 
 // 	#
 //	#	Private functions
 //	#
 
+//
+void AES_CTR::AddCounter(uint8_t* counter, uint64_t value) const {
+	//Add byte by byte from the least significant end while there is anything left to carry
+	for (int8_t i = 15; i >= 0 && value; i--) {
+		uint64_t sum = counter[i] + (value & 0xFF);
+		counter[i] = (uint8_t)sum;
+		value = (value >> 8) + (sum >> 8);
+	}
+}
+
+//
+void AES_CTR::ApplyKeystream(const uint8_t* src, uint8_t* dst, size_t length) {
+	//Every keystream block only depends on its counter, so each worker thread takes a contiguous range
+	ParallelStream(src, dst, length, false, nullptr);
+
+	//Continue with the next unused counter on the next call, a partial last block uses up its counter
+	AddCounter(this->chainBlock, (length + 15) / 16);
+}
+
+//
+bool AES_CTR::ReserveCounters(uint64_t blocks) {
+	//Big endian counters compare like the numbers they hold
+	std::array<uint8_t, 16> first;
+	memcpy(first.data(), this->chainBlock, 16);
+
+	std::array<uint8_t, 16> end = first;
+	AddCounter(end.data(), blocks);
+
+	//The 128 bit counter would wrap around onto counters of the range
+	if (end <= first)
+		return false;
+
+	auto next = this->usedCounters.upper_bound(first);
+	if (next != this->usedCounters.end() && next->first < end)
+		return false;
+
+	if (next != this->usedCounters.begin()) {
+		auto before = std::prev(next);
+		if (before->second > first)
+			return false;
+
+		//The next part of the same stream continues its range
+		if (before->second == first) {
+			before->second = end;
+			return true;
+		}
+	}
+
+	this->usedCounters.emplace(first, end);
+	return true;
+}
 
 /*
  * ************************************
  * ************************************
- *				AES_CFB
+ *				AES_GCM
  * ************************************
  * ************************************
 */
@@ -901,97 +3149,253 @@ AES_CBC::~AES_CBC() {
 //	#
 
 //
-AES_CFB::AES_CFB(const uint8_t* key, const uint8_t* iv) {
-	this->keyset = new AES_KEYSET(key);
-	keyset->ChangeIV(iv);
+AES_GCM::AES_GCM(const uint8_t* key, const uint8_t* iv, AES_KEYSIZE keySize)
+	: AES_GCM(std::make_shared<const AES_KEYSET>(key, keySize), iv) {}
+
+//
+AES_GCM::AES_GCM(std::shared_ptr<const AES_KEYSET> keyset, const uint8_t* iv) : AES_BASE(AES_GCM_M) {
+	this->keyset = keyset;
+	SetIV(iv);
 }
 
 //
-void AES_CFB::EncryptStream(uint8_t* stream, size_t length) {
+bool AES_GCM::EncryptStream(uint8_t* stream, size_t length) {
 	if (!stream) {
-		std::cerr << "AES CFB - EncryptStream: stream was NULL.\n";
-		return;
+		std::cerr << "AES GCM - EncryptStream: stream was NULL.\n";
+		return false;
 	}
 
 	if (!length) {
-		std::cerr << "AES CFB - EncryptStream: length was 0.";
-		return;
+		std::cerr << "AES GCM - EncryptStream: length was 0.";
+		return false;
 	}
 
-	size_t blcks = length / 16;
-
-	uint8_t lastBlock[16] = { 0 };
-	this->keyset->GetIV(lastBlock);
+	return CryptStream(stream, stream, length, false);
+}
 
-	size_t i = 0;
-	for (; i < blcks; i++) {
-		EncryptBlock(lastBlock);
-		BlockXOR(lastBlock, stream + i * 16);
-		memcpy(stream + i * 16, lastBlock, 16);
+//
+bool AES_GCM::DecryptStream(uint8_t* stream, size_t length) {
+	if (!stream) {
+		std::cerr << "AES GCM - DecryptStream: stream was NULL.\n";
+		return false;
 	}
 
-	//Check if there is remaining data that is less than a block
-	if (length & 0x0F) {
-		EncryptBlock(lastBlock);
-		BlockXOR(lastBlock, stream + i * 16, length & 0x0F);
-		memcpy(stream + i * 16, lastBlock, length & 0x0F);
+	if (!length) {
+		std::cerr << "AES GCM - DecryptStream: length was 0.";
+		return false;
 	}
+
+	return CryptStream(stream, stream, length, true);
 }
 
 //
-void AES_CFB::DecryptStream(uint8_t* stream, size_t length) {
-	if (!stream) {
-		std::cerr << "AES CFB - DecryptStream: stream was NULL.\n";
-		return;
-	}
+uint8_t AES_GCM::GetTagLength() const {
+	return 16;
+}
 
-	if (!length) {
-		std::cerr << "AES CFB - DecryptStream: length was 0.";
+//
+size_t AES_GCM::GetMaxLength() const {
+	return (size_t)AES_GCM_MAX_BLOCKS * 16;
+}
+
+//
+void AES_GCM::GetTag(uint8_t* dst) {
+	if (!dst)
 		return;
-	}
 
-	size_t blcks = length / 16;
+	//Close the hash with the bit lengths of the (empty) associated data and the ciphertext
+	uint8_t lengths[16] = { 0 };
+	for (uint8_t i = 0; i < 8; i++)
+		lengths[8 + i] = (uint8_t)((this->textLength * 8) >> (56 - 8 * i));
 
-	uint8_t lastBlock[16] = { 0 };
-	this->keyset->GetIV(lastBlock);
+	uint8_t tag[16];
+	memcpy(tag, this->hash, 16);
+	this->kernel->GhashBlocks(GetHashKey(), tag, lengths, 1);
 
-	/*
-	 *
-	 *	Note: 	In AES CFB mode the decription process also uses the
-	 *			block encryption functions.
-	 * 
-	*/
+	//Mask with the encrypted initial counter block
+	uint8_t mask[16];
+	memcpy(mask, this->iv, 16);
+	EncryptBlock(mask);
+	BlockXOR(tag, mask);
 
-	size_t i = 0;
-	for (; i < blcks; i++) {
-		EncryptBlock(lastBlock);
-		memcpy(this->procArray, stream + i * 16, 16);
-		BlockXOR(stream + i * 16, lastBlock);
-		memcpy(lastBlock, this->procArray, 16);
+	memcpy(dst, tag, 16);
+}
+
+//
+bool AES_GCM::IsParallel(bool decrypt) const {
+	return true;
+}
+
+//
+AES_GCM::~AES_GCM() {}
+
+// 	#
+//	#	Protected functions
+//	#
+
+//
+void AES_GCM::ResetChain() {
+	//96 bit nonce followed by a 32 bit block counter starting from 1, the counter block of the tag
+	this->iv[12] = this->iv[13] = this->iv[14] = 0;
+	this->iv[15] = 1;
+
+	AES_BASE::ResetChain();
+
+	memset(this->hash, 0, 16);
+	this->textLength = 0;
+	this->keystreamBlocks = 0;
+	this->partialBlock = false;
+	this->nonceReserved = false;
+}
+
+//
+bool AES_GCM::CryptStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt) {
+	if (decrypt) {
+		if (this->partialBlock) {
+			std::cerr << "AES GCM - DecryptStream: the last part ended mid-block, set the IV again first.\n";
+			return false;
+		}
+
+		if (!ApplyKeystream(src, dst, length)) {
+			std::cerr << "AES GCM - DecryptStream: text is longer than one nonce allows (2^39 - 256 bits).\n";
+			return false;
+		}
+
+		return true;
 	}
 
-	//Check if there is remaining data that is less than a block
-	if (length & 0x0F) {
-		EncryptBlock(lastBlock);
-		BlockXOR(stream + i * 16, lastBlock, length & 0x0F);
+	//A part ending mid-block used up its counter and padded the hash, a following part would not be standard GCM
+	if (this->partialBlock) {
+		std::cerr << "AES GCM - EncryptStream: the last part ended mid-block, set a new IV first.\n";
+		return false;
+	}
+
+	//A nonce used twice under one key gives away the XOR of both plaintexts and allows forging tags
+	if (!ReserveNonce()) {
+		std::cerr << "AES GCM - EncryptStream: nonce was already used for encryption, set a new IV first.\n";
+		return false;
+	}
+
+	//The counter must not wrap around to the tag mask, check the whole stream before encrypting any of it
+	if ((length + 15) / 16 > AES_GCM_MAX_BLOCKS - this->keystreamBlocks) {
+		std::cerr << "AES GCM - EncryptStream: text is longer than one nonce allows (2^39 - 256 bits).\n";
+		return false;
 	}
 
+	//Hash every part right after encrypting it, while it is still in the cache. Large parts give every worker thread one range.
+	size_t part = length;
+	if (length >= 2 * AES_THREAD_MIN_BLOCKS * 16)
+		part = (size_t)WorkerCount() * AES_THREAD_MIN_BLOCKS * 16;
+
+	for (size_t done = 0; done < length; done += part) {
+		size_t bytes = (length - done < part ? length - done : part);
+		ApplyKeystream(src + done, dst + done, bytes);
+		AuthenticateStream(dst + done, bytes);
+	}
+
+	return true;
 }
 
 //
-AES_CFB::~AES_CFB() {
-	delete keyset;
+void AES_GCM::AuthenticateStream(const uint8_t* stream, size_t length) {
+	const AES_GHASH_KEY* key = GetHashKey();
+
+	this->kernel->GhashBlocks(key, this->hash, stream, length / 16);
+
+	//A partial last block is padded with zeros
+	if (length & 0x0F) {
+		uint8_t last[16] = { 0 };
+		memcpy(last, stream + (length & ~(size_t)0x0F), length & 0x0F);
+		this->kernel->GhashBlocks(key, this->hash, last, 1);
+	}
+
+	this->textLength += length;
 }
 
 // 	#
 //	#	Private functions
 //	#
 
+//
+bool AES_GCM::ApplyKeystream(const uint8_t* src, uint8_t* dst, size_t length) {
+	//Counter 1 masks the tag, the text may use 2 up to 2^32 - 1
+	uint64_t blocks = (length + 15) / 16;
+	if (this->partialBlock || blocks > AES_GCM_MAX_BLOCKS - this->keystreamBlocks)
+		return false;
+
+	this->keystreamBlocks += blocks;
+	this->partialBlock = (length & 0x0F) != 0;
+
+	ParallelStream(src, dst, length, false, nullptr);
+
+	//A partial last block uses up its counter too
+	uint32_t counter = (uint32_t)this->chainBlock[12] << 24 | (uint32_t)this->chainBlock[13] << 16 | (uint32_t)this->chainBlock[14] << 8 | this->chainBlock[15];
+	counter += (uint32_t)blocks;
+
+	this->chainBlock[12] = (uint8_t)(counter >> 24);
+	this->chainBlock[13] = (uint8_t)(counter >> 16);
+	this->chainBlock[14] = (uint8_t)(counter >> 8);
+	this->chainBlock[15] = (uint8_t)counter;
+
+	return true;
+}
+
+//
+void AES_GCM::CryptRange(const uint8_t* src, uint8_t* dst, size_t length, size_t firstBlock, uint8_t* chain, bool decrypt) const {
+	uint8_t keystream[AES_BATCH_BLOCKS * 16];
+
+	uint32_t counter = (uint32_t)this->chainBlock[12] << 24 | (uint32_t)this->chainBlock[13] << 16 | (uint32_t)this->chainBlock[14] << 8 | this->chainBlock[15];
+	counter += (uint32_t)firstBlock;
+
+	for (size_t done = 0; done < length; done += AES_BATCH_BLOCKS * 16) {
+		size_t bytes = (length - done < AES_BATCH_BLOCKS * 16 ? length - done : AES_BATCH_BLOCKS * 16);
+		size_t count = (bytes + 15) / 16;
+
+		//The nonce stays, only the low 32 bits count, ApplyKeystream() stops them before they wrap around
+		for (size_t i = 0; i < count; i++) {
+			counter++;
+			memcpy(keystream + i * 16, this->chainBlock, 12);
+			keystream[i * 16 + 12] = (uint8_t)(counter >> 24);
+			keystream[i * 16 + 13] = (uint8_t)(counter >> 16);
+			keystream[i * 16 + 14] = (uint8_t)(counter >> 8);
+			keystream[i * 16 + 15] = (uint8_t)counter;
+		}
+
+		EncryptBlocks(keystream, keystream, count);
+		BlockXOR(dst + done, src + done, keystream, bytes);
+	}
+}
+
+//
+bool AES_GCM::ReserveNonce() {
+	if (this->nonceReserved)
+		return true;
+
+	std::array<uint8_t, 12> nonce;
+	memcpy(nonce.data(), this->iv, 12);
+
+	this->nonceReserved = this->usedNonces.insert(nonce).second;
+	return this->nonceReserved;
+}
+
+//
+const AES_GHASH_KEY* AES_GCM::GetHashKey() {
+	//The hash subkey H is the encrypted all-zero block
+	if (this->hashKernel != this->kernel) {
+		uint8_t h[16] = { 0 };
+		EncryptBlock(h);
+		this->kernel->GhashInit(h, &this->hashKey);
+		this->hashKernel = this->kernel;
+	}
+
+	return &this->hashKey;
+}
+
 
 /*
  * ************************************
  * ************************************
- *				AES_CFB
+ *				AES_XTS
  * ************************************
  * ************************************
 */
@@ -1001,77 +3405,356 @@ AES_CFB::~AES_CFB() {
 //	#
 
 //
-AES_OFB::AES_OFB(const uint8_t* key, const uint8_t* iv) {
-	this->keyset = new AES_KEYSET(key);
-	keyset->ChangeIV(iv);
+AES_XTS::AES_XTS(const uint8_t* key, AES_KEYSIZE keySize) : AES_BASE(AES_XTS_M) {
+	//Both keys are read like one string, the tweak key starts after keySize characters
+	uint8_t keyArr[AES_KEY_256 * 2] = { 0 };
+	uint8_t keyLength = 0;
+	if (key)
+		for (; keyLength < keySize * 2 && key[keyLength] != '\0'; keyLength++)
+			keyArr[keyLength] = key[keyLength];
+
+	this->keyset = std::make_shared<const AES_KEYSET>(keyArr, keySize);
+	this->tweakKeyset = std::make_shared<const AES_KEYSET>(keyArr + keySize, keySize);
+
+	//A shorter key leaves zeros in the tweak key, which anyone can guess
+	this->distinctKeys = (keyLength == keySize * 2 && memcmp(keyArr, keyArr + keySize, keySize) != 0);
+
+	//The sector number is the tweak, there is no IV to store
+	this->IVmode = false;
+	ResetChain();
 }
 
 //
-void AES_OFB::EncryptStream(uint8_t* stream, size_t length) {
-	if (!stream) {
-		std::cerr << "AES OFB - EncryptStream: stream was NULL.\n";
-		return;
-	}
+AES_XTS::AES_XTS(std::shared_ptr<const AES_KEYSET> keyset, std::shared_ptr<const AES_KEYSET> tweakKeyset) : AES_BASE(AES_XTS_M) {
+	this->keyset = keyset;
+	this->tweakKeyset = tweakKeyset;
+	this->IVmode = false;
+	ResetChain();
 
-	if (!length) {
-		std::cerr << "AES OFB - EncryptStream: length was 0.";
+	if (!keyset || !tweakKeyset)
 		return;
-	}
 
-	size_t blcks = length / 16;
+	//Equal schedules come from equal keys, the first stages hold the key itself
+	for (uint8_t i = 0; i <= keyset->GetRounds() && !this->distinctKeys; i++)
+		this->distinctKeys = (keyset->GetKeySize() != tweakKeyset->GetKeySize() || memcmp(keyset->GetRoundKey(i), tweakKeyset->GetRoundKey(i), 16));
+}
 
-	uint8_t lastBlock[16] = { 0 };
-	this->keyset->GetIV(lastBlock);
+//
+bool AES_XTS::HasDistinctKeys() const {
+	return this->distinctKeys;
+}
 
-	size_t i = 0;
-	for (; i < blcks; i++) {
-		EncryptBlock(lastBlock);
-		BlockXOR(stream + i * 16, lastBlock);
+//
+bool AES_XTS::EncryptStream(uint8_t* stream, size_t length) {
+	if (!stream) {
+		std::cerr << "AES XTS - EncryptStream: stream was NULL.\n";
+		return false;
 	}
 
-	//Check if there is remaining data that is less than a block
-	if (length & 0x0F) {
-		EncryptBlock(lastBlock);
-		BlockXOR(stream + i * 16, lastBlock, length & 0x0F);
+	if (length < 16) {
+		std::cerr << "AES XTS - EncryptStream: length was less than a block.\n";
+		return false;
 	}
 
+	return CryptStream(stream, stream, length, false);
 }
 
 //
-void AES_OFB::DecryptStream(uint8_t* stream, size_t length) {
+bool AES_XTS::DecryptStream(uint8_t* stream, size_t length) {
 	if (!stream) {
-		std::cerr << "AES OFB - DecryptStream: stream was NULL.\n";
-		return;
+		std::cerr << "AES XTS - DecryptStream: stream was NULL.\n";
+		return false;
 	}
 
-	if (!length) {
-		std::cerr << "AES OFB - DecryptStream: length was 0.";
-		return;
+	if (length < 16) {
+		std::cerr << "AES XTS - DecryptStream: length was less than a block.\n";
+		return false;
 	}
 
-	size_t blcks = length / 16;
+	return CryptStream(stream, stream, length, true);
+}
 
-	uint8_t lastBlock[16] = { 0 };
-	this->keyset->GetIV(lastBlock);
+//
+bool AES_XTS::EncryptSector(uint8_t* data, uint64_t index) const {
+	if (!data || !this->distinctKeys)
+		return false;
 
-	size_t i = 0;
-	for (; i < blcks; i++) {
-		EncryptBlock(lastBlock);
-		BlockXOR(stream + i * 16, lastBlock);
+	CryptSectors(data, data, this->sectorSize / 16, index, 0, false);
+	return true;
+}
+
+//
+bool AES_XTS::DecryptSector(uint8_t* data, uint64_t index) const {
+	if (!data || !this->distinctKeys)
+		return false;
+
+	CryptSectors(data, data, this->sectorSize / 16, index, 0, true);
+	return true;
+}
+
+//
+bool AES_XTS::EncryptFileSector(const char* fileName, uint64_t index, const uint8_t* data) const {
+	if (!fileName || !data)
+		return false;
+
+	std::fstream file(fileName, std::ios::in | std::ios::out | std::ios::binary);
+	if (!file)
+		return false;
+
+	file.seekg(0, std::ios::end);
+	uint64_t fileSize = (uint64_t)file.tellg();
+	uint64_t offset = (this->IVmode ? 16 : 0) + index * this->sectorSize;
+
+	//A sector followed by less than a block shares its last block with that tail (ciphertext stealing)
+	if (index > fileSize / this->sectorSize || offset + this->sectorSize > fileSize || fileSize - offset - this->sectorSize - 1 < 15) {
+		std::cerr << "[ERROR] " << GetModeStr() << " Encrypt File Sector: Not a whole sector of the file!\n";
+		return false;
 	}
 
-	//Check if there is remaining data that is less than a block
-	if (length & 0x0F) {
-		EncryptBlock(lastBlock);
-		BlockXOR(stream + i * 16, lastBlock, length & 0x0F);
+	uint8_t* buffer = new uint8_t[this->sectorSize];
+	memcpy(buffer, data, this->sectorSize);
+	if (!EncryptSector(buffer, index)) {
+		delete[] buffer;
+		return false;
 	}
+
+	file.seekp((std::streamoff)offset);
+	file.write((char*)buffer, this->sectorSize);
+	file.flush();
+
+	delete[] buffer;
+	return (bool)file;
 }
 
-AES_OFB::~AES_OFB() {
-	delete this->keyset;
+//
+bool AES_XTS::DecryptFileSector(const char* fileName, uint64_t index, uint8_t* dst) const {
+	if (!fileName || !dst)
+		return false;
+
+	std::fstream file(fileName, std::ios::in | std::ios::binary);
+	if (!file)
+		return false;
+
+	file.seekg(0, std::ios::end);
+	uint64_t fileSize = (uint64_t)file.tellg();
+	uint64_t offset = (this->IVmode ? 16 : 0) + index * this->sectorSize;
+
+	if (index > fileSize / this->sectorSize || offset + this->sectorSize > fileSize || fileSize - offset - this->sectorSize - 1 < 15) {
+		std::cerr << "[ERROR] " << GetModeStr() << " Decrypt File Sector: Not a whole sector of the file!\n";
+		return false;
+	}
+
+	file.seekg((std::streamoff)offset);
+	file.read((char*)dst, this->sectorSize);
+	if (!file)
+		return false;
+
+	return DecryptSector(dst, index);
+}
+
+//
+size_t AES_XTS::GetSectorSize() const {
+	return this->sectorSize;
+}
+
+//
+bool AES_XTS::SetSectorSize(size_t size) {
+	if (size < 16 || (size & 0x0F))
+		return false;
+	this->sectorSize = size;
+	ResetChain();
+	return true;
+}
+
+//
+void AES_XTS::Seek(uint64_t index) {
+	this->sector = index;
+	this->sectorBlock = 0;
+}
+
+//
+bool AES_XTS::IsParallel(bool decrypt) const {
+	return true;
+}
+
+//
+AES_XTS::~AES_XTS() {}
+
+// 	#
+//	#	Protected functions
+//	#
+
+//
+void AES_XTS::ResetChain() {
+	AES_BASE::ResetChain();
+	this->sector = 0;
+	this->sectorBlock = 0;
+}
+
+//
+bool AES_XTS::CryptStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt) {
+	if (!this->distinctKeys) {
+		std::cerr << "AES XTS - " << (decrypt ? "DecryptStream" : "EncryptStream") << ": data and tweak key are equal or the key is too short.\n";
+		return false;
+	}
+
+	Crypt(src, dst, length, decrypt);
+
+	return true;
+}
+
+//
+void AES_XTS::CryptRange(const uint8_t* src, uint8_t* dst, size_t length, size_t firstBlock, uint8_t* chain, bool decrypt) const {
+	CryptSectors(src, dst, length / 16, this->sector, this->sectorBlock + firstBlock, decrypt);
 }
 
 // 	#
 //	#	Private functions
 //	#
 
+//
+void AES_XTS::Crypt(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt) {
+	size_t blcks = length / 16;
+	size_t tail = length & 0x0F;
+
+	//The last whole block goes into the ciphertext stealing together with a partial block
+	size_t whole = blcks - (tail ? 1 : 0);
+
+	uint64_t index = this->sector;
+	size_t block = this->sectorBlock;
+
+	//Every block only depends on its sector number and position, so each worker thread takes a contiguous range
+	if (whole)
+		ParallelStream(src, dst, whole * 16, decrypt, nullptr);
+
+	//The stealing works in place on the last whole block and the partial one
+	if (tail) {
+		if (src != dst)
+			memcpy(dst + whole * 16, src + whole * 16, 16 + tail);
+		StealCiphertext(dst + whole * 16, tail, index, block + whole, decrypt);
+	}
+
+	//Continue with the next block on the next call
+	block += blcks;
+	this->sector = index + block / (this->sectorSize / 16);
+	this->sectorBlock = block % (this->sectorSize / 16);
+}
+
+//
+void AES_XTS::CryptSectors(const uint8_t* src, uint8_t* dst, size_t blcks, uint64_t index, size_t block, bool decrypt) const {
+	const size_t sectorBlocks = this->sectorSize / 16;
+	index += block / sectorBlocks;
+	block %= sectorBlocks;
+
+	uint8_t tweak[16];
+	uint8_t tweaks[AES_BATCH_BLOCKS * 16];
+
+	SectorTweak(tweak, index, block);
+
+	//The tweak stays in registers between blocks, the halves load natively on x86
+	uint64_t low, high;
+	memcpy(&low, tweak, 8);
+	memcpy(&high, tweak + 8, 8);
+
+	for (size_t done = 0; done < blcks; done += AES_BATCH_BLOCKS) {
+		size_t count = (blcks - done < AES_BATCH_BLOCKS ? blcks - done : AES_BATCH_BLOCKS);
+		uint8_t* data = dst + done * 16;
+
+		//Every block has its own tweak, a new sector starts from its encrypted number again
+		for (size_t i = 0; i < count; i++) {
+			memcpy(tweaks + i * 16, &low, 8);
+			memcpy(tweaks + i * 16 + 8, &high, 8);
+
+			if (++block == sectorBlocks) {
+				block = 0;
+				SectorTweak(tweak, ++index, 0);
+				memcpy(&low, tweak, 8);
+				memcpy(&high, tweak + 8, 8);
+			}
+			else {
+				//Same as MultiplyTweak()
+				uint64_t carry = high >> 63;
+				high = (high << 1) | (low >> 63);
+				low = (low << 1) ^ (0x87 & (0 - carry));
+			}
+		}
+
+		//The tweak whitens the block before and after the block cipher
+		BlockXOR(data, src + done * 16, tweaks, count * 16);
+		if (decrypt)
+			DecryptBlocks(data, data, count);
+		else
+			EncryptBlocks(data, data, count);
+		BlockXOR(data, tweaks, count * 16);
+	}
+}
+
+//
+void AES_XTS::StealCiphertext(uint8_t* stream, size_t tail, uint64_t index, size_t block, bool decrypt) const {
+	const size_t sectorBlocks = this->sectorSize / 16;
+
+	//The partial block continues the data unit of the last whole block, even past the end of a sector
+	uint8_t tweak[16];
+	uint8_t nextTweak[16];
+	SectorTweak(tweak, index + block / sectorBlocks, block % sectorBlocks);
+	memcpy(nextTweak, tweak, 16);
+	MultiplyTweak(nextTweak);
+
+	//Encryption uses the tweaks in order, decryption starts with the tweak of the partial block
+	const uint8_t* first = (decrypt ? nextTweak : tweak);
+	const uint8_t* second = (decrypt ? tweak : nextTweak);
+
+	uint8_t* partial = stream + 16;
+	uint8_t temp[16];
+	uint8_t head[16];
+
+	memcpy(temp, stream, 16);
+	BlockXOR(temp, first);
+	if (decrypt)
+		DecryptBlock(temp);
+	else
+		EncryptBlock(temp);
+	BlockXOR(temp, first);
+
+	//The partial block gets the head of the result, the partial input takes its place
+	memcpy(head, partial, tail);
+	memcpy(partial, temp, tail);
+	memcpy(temp, head, tail);
+
+	BlockXOR(temp, second);
+	if (decrypt)
+		DecryptBlock(temp);
+	else
+		EncryptBlock(temp);
+	BlockXOR(temp, second);
+
+	memcpy(stream, temp, 16);
+}
+
+//
+void AES_XTS::SectorTweak(uint8_t* tweak, uint64_t index, size_t block) const {
+	//The sector number as a 128 bit little endian value
+	memset(tweak, 0, 16);
+	for (uint8_t i = 0; i < 8; i++)
+		tweak[i] = (uint8_t)(index >> (i * 8));
+
+	this->kernel->EncryptBlock(this->tweakKeyset.get(), tweak);
+
+	for (size_t i = 0; i < block; i++)
+		MultiplyTweak(tweak);
+}
+
+//
+void AES_XTS::MultiplyTweak(uint8_t* tweak) const {
+	//Shift the 128 bit little endian value left by one, the bit shifted out folds back as x^7 + x^2 + x + 1. The halves load natively on x86.
+	uint64_t low, high;
+	memcpy(&low, tweak, 8);
+	memcpy(&high, tweak + 8, 8);
+
+	uint64_t carry = high >> 63;
+	high = (high << 1) | (low >> 63);
+	low = (low << 1) ^ (0x87 & (0 - carry));
+
+	memcpy(tweak, &low, 8);
+	memcpy(tweak + 8, &high, 8);
+}
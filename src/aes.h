@@ -3,22 +3,81 @@
 ///                 2023
 ///
 
+#include <memory>
+#include <functional>
+#include <array>
+#include <map>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "aes_kernel.h"
+
 #define AES_DEFAULT_BUFFSIZE    128000000  //Max buffer size on heap in bytes -!!- MUST BE MULTIPLE OF 16 -!!-
+#define AES_BATCH_BLOCKS        64         //Blocks handed to the cipher backend at once by the chained modes
+#define AES_MAX_ROUNDS          14         //Rounds of AES-256, the key stage arrays hold AES_MAX_ROUNDS + 1 stages
+#define AES_THREAD_MIN_BLOCKS   16384      //Smallest share of blocks worth handing to an extra worker thread (256 KiB)
+#define AES_MULTI_LANES         8          //Independent streams interleaved by AES_BASE::EncryptStreams()
+#define AES_OFB_SEGMENT         1048576    //Keystream bytes per ring slot of AES_OFB -!!- MUST BE MULTIPLE OF 16 -!!-
+#define AES_OFB_RING            16         //Ring slots of OFB keystream generated ahead (16 MiB)
+#define AES_XTS_SECTOR          4096       //Default XTS data unit (sector) size in bytes
+#define AES_PIPE_CHUNK          16777216   //Largest chunk of a file passed between the reader, cipher and writer threads -!!- MUST BE MULTIPLE OF 16 -!!-
+#define AES_PIPE_BUFFERS        4          //Chunk buffers in flight between the reader, cipher and writer threads
+#define AES_POOL_ALIGN          4096       //Alignment of AES_BUFFER_POOL buffers (one page, a multiple of the cache line)
+#define AES_CBC_HEADER          "FCS1"     //Magic of the segmented CBC header, followed by the segment size and 8 zero bytes
+#define AES_FRAME_MAX           32         //Longest frame before the data: a format header and the IV
+#define AES_GCM_MAX_BLOCKS      0xFFFFFFFE //Blocks of text per GCM nonce before the 32 bit counter wraps, SP 800-38D: 2^39 - 256 bits
 /*
 *	Note: This size only restricts single buffers, NOT the whole program buffer size.
 */
 
+#if defined(__unix__) || defined(__APPLE__)
+#define AES_FILE_MMAP
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define AES_FILE_URING
+#endif
+
+#if defined(__linux__) || defined(__FreeBSD__)
+#define AES_FILE_DIRECT
+#endif
+
+#define AES_RING_REQUEST        1048576    //Bytes per io_uring read or write, every chunk is split into several requests in flight
+
+class AES_URING;
+
+/**
+ * 	@brief Supported key lengths in bytes
+*/
+enum AES_KEYSIZE {
+	AES_KEY_128 = 16,
+	AES_KEY_192 = 24,
+	AES_KEY_256 = 32
+};
+
+/**
+ * 	@brief Expanded key material. Never changed through a const keyset, so one keyset can be shared by any number of threads
+*/
 class AES_KEYSET {
 private:
 
-	//All 11 stages of the key
-	uint8_t keyset[11][16];
+	//Key length
+	AES_KEYSIZE keySize = AES_KEY_128;
+
+	//Number of rounds: 10, 12 or 14
+	uint8_t rounds = 10;
 
-	//Initialization vector
-	uint8_t iv[16];
+	//All stages of the key as column words, row 0 in the lowest byte
+	uint32_t roundKeys[AES_MAX_ROUNDS + 1][4];
 
-	//Embed IV when encrypting and read IV from the input when decrypting
-	bool IVmode = true;
+	//Decryption schedule for the equivalent inverse cipher, the middle stages are passed through InvMixColumns
+	uint32_t decRoundKeys[AES_MAX_ROUNDS + 1][4];
+
+	//Both schedules in the state bases of the vector permute backend, see AES_KERNEL_VPERM::ConvertKeys()
+	alignas(16) uint32_t vpermRoundKeys[AES_MAX_ROUNDS + 1][4];
+	alignas(16) uint32_t vpermDecRoundKeys[AES_MAX_ROUNDS + 1][4];
 
 public:
 
@@ -26,12 +85,13 @@ public:
 	 * 	@brief Default constructor
 	 * 
 	 * 	@param key Pointer to the key array
+	 * 	@param keySize Key length, selects AES-128, AES-192 or AES-256
 	*/
-	AES_KEYSET(const uint8_t* key = nullptr);
+	AES_KEYSET(const uint8_t* key = nullptr, AES_KEYSIZE keySize = AES_KEY_128);
 	//*OK
 
 	/**
-	 * 	@brief Change AES secret key
+	 * 	@brief Change AES secret key, the key length stays the same
 	 * 
 	 * 	@param key New secret key
 	*/
@@ -39,72 +99,64 @@ public:
 	//*OK
 
 	/**
-	 * 	@brief Erase the secret key
-	*/
-	void EraseSecretkey(void);
-	//*OK
-
-	/**
-	 * 	@brief Change initialization Vector. IV must be 16 bytes long!
+	 * 	@brief Get the key length
 	 * 
-	 * 	@param iv Pointer to the array containing the IV
+	 * 	@returns Key length in bytes
 	*/
-	void ChangeIV(const uint8_t* iv);
+	AES_KEYSIZE GetKeySize(void) const;
 	//*OK
 
 	/**
-	 * 	@brief Get Initialization Vector
+	 * 	@brief Get the number of rounds
 	 * 
-	 * 	@param dst Pointer to a 16 bytes long array to store a copy of the IV
+	 * 	@returns 10, 12 or 14
 	*/
-	void GetIV(uint8_t* dst) const;
+	uint8_t GetRounds(void) const;
 	//*OK
 
 	/**
-	 * 	@brief Clear stored IV and auto generate new one.
+	 * 	@brief Erase the secret key
 	*/
-	void ClearIV(void);
+	void EraseSecretkey(void);
 	//*OK
 
 	/**
-	 * 	@brief Add specified key to a given AES block
+	 * 	@brief Add specified key to a given AES state
 	 * 
-	 * 	@param block AES block to add the key to
+	 * 	@param state AES state as 4 column words
 	 * 	@param keyNum Key's number
 	*/
-	void AddRoundKey(uint8_t* block, uint8_t keyNum);
+	void AddRoundKey(uint32_t* state, uint8_t keyNum) const;
 	//*OK
 
 	/**
-	 * 	@brief Add stored IV to a given AES block
+	 * 	@brief Get a key stage as 4 column words
+	 * 
+	 * 	@param keyNum Key's number
 	 * 
-	 * 	@param block AES block to add the IV to
+	 * 	@returns Pointer to the 4 column words of the key stage
 	*/
-	void XORIV(uint8_t* block);
+	const uint32_t* GetRoundKey(uint8_t keyNum) const;
 	//*OK
 
 	/**
-	 * 	@brief Add a 16 bytes long IV to a given AES block
+	 * 	@brief Get a key stage of the decryption schedule as 4 column words. Stages 1 - 9 already have InvMixColumns applied.
 	 * 
-	 * 	@param block  AES block to add the IV to
-	 * 	@param iv  Pointer to an IV block
-	*/
-	void XORIV(uint8_t* block, uint8_t* iv);
-
-	/**
-	 * 	@brief Set what to do with the IV when encrypting
+	 * 	@param keyNum Key's number, numbered like the encryption stages
 	 * 
-	 * 	@param mode true: Save and read IV from the binary stream | false: always use the IV stored in the keyset
+	 * 	@returns Pointer to the 4 column words of the key stage
 	*/
-	void SetIVMode(bool mode);
+	const uint32_t* GetDecryptRoundKey(uint8_t keyNum) const;
 	//*OK
 
 	/**
-	 * 	@brief Get IV mode
+	 * 	@brief Get the key schedule converted for the vector permute backend, 16 byte aligned
 	 * 
-	 * 	@returns Iv mode
+	 * 	@param decrypt  Get the decryption schedule instead of the encryption schedule
+	 * 
+	 * 	@returns Pointer to all stages, only valid where the backend is supported
 	*/
-	bool GetIVMode(void) const;
+	const uint32_t* GetVpermRoundKeys(bool decrypt) const;
 	//*OK
 
 	/**
@@ -115,22 +167,87 @@ public:
 
 private:
 
-	//Calculate all required key stages
+	//Calculate all required key stages, nullptr selects the all-zero key
 	void CalculateKeys(const uint8_t* key);
 	//*OK
 
-	//Calculate a single key stage
-	void ExpandKey(uint8_t keyNum);
+	/**
+	*	@brief Substitute every byte of a column word
+	*
+	*	@param word  The word to substitute
+	*
+	*	@returns Word with every byte replaced according to the S-box
+	*/
+	uint32_t SubWord(uint32_t word) const;
 	//*OK
 
 	/**
-	*	@brief Substitute a single byte
+	*	@brief InvMixColumns of a single column word
 	*
-	*	@param byte  The byte to replace*
+	*	@param word  The column to transform
 	*
-	*	@returns Corresponding byte according to sBox
+	*	@returns Transformed column
+	*/
+	uint32_t InvMixColumn(uint32_t word) const;
+	//*OK
+
+};
+
+/**
+ * 	@brief Page-aligned chunk buffers of the file functions. The memory is kept between calls,
+ * 	       so chunks and later files reuse pages that are already faulted in.
+*/
+class AES_BUFFER_POOL {
+private:
+
+	uint8_t* memory = nullptr;		//All buffers in one aligned allocation
+
+	size_t bufferSize = 0;		//Bytes per buffer, a multiple of AES_POOL_ALIGN
+
+	size_t bufferCount = 0;		//Buffers in the allocation
+
+public:
+
+	/**
+	 * 	@brief Default constructor, allocates nothing
+	*/
+	AES_BUFFER_POOL() {}
+	//*OK
+
+	AES_BUFFER_POOL(const AES_BUFFER_POOL&) = delete;
+	AES_BUFFER_POOL& operator=(const AES_BUFFER_POOL&) = delete;
+
+	/**
+	 * 	@brief Destructor, frees the buffers
+	*/
+	~AES_BUFFER_POOL();
+	//*OK
+
+	/**
+	 * 	@brief Make room for a number of buffers, only allocating when the current ones are too few or too small
+	 * 
+	 * 	@param count  Number of buffers
+	 * 	@param size  Minimum bytes per buffer
+	 * 
+	 * 	@returns If the buffers are available (false if the allocation failed)
 	*/
-	uint8_t SubByteSingle(uint8_t byte);
+	bool Reserve(size_t count, size_t size);
+	//*OK
+
+	/**
+	 * 	@brief Get a buffer reserved with Reserve()
+	 * 
+	 * 	@param index  Buffer number, less than the reserved count
+	 * 
+	 * 	@returns Pointer to the AES_POOL_ALIGN aligned buffer
+	*/
+	uint8_t* Get(size_t index) const;
+	//*OK
+
+	/**
+	 * 	@brief Free the buffers, the next Reserve() allocates again
+	*/
+	void Release(void);
 	//*OK
 
 };
@@ -143,7 +260,20 @@ enum AES_MODE {
 	AES_ECB_M  = 1,
 	AES_CBC_M  = 2,
 	AES_CFB_M  = 3,
-	AES_OFB_M =  4
+	AES_OFB_M =  4,
+	AES_CTR_M =  5,
+	AES_GCM_M =  6,
+	AES_XTS_M =  7
+};
+
+/**
+ * 	@brief File I/O backends of EncryptFile() and DecryptFile()
+*/
+enum AES_FILE_IO {
+	AES_IO_STREAM = 0,		//Buffered std::fstream reads and writes
+	AES_IO_MMAP   = 1,		//Input and output mapped into memory (AES_FILE_MMAP)
+	AES_IO_URING  = 2,		//Asynchronous reads and writes through io_uring (AES_FILE_URING), AES_IO_STREAM if the kernel refuses it
+	AES_IO_DIRECT = 3		//Aligned reads and writes past the page cache with O_DIRECT (AES_FILE_DIRECT)
 };
 
 class AES_BASE {
@@ -152,9 +282,21 @@ protected:
 	//Max buffer size on heap in megabytes -!!- MUST BE MULTIPLE OF 16 bytes -!!-
 	size_t bufferLimit = AES_DEFAULT_BUFFSIZE;    //Limits individual buffers to a maximum size
 
-	AES_KEYSET* keyset = nullptr;	//Different key stages
+	std::shared_ptr<const AES_KEYSET> keyset;	//Different key stages, read-only and shareable between cipher objects
+
+	uint8_t iv[16] = { 0 };		//Initialization vector
+
+	bool IVmode = true;		//Embed IV when encrypting and read IV from the input when decrypting
 
-	uint8_t procArray[16] = { 0 };		//Array to store a single block while it's being processed
+	const AES_KERNEL* kernel = AES_KERNEL::Select();	//Block cipher backend
+
+	unsigned threadCount = 0;		//Worker threads of the parallel modes, 0 uses every hardware thread
+
+	AES_BUFFER_POOL bufferPool;		//Chunk buffers of the file functions, kept for the next file
+
+	AES_FILE_IO fileIO = AES_IO_STREAM;		//File I/O backend
+
+	uint8_t chainBlock[16] = { 0 };		//Chaining value carried from one stream call to the next (the IV at the start)
 
 	const AES_MODE aesMode = AES_BASE_M;	//AES mode identifier
 
@@ -163,9 +305,9 @@ public:
 	/**
 	 *	@brief Constructor
 	 *
-	 *	@param key Pointer to a max 16 bytes long array containing the secret key
+	 *	@param mode AES mode identifier of the derived class
 	*/
-	AES_BASE(const uint8_t* key = nullptr) {}
+	AES_BASE(AES_MODE mode = AES_BASE_M) : aesMode(mode) {}
 	//*OK
 
 	/**
@@ -192,14 +334,75 @@ public:
 	bool SetBufferLimit(const size_t limit);
 	//*OK
 
+	/**
+	 * 	@brief Free the chunk buffers kept from the last file operation
+	*/
+	void ReleaseBuffers(void);
+	//*OK
+
+	/**
+	 * 	@brief Get the file I/O backend
+	 * 
+	 * 	@returns Backend of EncryptFile() and DecryptFile()
+	*/
+	AES_FILE_IO GetFileIO(void) const;
+	//*OK
+
+	/**
+	 * 	@brief Set the file I/O backend
+	 * 
+	 * 	@param io  Backend of EncryptFile() and DecryptFile()
+	 * 
+	 * 	@returns If set was successful (the backend is available on this platform)
+	*/
+	bool SetFileIO(AES_FILE_IO io);
+	//*OK
+
+	/**
+	 * 	@brief Get the name of the block cipher backend in use
+	 * 
+	 * 	@returns Backend name in c string
+	*/
+	const char* GetKernelName(void) const;
+	//*OK
+
+	/**
+	 * 	@brief Force a block cipher backend instead of the one selected by CPUID
+	 * 
+	 * 	@param name  Backend name ("aesni", "table")
+	 * 
+	 * 	@returns If set was successful (the backend exists and is supported by this CPU)
+	*/
+	bool SetKernel(const char* name);
+	//*OK
+
+	/**
+	 * 	@brief Set the number of worker threads for the parallel parts, see IsParallel()
+	 * 
+	 * 	@param count  Thread count, 0 uses every hardware thread
+	*/
+	void SetThreadCount(unsigned count);
+	//*OK
+
+	/**
+	 * 	@brief Check if the mode splits large streams between the worker threads
+	 * 
+	 * 	@param decrypt  Ask for decryption instead of encryption
+	 * 
+	 * 	@returns If the blocks of that direction do not depend on the output of the blocks before them
+	*/
+	virtual bool IsParallel(bool decrypt) const;
+	//*OK
+
 	/**
 	* 	@brief Encrypt stream
 	*
 	*	@param stream  Source stream
 	* 	@param length  Source length
 	*
+	*	@returns If the stream was encrypted, nothing is written otherwise
 	*/
-	virtual void EncryptStream(uint8_t* stream, size_t length) = 0;
+	virtual bool EncryptStream(uint8_t* stream, size_t length) = 0;
 	//*OK
 
 	/**
@@ -214,6 +417,51 @@ public:
 	uint8_t* EncryptBuffer(const uint8_t* src, size_t length, size_t* streamLength);
 	//*OK
 
+	/**
+	*	@brief Encrypt and pad a stream of bytes into a buffer of the caller
+	*
+	*	@param src	Source stream, may be dst + GetFrameOffset() to skip the copy
+	*	@param length  Source length
+	*	@param dst  Destination buffer
+	*	@param capacity  Destination size, at least GetEncryptedLength(length)
+	*	@param streamLength	Finished stream length
+	*
+	*	@returns dst, nullptr on error
+	*/
+	uint8_t* EncryptBuffer(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity, size_t* streamLength);
+	//*OK
+
+	/**
+	*	@brief Encrypt in place without copying. The frame (header and IV) is written in front of the data and the padding and tag after it.
+	*
+	*	@param buffer  Buffer holding the source at buffer + GetFrameOffset()
+	*	@param length  Source length
+	*	@param capacity  Buffer size, at least GetEncryptedLength(length)
+	*	@param streamLength	Finished stream length
+	*
+	*	@returns buffer, nullptr on error
+	*/
+	uint8_t* EncryptInPlace(uint8_t* buffer, size_t length, size_t capacity, size_t* streamLength);
+	//*OK
+
+	/**
+	*	@brief Get the length of the frame written before the encrypted data
+	*
+	*	@returns Header and IV length in bytes
+	*/
+	size_t GetFrameOffset(void) const;
+	//*OK
+
+	/**
+	*	@brief Get the length of an encrypted buffer
+	*
+	*	@param length  Source length
+	*
+	*	@returns Frame, padded data and tag length in bytes
+	*/
+	size_t GetEncryptedLength(size_t length) const;
+	//*OK
+
 	/**
 	*	@brief Encrypt file to binary file
 	* 
@@ -229,8 +477,9 @@ public:
 	*	@param stream  Source stream
 	* 	@param length  Source length
 	*
+	*	@returns If the stream was decrypted, nothing is written otherwise
 	*/
-	virtual void DecryptStream(uint8_t* stream, size_t length) = 0;
+	virtual bool DecryptStream(uint8_t* stream, size_t length) = 0;
 	//*OK
 
 	/**
@@ -245,6 +494,32 @@ public:
 	uint8_t* DecryptBuffer(const uint8_t* src, size_t length, size_t* streamLength);
 	//TODO
 
+	/**
+	*	@brief Decrypt a buffer of bytes into a buffer of the caller
+	*
+	*	@param src	Source stream
+	*	@param length  Source length
+	*	@param dst  Destination buffer, may be src
+	*	@param capacity  Destination size, at least length - GetFrameOffset()
+	*	@param streamLength	Finished stream length
+	*
+	*	@returns dst, nullptr on error
+	*/
+	uint8_t* DecryptBuffer(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity, size_t* streamLength);
+	//*OK
+
+	/**
+	*	@brief Decrypt in place without copying
+	*
+	*	@param buffer  Source stream, overwritten
+	*	@param length  Source length
+	*	@param streamLength	Finished stream length
+	*
+	*	@returns Pointer to the decrypted data inside buffer (after the frame), nullptr on error
+	*/
+	uint8_t* DecryptInPlace(uint8_t* buffer, size_t length, size_t* streamLength);
+	//*OK
+
 	/**
 	*	@brief Decrypt binary file to the original file
 	* 
@@ -254,6 +529,20 @@ public:
 	virtual void DecryptFile(const char* inputFileName, const char* outputFileName);
 	//*OK
 
+	/**
+	*	@brief Encrypt independent streams side by side (multi-buffer). Same result as calling EncryptStream() of every cipher on its own stream.
+	*
+	*	@param ciphers  Cipher objects, one per stream. Streams of CBC, CFB or OFB ciphers sharing the mode, keyset and backend of the
+	*					first one are interleaved, up to AES_MULTI_LANES at once. The others are encrypted on their own.
+	*	@param streams  Source streams, encrypted in place
+	*	@param lengths  Source lengths
+	*	@param count  Number of streams
+	*
+	*	@returns If every stream was encrypted
+	*/
+	static bool EncryptStreams(AES_BASE* const* ciphers, uint8_t* const* streams, const size_t* lengths, size_t count);
+	//*OK
+
 	/**
 	*	@brief Get a file's size int bytes
 	*
@@ -299,6 +588,79 @@ public:
 	virtual void GetIV(uint8_t* dst) const;
 	//*OK
 
+	/**
+	 * 	@brief Set what to do with the IV when encrypting
+	 * 
+	 * 	@param mode true: Save and read IV from the binary stream | false: always use the IV set with SetIV()
+	*/
+	void SetIVMode(bool mode);
+	//*OK
+
+	/**
+	 * 	@brief Get IV mode
+	 * 
+	 * 	@returns Iv mode
+	*/
+	bool GetIVMode(void) const;
+	//*OK
+
+	/**
+	 * 	@brief Get the expanded key, to share it with other cipher objects (e.g. one per worker thread)
+	 * 
+	 * 	@returns Shared pointer to the read-only keyset
+	*/
+	std::shared_ptr<const AES_KEYSET> GetKeyset(void) const;
+	//*OK
+
+	/**
+	 * 	@brief Get the length of the authentication tag written after the ciphertext
+	 * 
+	 * 	@returns Tag length in bytes (max. 16), 0 for modes without authentication
+	*/
+	virtual uint8_t GetTagLength(void) const;
+	//*OK
+
+	/**
+	 * 	@brief Announce the length of the text the next stream calls process under the current IV, e.g. the file size.
+	 *	       Modes generating keystream ahead do not go past it.
+	 * 
+	 * 	@param length  Bytes of text still to come
+	*/
+	virtual void SetTextLength(size_t length);
+	//*OK
+
+	/**
+	 * 	@brief Get the longest text the mode can process under one IV
+	 * 
+	 * 	@returns Length in bytes, SIZE_MAX for modes without a limit
+	*/
+	virtual size_t GetMaxLength(void) const;
+	//*OK
+
+	/**
+	 * 	@brief Get the authentication tag of the data processed since the IV was set
+	 * 
+	 * 	@param dst Pointer to an array of GetTagLength() bytes
+	*/
+	virtual void GetTag(uint8_t* dst);
+	//*OK
+
+	/**
+	 * 	@brief Get the length of the format header written before the IV
+	 * 
+	 * 	@returns Header length in bytes (max. 16), 0 for the plain format
+	*/
+	virtual uint8_t GetHeaderLength(void) const;
+	//*OK
+
+	/**
+	 * 	@brief Get the format header describing the current settings
+	 * 
+	 * 	@param dst Pointer to an array of GetHeaderLength() bytes
+	*/
+	virtual void GetHeader(uint8_t* dst) const;
+	//*OK
+
 	/**
 	 * 	@brief Get AES mdoe
 	 * 
@@ -323,7 +685,17 @@ protected:
 	* 	@param block  Array containing the data to be encrypted
 	*
 	*/
-	inline void EncryptBlock(uint8_t* block);
+	inline void EncryptBlock(uint8_t* block) const;
+	//*OK
+
+	/**
+	* 	@brief Encrypt independent 16 byte long blocks with the backend's multi-block kernel
+	*
+	* 	@param src  Source blocks
+	* 	@param dst  Destination blocks (can be the same as src)
+	* 	@param count  Number of blocks
+	*/
+	inline void EncryptBlocks(const uint8_t* src, uint8_t* dst, size_t count) const;
 	//*OK
 
 	/**
@@ -340,149 +712,871 @@ protected:
 	//*OK
 
 	/**
-	* 	@brief Decrypt a single 16 byte long block*
+	*	@brief Encrypt and pad data in place
 	*
-	* 	@param block  Array containing the data to be decrypted
+	*	@param data  Source data with room for 16 bytes of padding
+	*	@param length  Source length
+	*	@param streamLength	Finished data length
+	*	@param attachPadding  Attach padding from the last block
 	*
+	*	@returns If the data was encrypted
 	*/
-	inline void DecryptBlock(uint8_t* block);
+	bool EncryptData(uint8_t* data, size_t length, size_t* streamLength, bool attachPadding);
 	//*OK
 
 	/**
-	*	@brief Decrypt a stream of bytes
+	* 	@brief Decrypt a single 16 byte long block*
 	*
-	*	@param src	Source stream
-	*	@param length  Source length
-	*	@param streamLength	Finished stream length
-	*	@param removePadding  Remove padding from the last block
+	* 	@param block  Array containing the data to be decrypted
 	*
-	*	@returns Pointer to decrypted data
 	*/
-	uint8_t* Decrypt(const uint8_t* src, size_t length, size_t* streamLength, bool removePadding);
+	inline void DecryptBlock(uint8_t* block) const;
 	//*OK
 
 	/**
-	*	@brief Substitute bytes in block
+	* 	@brief Decrypt independent 16 byte long blocks with the backend's multi-block kernel
 	*
-	*	@param block  The block of data to work on
+	* 	@param src  Source blocks
+	* 	@param dst  Destination blocks (can be the same as src)
+	* 	@param count  Number of blocks
 	*/
-	inline void SubBytes(uint8_t* block);
+	inline void DecryptBlocks(const uint8_t* src, uint8_t* dst, size_t count) const;
 	//*OK
 
 	/**
-	*	@brief Inverse substitute bytes in block
-	*
-	*	@param block  The blockof data to work on
+	 * 	@brief Clear stored IV and generate a new one from the system CSPRNG
+	 * 
+	 * 	@returns If the random source delivered, the IV must not be used otherwise
 	*/
-	inline void SubBytesInv(uint8_t* block);
+	bool ClearIV(void);
 	//*OK
 
 	/**
-	* 	@brief Shift rows left in block
-	*
-	* 	@param block  The block of data to work on
-	*
+	 * 	@brief Restart chaining from the stored IV
 	*/
-	inline void ShiftRowsLeft(uint8_t* block);
+	virtual void ResetChain(void);
 	//*OK
 
 	/**
-	* 	@brief Shift rows right in block
-	*
-	* 	@param block  The block of data to work on
-	*
+	 * 	@brief Add ciphertext to the authentication tag without decrypting it
+	 * 
+	 * 	@param stream  Ciphertext
+	 * 	@param length  Ciphertext length, a multiple of 16 except for the last call
 	*/
-	inline void ShiftRowsRight(uint8_t* block);
+	virtual void AuthenticateStream(const uint8_t* stream, size_t length);
 	//*OK
 
 	/**
-	* 	@brief Mix columns round
-	*
-	* 	@param block  The block of data to work on
-	*
+	 * 	@brief Apply the settings of a received format header
+	 * 
+	 * 	@param header  Received header of GetHeaderLength() bytes
+	 * 
+	 * 	@returns If the header was valid
 	*/
-	inline void MixColumns(uint8_t* block);
+	virtual bool SetHeader(const uint8_t* header);
 	//*OK
 
 	/**
-	* 	@brief Inverse mix columns round
-	*
-	* 	@param block  The blockof data to work on
-	*
+	 * 	@brief Pick the format of received data from its first bytes, before GetHeaderLength() is used to read it
+	 * 
+	 * 	@param start  First bytes of the received data
+	 * 	@param length  Number of bytes at start, the header is at most 16
+	 * 
+	 * 	@returns false if the data claims a format but its header is invalid
 	*/
-	inline void MixColumnsInv(uint8_t* block);
+	virtual bool DetectHeader(const uint8_t* start, size_t length);
 	//*OK
 
 	/**
-		@brief Galois field GF(2^8) finite field multiplication
-
-		@param multiplicant
-		@param multiplier
+	 * 	@brief Compare a received tag with the tag of the authenticated data in constant time
+	 * 
+	 * 	@param tag  Received tag of GetTagLength() bytes
+	 * 
+	 * 	@returns true: tags match | false: the data or the key is wrong
+	*/
+	bool VerifyTag(const uint8_t* tag);
+	//*OK
+
+	/**
+	*	@brief Decrypt a stream of bytes
+	*
+	*	@param src	Source stream
+	*	@param length  Source length
+	*	@param streamLength	Finished stream length
+	*	@param removePadding  Remove padding from the last block
+	*
+	*	@returns Pointer to decrypted data
+	*/
+	uint8_t* Decrypt(const uint8_t* src, size_t length, size_t* streamLength, bool removePadding);
+	//*OK
+
+	/**
+	*	@brief Decrypt data in place
+	*
+	*	@param data  Source data
+	*	@param length  Source length
+	*	@param streamLength	Finished data length
+	*	@param removePadding  Remove padding from the last block
+	*
+	*	@returns If the data was decrypted
+	*/
+	bool DecryptData(uint8_t* data, size_t length, size_t* streamLength, bool removePadding);
+	//*OK
+
+	/**
+	*	@brief Parse the frame (header and IV) at the start of encrypted data, shared by all the sources
+	*
+	*	@param frame  First bytes of the encrypted data, up to AES_FRAME_MAX
+	*	@param frameLength  Bytes at frame
+	*	@param streamLength  Whole encrypted length, reduced to the length of the data between the frame and the tag
+	*
+	*	@returns nullptr if the frame was valid, else the error message
+	*/
+	const char* ParseFrame(const uint8_t* frame, size_t frameLength, size_t* streamLength);
+	//*OK
+
+	/**
+	*	@brief Read the frame (header and IV) of an encrypted buffer and check its tag
+	*
+	*	@param src	Source stream
+	*	@param length  Source length
+	*	@param dataLength  Length of the encrypted data at src + GetFrameOffset()
+	*
+	*	@returns If the frame was valid and the tag matched
+	*/
+	bool ReadFrame(const uint8_t* src, size_t length, size_t* dataLength);
+	//*OK
+
+	/**
+	*	@brief Attach #PKCS7 padding in place
+	*
+	*	@param stream  Source stream with room for 16 more bytes
+	*	@param length  Source length
+	*
+	*	@returns Padded length
+	*/
+	size_t AttachPadding(uint8_t* stream, size_t length) const;
+	//*OK
+
+	/**
+	*	@brief Split the data of a file into chunks. Whole chunks have no padding, the last one keeps a whole block before a partial one (XTS ciphertext stealing).
+	*
+	*	@param length  Data length
+	*	@param chunkSize  Length of the whole chunks
+	*	@param lastSize  Length of the last chunk, at most chunkSize + 16
+	*	@param align  Whole chunks are a multiple of this length (a multiple of 16)
+	*
+	*	@returns Number of chunks including the last one
+	*/
+	size_t SplitChunks(size_t length, size_t* chunkSize, size_t* lastSize, size_t align = 16) const;
+	//*OK
+
+	/**
+	*	@brief Encrypt or decrypt one chunk of a file in place
+	*
+	*	@param chunk  Chunk data with room for 16 bytes of padding
+	*	@param length  Chunk length
+	*	@param last  Last chunk of the file, padded or unpadded
+	*	@param streamLength  Finished chunk length
+	*	@param decrypt  Decrypt instead of encrypt
+	*
+	*	@returns If the chunk was processed
+	*/
+	bool CryptChunk(uint8_t* chunk, size_t length, bool last, size_t* streamLength, bool decrypt);
+	//*OK
+
+	/**
+	*	@brief Encrypt or decrypt the rest of a file in chunks from bufferPool, the last chunk with padding.
+	*	       A reader thread fills the next buffers and a writer thread empties the processed ones while the calling thread runs the cipher.
+	*
+	*	@param inputFile  Source file, read from the current position
+	*	@param outputFile  Destination file, written at the current position
+	*	@param length  Bytes left in the source file
+	*	@param decrypt  Decrypt instead of encrypt
+	*
+	*	@returns If every chunk was read, processed and written
+	*/
+	bool PipeChunks(std::fstream& inputFile, std::fstream& outputFile, size_t length, bool decrypt);
+	//*OK
+
+	/**
+	*	@brief Run chunks through a reader thread, the processor on the calling thread and a writer thread, see PipeChunks()
+	*
+	*	@param length  Data length
+	*	@param align  Whole chunks are a multiple of this length
+	*	@param slack  Extra bytes per buffer for the reader and writer
+	*	@param reader  Fills a buffer with the chunk at a data position
+	*	@param processor  Processes a buffer in place and gives the output length
+	*	@param writer  Writes the output of a buffer, the last chunk is flagged
+	*
+	*	@returns If every stage succeeded for every chunk
+	*/
+	bool PipeStages(size_t length, size_t align, size_t slack,
+		const std::function<bool(uint8_t* buffer, uint64_t position, size_t length)>& reader,
+		const std::function<bool(uint8_t* buffer, size_t length, bool last, size_t* outputLength)>& processor,
+		const std::function<bool(uint8_t* buffer, size_t length, bool last)>& writer);
+	//*OK
+
+	/**
+	*	@brief Encrypt a file through memory mappings (AES_IO_MMAP). The output is sized up front and filled in place.
+	*
+	*	@param inputFileName  The source filename
+	*	@param outputFileName  Encrypted (output) filename
+	*/
+	void EncryptMapped(const char* inputFileName, const char* outputFileName);
+	//*OK
+
+	/**
+	*	@brief Decrypt a file through memory mappings (AES_IO_MMAP), the output is cut to the length without padding at the end
+	*
+	*	@param inputFileName  The encrypted filename
+	*	@param outputFileName  Decrypted (output) filename
+	*/
+	void DecryptMapped(const char* inputFileName, const char* outputFileName);
+	//*OK
+
+	/**
+	*	@brief Process chunks from a source into a destination mapping with CryptStream(), the last block or two are copied and padded in place
+	*
+	*	@param src  Source data
+	*	@param dst  Destination data with room for the padding
+	*	@param length  Source length
+	*	@param streamLength  Finished destination length
+	*	@param decrypt  Decrypt instead of encrypt
+	*
+	*	@returns If the data was processed
+	*/
+	bool CryptMapped(const uint8_t* src, uint8_t* dst, size_t length, size_t* streamLength, bool decrypt);
+	//*OK
+
+	/**
+	*	@brief Encrypt or decrypt src into dst with the checks of EncryptStream() / DecryptStream() on the arguments already done.
+	*	       Modes override it to read src and write dst in one pass, by default src is copied to dst and processed there.
+	*
+	*	@param src  Source data
+	*	@param dst  Destination data, src itself or not overlapping it
+	*	@param length  Source length
+	*	@param decrypt  Decrypt instead of encrypt
+	*
+	*	@returns If the data was processed
+	*/
+	virtual bool CryptStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt);
+	//*OK
+
+	/**
+	*	@brief Encrypt a file with io_uring (AES_IO_URING)
+	*
+	*	@param inputFileName  The source filename
+	*	@param outputFileName  Encrypted (output) filename
+	*
+	*	@returns false if io_uring is not available, nothing was touched then
+	*/
+	bool EncryptRing(const char* inputFileName, const char* outputFileName);
+	//*OK
+
+	/**
+	*	@brief Decrypt a file with io_uring (AES_IO_URING)
+	*
+	*	@param inputFileName  The encrypted filename
+	*	@param outputFileName  Decrypted (output) filename
+	*
+	*	@returns false if io_uring is not available, nothing was touched then
+	*/
+	bool DecryptRing(const char* inputFileName, const char* outputFileName);
+	//*OK
+
+	/**
+	*	@brief Encrypt or decrypt data of a file in chunks from bufferPool, the last chunk with padding.
+	*	       The reads of the next chunks and the writes of the processed ones stay in flight while the cipher works.
+	*
+	*	@param ring  Set up io_uring instance
+	*	@param inputFd  Source file
+	*	@param outputFd  Destination file, -1 only authenticates the data (tag check before decrypting)
+	*	@param inputOffset  Position of the data in the source file
+	*	@param outputOffset  Position of the data in the destination file
+	*	@param length  Data length
+	*	@param streamLength  Finished data length
+	*	@param decrypt  Decrypt instead of encrypt
+	*
+	*	@returns If every chunk was read, processed and written
+	*/
+	bool RingChunks(AES_URING& ring, int inputFd, int outputFd, uint64_t inputOffset, uint64_t outputOffset, size_t length, size_t* streamLength, bool decrypt);
+	//*OK
+
+	/**
+	*	@brief Read the header and the IV of an encrypted file and the tag at its end
+	*
+	*	@param fd  Encrypted file
+	*	@param streamLength  File length, reduced to the length of the encrypted data
+	*	@param tag  16 bytes long array for the tag
+	*/
+	void ReadFileFrame(int fd, size_t* streamLength, uint8_t* tag);
+	//*OK
+
+	/**
+	*	@brief Encrypt a file with O_DIRECT (AES_IO_DIRECT). Reads and writes are whole aligned blocks, so the page cache is left alone.
+	*
+	*	@param inputFileName  The source filename
+	*	@param outputFileName  Encrypted (output) filename
+	*/
+	void EncryptDirect(const char* inputFileName, const char* outputFileName);
+	//*OK
+
+	/**
+	*	@brief Decrypt a file with O_DIRECT (AES_IO_DIRECT)
+	*
+	*	@param inputFileName  The encrypted filename
+	*	@param outputFileName  Decrypted (output) filename
+	*/
+	void DecryptDirect(const char* inputFileName, const char* outputFileName);
+	//*OK
+
+	/**
+	*	@brief Run the data of a file through PipeStages() with aligned O_DIRECT reads and writes
+	*
+	*	@param inputFd  Source file
+	*	@param outputFd  Destination file, -1 only authenticates the data (tag check before decrypting)
+	*	@param inputOffset  Position of the data in the source file
+	*	@param frame  Bytes written before the data (header and IV)
+	*	@param frameLength  Length of frame
+	*	@param length  Data length
+	*	@param decrypt  Decrypt instead of encrypt
+	*
+	*	@returns If every chunk was read, processed and written
+	*/
+	bool DirectChunks(int inputFd, int outputFd, uint64_t inputOffset, const uint8_t* frame, size_t frameLength, size_t length, bool decrypt);
+	//*OK
+
+	/**
+	 * 	@brief XOR together 2 matrices and store the result in the 1st
+	 * 
+	 * 	@param block_a  Pointer to the 1st block where the result will be saved
+	 * 	@param block_b  Pointer to the 2nd block
+	 * 	@param length  The length of both blocks
+	*/
+	inline void BlockXOR(uint8_t* block_a, const uint8_t* block_b, const size_t length = 16) const;
+	//*OK
+
+	/**
+	 * 	@brief XOR together 2 matrices and store the result in a 3rd, which may be the 1st
+	 * 
+	 * 	@param dst  Pointer to the block where the result will be saved
+	 * 	@param block_a  Pointer to the 1st block
+	 * 	@param block_b  Pointer to the 2nd block
+	 * 	@param length  The length of the blocks
+	*/
+	inline void BlockXOR(uint8_t* dst, const uint8_t* block_a, const uint8_t* block_b, const size_t length) const;
+	//*OK
+
+	/**
+	 * 	@brief Get the range size for splitting blocks between the worker threads. Ranges are never smaller than AES_THREAD_MIN_BLOCKS.
+	 * 
+	 * 	@param blcks  Number of blocks
+	 * 
+	 * 	@returns Blocks per range, blcks if the work stays on the calling thread
+	*/
+	size_t ParallelShare(size_t blcks) const;
+	//*OK
+
+	/**
+	 * 	@brief Process contiguous ranges of blocks on worker threads
+	 * 
+	 * 	@param blcks  Number of blocks
+	 * 	@param share  Blocks per range, from ParallelShare()
+	 * 	@param worker  Called with the first block and the block count of every range, from several threads at once. The calling thread takes the first range.
+	*/
+	void ParallelBlocks(size_t blcks, size_t share, const std::function<void(size_t, size_t)>& worker) const;
+	//*OK
+
+	/**
+	 * 	@brief Get the number of worker threads
+	 * 
+	 * 	@returns The thread count, or the hardware thread count if it is 0
+	*/
+	unsigned WorkerCount(void) const;
+	//*OK
+
+	/**
+	 * 	@brief Split a stream into ranges and process them with CryptRange(), on the worker threads if IsParallel() allows it.
+	 *	       Only the last range can end mid-block.
+	 * 
+	 * 	@param src  Source stream
+	 * 	@param dst  Destination stream, src itself or not overlapping it
+	 * 	@param length  Source length
+	 * 	@param decrypt  Decrypt instead of encrypt
+	 * 	@param lastInput  16 bytes long array for the last input block before it is overwritten, nullptr if not needed. May be chainBlock.
+	 * 	@param alignBlocks  Ranges start at multiples of this many blocks
+	*/
+	void ParallelStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt, uint8_t* lastInput, size_t alignBlocks = 1);
+	//*OK
+
+	/**
+	 * 	@brief Process one range of ParallelStream(), safe to run from several threads at once. Modes calling ParallelStream() override it.
+	 * 
+	 * 	@param src  First source block of the range
+	 * 	@param dst  First destination block of the range, src itself or not overlapping it
+	 * 	@param length  Length of the range in bytes
+	 * 	@param firstBlock  Blocks before the range in the stream
+	 * 	@param chain  Copy of the input block before the range (chainBlock for the first range), may be overwritten
+	 * 	@param decrypt  Decrypt instead of encrypt
+	*/
+	virtual void CryptRange(const uint8_t* src, uint8_t* dst, size_t length, size_t firstBlock, uint8_t* chain, bool decrypt) const;
+	//*OK
+
+};
+
+
+class AES_ECB : public AES_BASE {
+public:
+
+	/**
+	 * 	@brief Constructor
+	 * 
+	 * 	@param key	Pointer to the key array
+	 * 	@param keySize	Key length, selects AES-128, AES-192 or AES-256
+	*/
+	AES_ECB(const uint8_t* key = nullptr, AES_KEYSIZE keySize = AES_KEY_128);
+	//*OK
+
+	/**
+	 * 	@brief Constructor sharing an already expanded key
+	 * 
+	 * 	@param keyset	Read-only keyset, e.g. from another cipher object's GetKeyset()
+	*/
+	AES_ECB(std::shared_ptr<const AES_KEYSET> keyset);
+	//*OK
+
+	/**
+	* 	@brief Encrypt stream
+	*
+	*	@param stream  Source stream
+	* 	@param length  Source length
+	*/
+	bool EncryptStream(uint8_t* stream, size_t length);
+	//*OK
+
+	/**
+	* 	@brief Decrypt stream at original position
+	*
+	*	@param stream  Source stream
+	* 	@param length  Source length
+	*/
+	bool DecryptStream(uint8_t* stream, size_t length);
+	//*OK
+
+	/**
+	 * 	@brief Check if the mode splits large streams between the worker threads
+	 * 
+	 * 	@param decrypt  Ask for decryption instead of encryption
+	 * 
+	 * 	@returns true, every block is independent
+	*/
+	bool IsParallel(bool decrypt) const;
+	//*OK
+
+	/**
+	 * 	@brief Destructor
+	*/
+	~AES_ECB();
+	//*OK
+
+protected:
+
+	/**
+	 * 	@brief Encrypt or decrypt src into dst in one pass
+	 * 
+	 * 	@param src  Source data
+	 * 	@param dst  Destination data, src itself or not overlapping it
+	 * 	@param length  Source length
+	 * 	@param decrypt  Decrypt instead of encrypt
+	 * 
+	 * 	@returns true
+	*/
+	bool CryptStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt);
+
+	/**
+	 * 	@brief Encrypt or decrypt a range of whole blocks
+	 * 
+	 * 	@param src  First source block of the range
+	 * 	@param dst  First destination block of the range, src itself or not overlapping it
+	 * 	@param length  Length of the range in bytes
+	 * 	@param firstBlock  Unused
+	 * 	@param chain  Unused
+	 * 	@param decrypt  Decrypt instead of encrypt
+	*/
+	void CryptRange(const uint8_t* src, uint8_t* dst, size_t length, size_t firstBlock, uint8_t* chain, bool decrypt) const;
+
+};
+
+
+class AES_CBC : public AES_BASE {
+private:
+
+	size_t segmentSize = 0;		//Bytes chained from one IV, 0 chains the whole stream (plain CBC)
+
+	uint64_t segmentPos = 0;	//Bytes processed since the IV was set
+
+public:
+
+	/**
+	 * 	@brief Constructor
+	 * 
+	 * 	@param key Pointer to the key array
+	 * 	@param iv  Pointer to the IV array
+	 * 	@param keySize Key length, selects AES-128, AES-192 or AES-256
+	*/
+	AES_CBC(const uint8_t* key = nullptr, const uint8_t* iv = nullptr, AES_KEYSIZE keySize = AES_KEY_128);
+
+	/**
+	 * 	@brief Constructor sharing an already expanded key
+	 * 
+	 * 	@param keyset Read-only keyset, e.g. from another cipher object's GetKeyset()
+	 * 	@param iv  Pointer to the IV array
+	*/
+	AES_CBC(std::shared_ptr<const AES_KEYSET> keyset, const uint8_t* iv = nullptr);
+
+	/**
+	* 	@brief Encrypt stream. Segmented streams split whole segments between worker threads.
+	*
+	*	@param stream  Source stream
+	* 	@param length  Source length
+	*
+	*/
+	bool EncryptStream(uint8_t* stream, size_t length);
+
+	/**
+	* 	@brief Decrypt stream at original position. Large streams are split between worker threads.
+	*
+	*	@param stream  Source stream
+	* 	@param length  Source length
+	*/
+	bool DecryptStream(uint8_t* stream, size_t length);
+
+	/**
+	 * 	@brief Check if the mode splits large streams between the worker threads
+	 * 
+	 * 	@param decrypt  Ask for decryption instead of encryption
+	 * 
+	 * 	@returns Decryption, every plaintext block only depends on two ciphertext blocks. Encryption only with segments.
+	*/
+	bool IsParallel(bool decrypt) const;
+
+	/**
+	 * 	@brief Get the segment size
+	 * 
+	 * 	@returns Segment size in bytes, 0 for plain CBC
+	*/
+	size_t GetSegmentSize(void) const;
+
+	/**
+	 * 	@brief Chain fixed-size segments from their own IVs instead of the whole stream from one IV, the stream restarts at segment 0.
+	 *	       Segment i starts from E(IV + i), so segments are encrypted on several threads. The files get a header with the segment size,
+	 *	       decrypting takes the size from it (and sets it here) whatever was set before.
+	 * 
+	 * 	@param size  Segment size in bytes (MUST BE MULTIPLE OF 16, max. 0xFFFFFFF0), 0 for plain CBC
+	 * 
+	 * 	@returns If set was successful
+	*/
+	bool SetSegmentSize(size_t size);
+
+	/**
+	 * 	@brief Get the length of the format header written before the IV
+	 * 
+	 * 	@returns 16 with segments, 0 for plain CBC
+	*/
+	uint8_t GetHeaderLength(void) const;
+
+	/**
+	 * 	@brief Get the format header: AES_CBC_HEADER, segment size (32 bit little endian) and 8 zero bytes
+	 * 
+	 * 	@param dst Pointer to an array of GetHeaderLength() bytes
+	*/
+	void GetHeader(uint8_t* dst) const;
+
+	/**
+	 * 	@brief Destructor
+	*/
+	~AES_CBC();
+
+protected:
+
+	/**
+	 * 	@brief Encrypt or decrypt src into dst in one pass
+	 * 
+	 * 	@param src  Source data
+	 * 	@param dst  Destination data, src itself or not overlapping it
+	 * 	@param length  Source length
+	 * 	@param decrypt  Decrypt instead of encrypt
+	 * 
+	 * 	@returns true
+	*/
+	bool CryptStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt);
+
+	/**
+	 * 	@brief Restart chaining from the stored IV at segment 0
+	*/
+	void ResetChain(void);
+
+	/**
+	 * 	@brief Take the segment size from a received header
+	 * 
+	 * 	@param header  Received header of GetHeaderLength() bytes
+	 * 
+	 * 	@returns If the header was valid
+	*/
+	bool SetHeader(const uint8_t* header);
+
+	/**
+	 * 	@brief Take the segment size from the header if the data starts with AES_CBC_HEADER, otherwise switch to plain CBC
+	 * 
+	 * 	@param start  First bytes of the received data
+	 * 	@param length  Number of bytes at start
+	 * 
+	 * 	@returns false if the data starts with AES_CBC_HEADER but the rest of the header is invalid
+	*/
+	bool DetectHeader(const uint8_t* start, size_t length);
+
+	/**
+	 * 	@brief Encrypt or decrypt a range of whole blocks, segment starts chain from their own IVs
+	 * 
+	 * 	@param src  First source block of the range
+	 * 	@param dst  First destination block of the range, src itself or not overlapping it
+	 * 	@param length  Length of the range in bytes
+	 * 	@param firstBlock  Blocks before the range in the stream
+	 * 	@param chain  Ciphertext block before the range (or the IV), overwritten with the last ciphertext block
+	 * 	@param decrypt  Decrypt instead of encrypt. Encrypted ranges must start at a segment start or continue from chainBlock.
+	*/
+	void CryptRange(const uint8_t* src, uint8_t* dst, size_t length, size_t firstBlock, uint8_t* chain, bool decrypt) const;
+
+private:
+
+	/**
+	 * 	@brief Derive the IV of a segment
+	 * 
+	 * 	@param index  Segment number
+	 * 	@param dst  16 bytes long array for the IV
+	*/
+	void SegmentIV(uint64_t index, uint8_t* dst) const;
+
+};
+
+class AES_CFB : public AES_BASE {
+public:
+
+	/**
+	 * 	@brief Constructor
+	 * 
+	 * 	@param key Pointer to the key array
+	 * 	@param iv  Pointer to the IV array
+	 * 	@param keySize Key length, selects AES-128, AES-192 or AES-256
+	*/
+	AES_CFB(const uint8_t* key = nullptr, const uint8_t* iv = nullptr, AES_KEYSIZE keySize = AES_KEY_128);
+
+	/**
+	 * 	@brief Constructor sharing an already expanded key
+	 * 
+	 * 	@param keyset Read-only keyset, e.g. from another cipher object's GetKeyset()
+	 * 	@param iv  Pointer to the IV array
+	*/
+	AES_CFB(std::shared_ptr<const AES_KEYSET> keyset, const uint8_t* iv = nullptr);
+
+	/**
+	* 	@brief Encrypt stream
+	*
+	*	@param stream					Source stream
+	* 	@param length					Source length
+	*
+	*/
+	bool EncryptStream(uint8_t* stream, size_t length);
+
+	/**
+	* 	@brief Decrypt stream at original position. Large streams are split between worker threads.
+	*
+	*	@param stream					Source stream
+	* 	@param length					Source length
+	*
+	*/
+	bool DecryptStream(uint8_t* stream, size_t length);
+
+	/**
+	 * 	@brief Check if the mode splits large streams between the worker threads
+	 * 
+	 * 	@param decrypt  Ask for decryption instead of encryption
+	 * 
+	 * 	@returns Only decryption, every keystream block is the ciphertext block before it encrypted
+	*/
+	bool IsParallel(bool decrypt) const;
+
+	/**
+	 * 	@brief Destructor
+	*/
+	~AES_CFB();
+
+protected:
+
+	/**
+	 * 	@brief Encrypt or decrypt src into dst in one pass
+	 * 
+	 * 	@param src  Source data
+	 * 	@param dst  Destination data, src itself or not overlapping it
+	 * 	@param length  Source length
+	 * 	@param decrypt  Decrypt instead of encrypt
+	 * 
+	 * 	@returns true
+	*/
+	bool CryptStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt);
+
+	/**
+	 * 	@brief Decrypt a range of whole blocks
+	 * 
+	 * 	@param src  First source block of the range
+	 * 	@param dst  First destination block of the range, src itself or not overlapping it
+	 * 	@param length  Length of the range in bytes
+	 * 	@param firstBlock  Unused
+	 * 	@param chain  Ciphertext block before the range (or the IV), overwritten
+	 * 	@param decrypt  Always true, encryption is serial
+	*/
+	void CryptRange(const uint8_t* src, uint8_t* dst, size_t length, size_t firstBlock, uint8_t* chain, bool decrypt) const;
+
+};
+
+
+class AES_OFB : public AES_BASE {
+private:
+
+	std::unique_ptr<uint8_t[]> ringSlots[AES_OFB_RING];		//Keystream generated ahead, allocated on first use
+
+	size_t ringFill[AES_OFB_RING] = { 0 };		//Keystream bytes in each slot
+
+	size_t ringHead = 0;		//Slot the stream position is in
+
+	size_t ringOffset = 0;		//Bytes of the head slot already used
+
+	size_t ringCount = 0;		//Filled slots from the head on
+
+	uint8_t aheadBlock[16] = { 0 };		//Last keystream block put into the ring (chainBlock while the ring is empty)
+
+	uint64_t keystreamLeft = UINT64_MAX;		//Keystream bytes the text still needs past the ring, UINT64_MAX until SetTextLength()
+
+	bool producerStop = false;		//Asks the keystream thread to exit
+
+	bool producerDone = false;		//The keystream thread reached keystreamLeft and exited
+
+	std::thread producer;		//Keystream thread, keeps the ring filled between stream calls
+
+	mutable std::mutex ringLock;		//Guards the ring counters and producerStop
+
+	std::condition_variable ringSignal;		//Slot filled or released
+
+public:
+
+	/**
+	 * 	@brief Constructor
+	 * 
+	 * 	@param key Pointer to the key array
+	 * 	@param iv  Pointer to the IV array
+	 * 	@param keySize Key length, selects AES-128, AES-192 or AES-256
+	*/
+	AES_OFB(const uint8_t* key = nullptr, const uint8_t* iv = nullptr, AES_KEYSIZE keySize = AES_KEY_128);
+
+	/**
+	 * 	@brief Constructor sharing an already expanded key
+	 * 
+	 * 	@param keyset Read-only keyset, e.g. from another cipher object's GetKeyset()
+	 * 	@param iv  Pointer to the IV array
+	*/
+	AES_OFB(std::shared_ptr<const AES_KEYSET> keyset, const uint8_t* iv = nullptr);
+
+	/**
+	* 	@brief Encrypt stream. After SetTextLength(), a stream of AES_OFB_SEGMENT bytes and more with text following it starts the keystream thread,
+	*	       which stays ahead of the stream up to the announced length. Otherwise the keystream is generated inline.
+	*
+	*	@param stream					Source stream
+	* 	@param length					Source length
+	*
+	*/
+	bool EncryptStream(uint8_t* stream, size_t length);
+
+	/**
+	* 	@brief Decrypt stream at original position. Same keystream handling as EncryptStream().
+	*
+	*	@param stream					Source stream
+	* 	@param length					Source length
+	*
+	*/
+	bool DecryptStream(uint8_t* stream, size_t length);
 
-		@returns Product of the multiplication
+	/**
+	 * 	@brief Generate keystream for the next bytes of the stream now, the stream calls using it only XOR. No effect while the keystream thread runs.
+	 * 
+	 * 	@param length  Bytes of keystream, at most AES_OFB_RING * AES_OFB_SEGMENT are kept ahead
 	*/
-	inline uint8_t GFMult(uint8_t multiplier, uint8_t multiplicant);
-	//*OK
+	void Precompute(size_t length);
 
 	/**
-	 * 	@brief XOR together 2 matrices and store the result in the 1st
+	 * 	@brief Check for keystream generated ahead of the stream position
 	 * 
-	 * 	@param block_a  Pointer to the 1st block where the result will be saved
-	 * 	@param block_b  Pointer to the 2nd block
-	 * 	@param length  The length of both blocks
+	 * 	@returns If the ring holds keystream or the keystream thread runs
 	*/
-	inline void BlockXOR(uint8_t* block_a, const uint8_t* block_b, const size_t length = 16);
-	//*OK
+	bool HasKeystream(void) const;
 
-};
+	/**
+	 * 	@brief Announce the length of the text still to come under the current IV, the keystream thread stops there
+	 * 
+	 * 	@param length  Bytes of text, SetIV() forgets the length again
+	*/
+	void SetTextLength(size_t length);
 
+	/**
+	 * 	@brief Destructor
+	*/
+	~AES_OFB();
 
-class AES_ECB : public AES_BASE {
-private:
+protected:
 
-	const AES_MODE aesMode = AES_ECB_M;		//AES mode identifier
+	/**
+	 * 	@brief Stop the keystream thread, drop the keystream generated ahead and restart from the IV
+	*/
+	void ResetChain(void);
 
-public:
+private:
 
 	/**
-	 * 	@brief Constructor
+	 * 	@brief XOR keystream onto the stream, taken from the ring first. A partial last block uses up a whole keystream block.
 	 * 
-	 * 	@param key	Pointer to the key array
+	 * 	@param stream  Start of the data
+	 * 	@param length  Length of the data in bytes
 	*/
-	AES_ECB(const uint8_t* key = nullptr);
-	//*OK
+	void ApplyKeystream(uint8_t* stream, size_t length);
 
 	/**
-	* 	@brief Encrypt stream
-	*
-	*	@param stream  Source stream
-	* 	@param length  Source length
+	 * 	@brief Generate keystream into a ring slot, continuing from aheadBlock
+	 * 
+	 * 	@param kernel  Backend to generate with
+	 * 	@param slot  Ring slot index
+	 * 	@param length  Keystream bytes, a multiple of 16 up to AES_OFB_SEGMENT
 	*/
-	void EncryptStream(uint8_t* stream, size_t length);
-	//*OK
+	void FillSlot(const AES_KERNEL* kernel, size_t slot, size_t length);
 
 	/**
-	* 	@brief Decrypt stream at original position
-	*
-	*	@param stream  Source stream
-	* 	@param length  Source length
+	 * 	@brief Keystream thread, fills free ring slots until producerStop is set or keystreamLeft is used up
+	 * 
+	 * 	@param kernel  Backend to generate with
 	*/
-	void DecryptStream(uint8_t* stream, size_t length);
-	//*OK
+	void ProduceKeystream(const AES_KERNEL* kernel);
 
 	/**
-	 * 	@brief Destructor
+	 * 	@brief Stop the keystream thread and empty the ring
 	*/
-	~AES_ECB();
-	//*OK
+	void StopKeystream(void);
 
 };
 
 
-class AES_CBC : public AES_BASE {
+class AES_CTR : public AES_BASE {
 private:
 
-	const AES_MODE aesMode = AES_CBC_M;		// AES mode identifier
+	std::map<std::array<uint8_t, 16>, std::array<uint8_t, 16>> usedCounters;		//Counter ranges [first, end) this object encrypted with, by first counter
 
 public:
 
@@ -490,38 +1584,134 @@ public:
 	 * 	@brief Constructor
 	 * 
 	 * 	@param key Pointer to the key array
-	 * 	@param iv  Pointer to the IV array
+	 * 	@param iv  Pointer to the IV array, used as the initial 128 bit big endian counter
+	 * 	@param keySize Key length, selects AES-128, AES-192 or AES-256
 	*/
-	AES_CBC(const uint8_t* key = nullptr, const uint8_t* iv = nullptr);
+	AES_CTR(const uint8_t* key = nullptr, const uint8_t* iv = nullptr, AES_KEYSIZE keySize = AES_KEY_128);
 
 	/**
-	* 	@brief Encrypt stream
+	 * 	@brief Constructor sharing an already expanded key
+	 * 
+	 * 	@param keyset Read-only keyset, e.g. from another cipher object's GetKeyset()
+	 * 	@param iv  Pointer to the IV array, used as the initial 128 bit big endian counter
+	*/
+	AES_CTR(std::shared_ptr<const AES_KEYSET> keyset, const uint8_t* iv = nullptr);
+
+	/**
+	* 	@brief Encrypt stream. The counter range is split between worker threads
 	*
-	*	@param stream  Source stream
-	* 	@param length  Source length
+	*	@param stream					Source stream
+	* 	@param length					Source length
 	*
+	*	@returns false if a counter of the stream was already used by an earlier encryption of this object (e.g. a repeated SetIV() or Seek())
 	*/
-	void EncryptStream(uint8_t* stream, size_t length);
+	bool EncryptStream(uint8_t* stream, size_t length);
 
 	/**
-	* 	@brief Decrypt stream at original position
+	* 	@brief Decrypt stream at original position, same as encrypting
 	*
-	*	@param stream  Source stream
-	* 	@param length  Source length
+	*	@param stream					Source stream
+	* 	@param length					Source length
+	*
+	*/
+	bool DecryptStream(uint8_t* stream, size_t length);
+
+	/**
+	 * 	@brief Move the keystream to a given block of the message, the next stream call starts there
+	 * 
+	 * 	@param block  Index of the 16 byte block, counted from the IV
+	*/
+	void Seek(uint64_t block);
+
+	/**
+	 * 	@brief Check if the mode splits large streams between the worker threads
+	 * 
+	 * 	@param decrypt  Ask for decryption instead of encryption
+	 * 
+	 * 	@returns true, every keystream block only depends on its counter
 	*/
-	void DecryptStream(uint8_t* stream, size_t length);
+	bool IsParallel(bool decrypt) const;
 
 	/**
 	 * 	@brief Destructor
 	*/
-	~AES_CBC();
+	~AES_CTR();
+
+protected:
+
+	/**
+	 * 	@brief Encrypt or decrypt src into dst in one pass
+	 * 
+	 * 	@param src  Source data
+	 * 	@param dst  Destination data, src itself or not overlapping it
+	 * 	@param length  Source length
+	 * 	@param decrypt  Decrypt instead of encrypt
+	 * 
+	 * 	@returns false if the counters of an encryption were used before
+	*/
+	bool CryptStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt);
+
+	/**
+	 * 	@brief XOR keystream onto a part of the stream
+	 * 
+	 * 	@param src  Start of the source part
+	 * 	@param dst  Start of the destination part, src itself or not overlapping it
+	 * 	@param length  Length of the part in bytes
+	 * 	@param firstBlock  Counter offset of the part's first block from the current chaining counter
+	 * 	@param chain  Unused
+	 * 	@param decrypt  Unused, both directions are the same
+	*/
+	void CryptRange(const uint8_t* src, uint8_t* dst, size_t length, size_t firstBlock, uint8_t* chain, bool decrypt) const;
+
+private:
+
+	/**
+	 * 	@brief Add to a 128 bit big endian counter
+	 * 
+	 * 	@param counter  16 bytes long counter block
+	 * 	@param value  Value to add
+	*/
+	void AddCounter(uint8_t* counter, uint64_t value) const;
+
+	/**
+	 * 	@brief XOR keystream onto the source into the destination and move the counter past it
+	 * 
+	 * 	@param src  Start of the source data
+	 * 	@param dst  Start of the destination, src itself or not overlapping it
+	 * 	@param length  Length of the data in bytes
+	*/
+	void ApplyKeystream(const uint8_t* src, uint8_t* dst, size_t length);
+
+	/**
+	 * 	@brief Remember the counters of the next blocks as used for encryption
+	 * 
+	 * 	@param blocks  Number of counters from the current chaining counter
+	 * 
+	 * 	@returns If none of them was used before and the 128 bit counter does not wrap around
+	*/
+	bool ReserveCounters(uint64_t blocks);
 
 };
 
-class AES_CFB : public AES_BASE {
+
+class AES_GCM : public AES_BASE {
 private:
 
-	const AES_MODE aesMode = AES_CFB_M;		// AES mode identifier
+	AES_GHASH_KEY hashKey;		//GHASH key, in the layout of hashKernel
+
+	const AES_KERNEL* hashKernel = nullptr;		//Backend hashKey was built by
+
+	uint8_t hash[16] = { 0 };		//GHASH of the ciphertext so far
+
+	uint64_t textLength = 0;		//Ciphertext bytes in the hash
+
+	uint64_t keystreamBlocks = 0;		//Counters used since the nonce was set, at most AES_GCM_MAX_BLOCKS
+
+	bool partialBlock = false;		//The last part ended mid-block, the text under the nonce is closed
+
+	bool nonceReserved = false;		//The current nonce is in usedNonces
+
+	std::set<std::array<uint8_t, 12>> usedNonces;		//Nonces this object encrypted under
 
 public:
 
@@ -529,72 +1719,361 @@ public:
 	 * 	@brief Constructor
 	 * 
 	 * 	@param key Pointer to the key array
-	 * 	@param iv  Pointer to the IV array
+	 * 	@param iv  Pointer to the IV array, the first 12 bytes are the nonce
+	 * 	@param keySize Key length, selects AES-128, AES-192 or AES-256
 	*/
-	AES_CFB(const uint8_t* key = nullptr, const uint8_t* iv = nullptr);
+	AES_GCM(const uint8_t* key = nullptr, const uint8_t* iv = nullptr, AES_KEYSIZE keySize = AES_KEY_128);
 
 	/**
-	* 	@brief Encrypt stream
+	 * 	@brief Constructor sharing an already expanded key
+	 * 
+	 * 	@param keyset Read-only keyset, e.g. from another cipher object's GetKeyset()
+	 * 	@param iv  Pointer to the IV array, the first 12 bytes are the nonce
+	*/
+	AES_GCM(std::shared_ptr<const AES_KEYSET> keyset, const uint8_t* iv = nullptr);
+
+	/**
+	* 	@brief Encrypt stream and add the ciphertext to the tag. A text may be split into several calls,
+	*	but only the last one may end mid-block: every call after it returns false until the IV is set again.
+	*	Returns false as well when the nonce was already used for encryption by this object.
 	*
 	*	@param stream					Source stream
 	* 	@param length					Source length
 	*
 	*/
-	void EncryptStream(uint8_t* stream, size_t length);
+	bool EncryptStream(uint8_t* stream, size_t length);
 
 	/**
-	* 	@brief Decrypt stream at original position
+	* 	@brief Decrypt stream at original position. Only decrypts, DecryptBuffer() and DecryptFile() check the tag before decrypting.
+	*	As with EncryptStream(), only the last call under one IV may end mid-block.
 	*
 	*	@param stream					Source stream
 	* 	@param length					Source length
 	*
 	*/
-	void DecryptStream(uint8_t* stream, size_t length);
+	bool DecryptStream(uint8_t* stream, size_t length);
+
+	/**
+	 * 	@brief Get the length of the authentication tag
+	 * 
+	 * 	@returns 16
+	*/
+	uint8_t GetTagLength(void) const;
+
+	/**
+	 * 	@brief Get the longest text under one nonce
+	 * 
+	 * 	@returns AES_GCM_MAX_BLOCKS blocks in bytes
+	*/
+	size_t GetMaxLength(void) const;
+
+	/**
+	 * 	@brief Get the authentication tag of the data processed since the IV was set
+	 * 
+	 * 	@param dst Pointer to a 16 bytes long array
+	*/
+	void GetTag(uint8_t* dst);
+
+	/**
+	 * 	@brief Check if the mode splits large streams between the worker threads
+	 * 
+	 * 	@param decrypt  Ask for decryption instead of encryption
+	 * 
+	 * 	@returns true, the keystream is split between the worker threads. GHASH stays on the calling thread.
+	*/
+	bool IsParallel(bool decrypt) const;
 
 	/**
 	 * 	@brief Destructor
 	*/
-	~AES_CFB();
+	~AES_GCM();
+
+protected:
+
+	/**
+	 * 	@brief Encrypt or decrypt src into dst in one pass
+	 * 
+	 * 	@param src  Source data
+	 * 	@param dst  Destination data, src itself or not overlapping it
+	 * 	@param length  Source length
+	 * 	@param decrypt  Decrypt instead of encrypt
+	 * 
+	 * 	@returns false if a part ended mid-block before, the text does not fit the nonce or an encryption reuses it
+	*/
+	bool CryptStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt);
+
+	/**
+	 * 	@brief Restart the counter from the IV and clear the hash. The last 4 bytes of the IV are set to the initial block counter.
+	*/
+	void ResetChain(void);
+
+	/**
+	 * 	@brief Add ciphertext to the hash without decrypting it
+	 * 
+	 * 	@param stream  Ciphertext
+	 * 	@param length  Ciphertext length, a multiple of 16 except for the last call
+	*/
+	void AuthenticateStream(const uint8_t* stream, size_t length);
+
+	/**
+	 * 	@brief XOR keystream onto a part of the stream
+	 * 
+	 * 	@param src  Start of the source part
+	 * 	@param dst  Start of the destination part, src itself or not overlapping it
+	 * 	@param length  Length of the part in bytes
+	 * 	@param firstBlock  Counter offset of the part's first block from the current counter block
+	 * 	@param chain  Unused
+	 * 	@param decrypt  Unused, both directions are the same
+	*/
+	void CryptRange(const uint8_t* src, uint8_t* dst, size_t length, size_t firstBlock, uint8_t* chain, bool decrypt) const;
+
+private:
+
+	/**
+	 * 	@brief XOR keystream onto the source into the destination, the low 32 bits of the counter block are incremented
+	 * 
+	 * 	@param src  Start of the source data
+	 * 	@param dst  Start of the destination, src itself or not overlapping it
+	 * 	@param length  Length of the data in bytes
+	 * 
+	 * 	@returns false without touching the destination if the counter would wrap around (more than AES_GCM_MAX_BLOCKS under the nonce)
+	*/
+	bool ApplyKeystream(const uint8_t* src, uint8_t* dst, size_t length);
+
+	/**
+	 * 	@brief Remember the current nonce as used for encryption
+	 * 
+	 * 	@returns If this object did not encrypt under the nonce before, or already reserved it since the IV was set
+	*/
+	bool ReserveNonce(void);
+
+	/**
+	 * 	@brief Get the GHASH key for the current backend, it is rebuilt when the backend changes
+	 * 
+	 * 	@returns Pointer to the GHASH key
+	*/
+	const AES_GHASH_KEY* GetHashKey(void);
 
 };
 
 
-class AES_OFB : public AES_BASE {
+class AES_XTS : public AES_BASE {
 private:
 
-	const AES_MODE aesMode = AES_OFB_M;		// AES mode identifier
+	std::shared_ptr<const AES_KEYSET> tweakKeyset;		//Second key, encrypts the sector numbers into tweaks
+
+	size_t sectorSize = AES_XTS_SECTOR;		//Data unit size in bytes, a multiple of 16
+
+	uint64_t sector = 0;		//Sector of the next stream call
+
+	size_t sectorBlock = 0;		//Block within that sector
+
+	bool distinctKeys = false;		//Data and tweak key differ, IEEE 1619 refuses equal keys
 
 public:
 
 	/**
-	 * 	@brief Constructor
+	 * 	@brief Constructor. The key holds the data key followed by the tweak key, read like a string, missing characters are zero.
+	 *	       Keys shorter than 2 * keySize characters and equal keys are refused, see HasDistinctKeys().
 	 * 
-	 * 	@param key Pointer to the key array
-	 * 	@param iv  Pointer to the IV array
+	 * 	@param key Pointer to the key array, 2 * keySize characters
+	 * 	@param keySize Length of each of the two keys, selects AES-128, AES-192 or AES-256
 	*/
-	AES_OFB(const uint8_t* key = nullptr, const uint8_t* iv = nullptr);
+	AES_XTS(const uint8_t* key = nullptr, AES_KEYSIZE keySize = AES_KEY_128);
 
 	/**
-	* 	@brief Encrypt stream
+	 * 	@brief Constructor sharing already expanded keys
+	 * 
+	 * 	@param keyset Read-only keyset encrypting the data
+	 * 	@param tweakKeyset Read-only keyset encrypting the sector numbers, must differ from keyset
+	*/
+	AES_XTS(std::shared_ptr<const AES_KEYSET> keyset, std::shared_ptr<const AES_KEYSET> tweakKeyset);
+
+	/**
+	 * 	@brief Check the keys, IEEE 1619 and SP 800-38E need a tweak key different from the data key
+	 * 
+	 * 	@returns false if both keys are equal or the key string was shorter than both keys, every encryption and decryption is refused then
+	*/
+	bool HasDistinctKeys(void) const;
+
+	/**
+	* 	@brief Encrypt stream from the current sector on. Sectors are independent, so the blocks are split between worker threads.
+	*	       A partial last block is handled with ciphertext stealing and needs the whole block before it in the same call.
 	*
 	*	@param stream					Source stream
-	* 	@param length					Source length
+	* 	@param length					Source length, at least 16
 	*
 	*/
-	void EncryptStream(uint8_t* stream, size_t length);
+	bool EncryptStream(uint8_t* stream, size_t length);
 
 	/**
-	* 	@brief Decrypt stream at original position
+	* 	@brief Decrypt stream at original position, same rules as EncryptStream()
 	*
 	*	@param stream					Source stream
-	* 	@param length					Source length
+	* 	@param length					Source length, at least 16
 	*
 	*/
-	void DecryptStream(uint8_t* stream, size_t length);
+	bool DecryptStream(uint8_t* stream, size_t length);
+
+	/**
+	 * 	@brief Encrypt one whole sector in place, independent of the stream position and safe to run from several threads at once
+	 * 
+	 * 	@param data  GetSectorSize() bytes of plaintext
+	 * 	@param index  Sector number
+	 * 
+	 * 	@returns If the sector was encrypted
+	*/
+	bool EncryptSector(uint8_t* data, uint64_t index) const;
+
+	/**
+	 * 	@brief Decrypt one whole sector in place, independent of the stream position and safe to run from several threads at once
+	 * 
+	 * 	@param data  GetSectorSize() bytes of ciphertext
+	 * 	@param index  Sector number
+	 * 
+	 * 	@returns If the sector was decrypted
+	*/
+	bool DecryptSector(uint8_t* data, uint64_t index) const;
+
+	/**
+	 * 	@brief Replace one whole sector of an encrypted file without touching the rest of it
+	 * 
+	 * 	@param fileName  Encrypted file
+	 * 	@param index  Sector number, the sector must lie completely inside the file
+	 * 	@param data  GetSectorSize() bytes of new plaintext
+	 * 
+	 * 	@returns If the sector was written
+	*/
+	bool EncryptFileSector(const char* fileName, uint64_t index, const uint8_t* data) const;
+
+	/**
+	 * 	@brief Read and decrypt one whole sector of an encrypted file
+	 * 
+	 * 	@param fileName  Encrypted file
+	 * 	@param index  Sector number, the sector must lie completely inside the file
+	 * 	@param dst  GetSectorSize() bytes long array for the plaintext
+	 * 
+	 * 	@returns If the sector was read
+	*/
+	bool DecryptFileSector(const char* fileName, uint64_t index, uint8_t* dst) const;
+
+	/**
+	 * 	@brief Get the sector size
+	 * 
+	 * 	@returns Data unit size in bytes
+	*/
+	size_t GetSectorSize(void) const;
+
+	/**
+	 * 	@brief Set the sector size (MUST BE MULTIPLE OF 16), the stream restarts at sector 0
+	 * 
+	 * 	@param size  New data unit size in bytes, e.g. 512 or 4096
+	 * 
+	 * 	@returns If set was successful
+	*/
+	bool SetSectorSize(size_t size);
+
+	/**
+	 * 	@brief Move the stream to the start of a sector, the next stream call starts there
+	 * 
+	 * 	@param index  Sector number
+	*/
+	void Seek(uint64_t index);
+
+	/**
+	 * 	@brief Check if the mode splits large streams between the worker threads
+	 * 
+	 * 	@param decrypt  Ask for decryption instead of encryption
+	 * 
+	 * 	@returns true, every block only depends on its sector number and position
+	*/
+	bool IsParallel(bool decrypt) const;
 
 	/**
 	 * 	@brief Destructor
 	*/
-	~AES_OFB();
+	~AES_XTS();
+
+protected:
+
+	/**
+	 * 	@brief Encrypt or decrypt src into dst in one pass
+	 * 
+	 * 	@param src  Source data
+	 * 	@param dst  Destination data, src itself or not overlapping it
+	 * 	@param length  Source length
+	 * 	@param decrypt  Decrypt instead of encrypt
+	 * 
+	 * 	@returns false if the data and tweak keys are equal
+	*/
+	bool CryptStream(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt);
+
+	/**
+	 * 	@brief Restart the stream at sector 0, the IV is not used by XTS
+	*/
+	void ResetChain(void);
+
+	/**
+	 * 	@brief Encrypt or decrypt a range of whole blocks from the current sector and block on
+	 * 
+	 * 	@param src  First source block of the range
+	 * 	@param dst  First destination block of the range, src itself or not overlapping it
+	 * 	@param length  Length of the range in bytes
+	 * 	@param firstBlock  Blocks before the range in the stream
+	 * 	@param chain  Unused
+	 * 	@param decrypt  Decrypt instead of encrypt
+	*/
+	void CryptRange(const uint8_t* src, uint8_t* dst, size_t length, size_t firstBlock, uint8_t* chain, bool decrypt) const;
+
+private:
+
+	/**
+	 * 	@brief Encrypt or decrypt a stream from the current position and move the position past it
+	 * 
+	 * 	@param src  Start of the source data
+	 * 	@param dst  Start of the destination, src itself or not overlapping it
+	 * 	@param length  Length of the data in bytes
+	 * 	@param decrypt  Decrypt instead of encrypt
+	*/
+	void Crypt(const uint8_t* src, uint8_t* dst, size_t length, bool decrypt);
+
+	/**
+	 * 	@brief Encrypt or decrypt whole blocks, safe to run from several threads at once
+	 * 
+	 * 	@param src  First source block
+	 * 	@param dst  First destination block, src itself or not overlapping it
+	 * 	@param blcks  Number of blocks
+	 * 	@param index  Sector of the first block
+	 * 	@param block  Block of the first block within that sector, may exceed the sector
+	 * 	@param decrypt  Decrypt instead of encrypt
+	*/
+	void CryptSectors(const uint8_t* src, uint8_t* dst, size_t blcks, uint64_t index, size_t block, bool decrypt) const;
+
+	/**
+	 * 	@brief Ciphertext stealing for a partial last block, which uses the tweak following the last whole block
+	 * 
+	 * 	@param stream  Last whole block, the partial block follows it
+	 * 	@param tail  Bytes in the partial block, 1 - 15
+	 * 	@param index  Sector of the last whole block
+	 * 	@param block  Block of the last whole block within that sector
+	 * 	@param decrypt  Decrypt instead of encrypt
+	*/
+	void StealCiphertext(uint8_t* stream, size_t tail, uint64_t index, size_t block, bool decrypt) const;
+
+	/**
+	 * 	@brief Get the tweak of a block, the encrypted sector number multiplied by alpha for every block before it
+	 * 
+	 * 	@param tweak  16 bytes long array for the tweak
+	 * 	@param index  Sector number
+	 * 	@param block  Block within the sector
+	*/
+	void SectorTweak(uint8_t* tweak, uint64_t index, size_t block) const;
+
+	/**
+	 * 	@brief Multiply a tweak by alpha in GF(2^128), the tweak of the next block
+	 * 
+	 * 	@param tweak  16 bytes long tweak, little endian
+	*/
+	void MultiplyTweak(uint8_t* tweak) const;
 
 };
@@ -0,0 +1,538 @@
+///
+///     Code by:    Peter Mikulas
+///                 2023
+///
+
+#include <cstring>
+#include <fstream>
+
+#include "aes.h"
+
+#ifdef AES_KERNEL_X86
+
+#include <emmintrin.h>
+
+/*
+ *	Note:	Bitsliced state layout
+ *
+ *			8 blocks are processed at once in 8 SSE2 registers ("planes").
+ *			Plane i holds bit i of every state byte: byte k of a plane is state
+ *			byte k (column-major, like the blocks themselves) and bit b of that
+ *			byte belongs to block b. A 32-bit lane of a plane is one state column,
+ *			so ShiftRows moves whole lanes and MixColumns rotates bytes in a lane.
+ *
+ *			Only logic operations, shifts and shuffles are used. There are no
+ *			table lookups and no data-dependent branches, so the timing does not
+ *			depend on the key or the data.
+*/
+
+#define AES_BS_TARGET __attribute__((target("sse2")))
+
+//Blocks processed by one pass of the bitsliced rounds
+#define AES_BS_BLOCKS 8
+
+/*
+ * ************************************
+ * ************************************
+ *			Bitsliced primitives
+ * ************************************
+ * ************************************
+*/
+
+//Exchange the bits of a selected by (mask << n) with the bits of b selected by mask
+static AES_BS_TARGET inline void SwapMove(__m128i& a, __m128i& b, const __m128i mask, const int n) {
+	__m128i t = _mm_and_si128(_mm_xor_si128(_mm_srli_epi64(a, n), b), mask);
+	b = _mm_xor_si128(b, t);
+	a = _mm_xor_si128(a, _mm_slli_epi64(t, n));
+}
+
+//Transpose 8 blocks into 8 bit planes. The transform is its own inverse.
+static AES_BS_TARGET inline void Ortho(__m128i* q) {
+	const __m128i m1 = _mm_set1_epi8(0x55);
+	const __m128i m2 = _mm_set1_epi8(0x33);
+	const __m128i m4 = _mm_set1_epi8(0x0F);
+
+	SwapMove(q[0], q[1], m1, 1);
+	SwapMove(q[2], q[3], m1, 1);
+	SwapMove(q[4], q[5], m1, 1);
+	SwapMove(q[6], q[7], m1, 1);
+
+	SwapMove(q[0], q[2], m2, 2);
+	SwapMove(q[1], q[3], m2, 2);
+	SwapMove(q[4], q[6], m2, 2);
+	SwapMove(q[5], q[7], m2, 2);
+
+	SwapMove(q[0], q[4], m4, 4);
+	SwapMove(q[1], q[5], m4, 4);
+	SwapMove(q[2], q[6], m4, 4);
+	SwapMove(q[3], q[7], m4, 4);
+}
+
+//Spread every round key bit over a whole byte of its plane. The decryption stages before an inverse S-box carry its 0x63.
+template <uint8_t ROUNDS>
+static AES_BS_TARGET inline void SliceKeys(const AES_KEYSET* keyset, bool decrypt, __m128i (*sk)[8]) {
+	for (uint8_t k = 0; k <= ROUNDS; k++) {
+		const uint32_t* rk = decrypt ? keyset->GetDecryptRoundKey(k) : keyset->GetRoundKey(k);
+		__m128i key = _mm_loadu_si128((const __m128i*)rk);
+		if (decrypt && k > 0)
+			key = _mm_xor_si128(key, _mm_set1_epi8(0x63));
+		for (uint8_t i = 0; i < 8; i++) {
+			const __m128i bit = _mm_set1_epi8((char)(1 << i));
+			sk[k][i] = _mm_cmpeq_epi8(_mm_and_si128(key, bit), bit);
+		}
+	}
+}
+
+//
+static AES_BS_TARGET inline void AddRoundKey(__m128i* q, const __m128i* sk) {
+	for (uint8_t i = 0; i < 8; i++)
+		q[i] = _mm_xor_si128(q[i], sk[i]);
+}
+
+//Outputs of the top linear layers that the non-linear middle layer of the S-box circuits takes
+struct BitsliceSboxTop {
+	__m128i T1, T2, T3, T4, T6, T8, T9, T10, T13, T14, T15, T16, T17, T19, T20, T22, T23, T24, T25, T26, T27, U7;
+};
+
+//Products of the middle layer that the bottom linear layers combine
+struct BitsliceSboxMiddle {
+	__m128i M46, M47, M48, M49, M50, M51, M52, M53, M54, M55, M56, M57, M58, M59, M60, M61, M62, M63;
+};
+
+//Inversion in GF(2^8) shared by the S-box and the inverse S-box, only the linear layers around it differ
+static AES_BS_TARGET inline BitsliceSboxMiddle InvertMiddle(const BitsliceSboxTop& t) {
+	//Non-linear middle layer (inversion in GF(2^8))
+	__m128i M1 = _mm_and_si128(t.T13, t.T6);
+	__m128i M2 = _mm_and_si128(t.T23, t.T8);
+	__m128i M3 = _mm_xor_si128(t.T14, M1);
+	__m128i M4 = _mm_and_si128(t.T19, t.U7);
+	__m128i M5 = _mm_xor_si128(M4, M1);
+	__m128i M6 = _mm_and_si128(t.T3, t.T16);
+	__m128i M7 = _mm_and_si128(t.T22, t.T9);
+	__m128i M8 = _mm_xor_si128(t.T26, M6);
+	__m128i M9 = _mm_and_si128(t.T20, t.T17);
+	__m128i M10 = _mm_xor_si128(M9, M6);
+	__m128i M11 = _mm_and_si128(t.T1, t.T15);
+	__m128i M12 = _mm_and_si128(t.T4, t.T27);
+	__m128i M13 = _mm_xor_si128(M12, M11);
+	__m128i M14 = _mm_and_si128(t.T2, t.T10);
+	__m128i M15 = _mm_xor_si128(M14, M11);
+	__m128i M16 = _mm_xor_si128(M3, M2);
+	__m128i M17 = _mm_xor_si128(M5, t.T24);
+	__m128i M18 = _mm_xor_si128(M8, M7);
+	__m128i M19 = _mm_xor_si128(M10, M15);
+	__m128i M20 = _mm_xor_si128(M16, M13);
+	__m128i M21 = _mm_xor_si128(M17, M15);
+	__m128i M22 = _mm_xor_si128(M18, M13);
+	__m128i M23 = _mm_xor_si128(M19, t.T25);
+	__m128i M24 = _mm_xor_si128(M22, M23);
+	__m128i M25 = _mm_and_si128(M22, M20);
+	__m128i M26 = _mm_xor_si128(M21, M25);
+	__m128i M27 = _mm_xor_si128(M20, M21);
+	__m128i M28 = _mm_xor_si128(M23, M25);
+	__m128i M29 = _mm_and_si128(M28, M27);
+	__m128i M30 = _mm_and_si128(M26, M24);
+	__m128i M31 = _mm_and_si128(M20, M23);
+	__m128i M32 = _mm_and_si128(M27, M31);
+	__m128i M33 = _mm_xor_si128(M27, M25);
+	__m128i M34 = _mm_and_si128(M21, M22);
+	__m128i M35 = _mm_and_si128(M24, M34);
+	__m128i M36 = _mm_xor_si128(M24, M25);
+	__m128i M37 = _mm_xor_si128(M21, M29);
+	__m128i M38 = _mm_xor_si128(M32, M33);
+	__m128i M39 = _mm_xor_si128(M23, M30);
+	__m128i M40 = _mm_xor_si128(M35, M36);
+	__m128i M41 = _mm_xor_si128(M38, M40);
+	__m128i M42 = _mm_xor_si128(M37, M39);
+	__m128i M43 = _mm_xor_si128(M37, M38);
+	__m128i M44 = _mm_xor_si128(M39, M40);
+	__m128i M45 = _mm_xor_si128(M42, M41);
+	__m128i M46 = _mm_and_si128(M44, t.T6);
+	__m128i M47 = _mm_and_si128(M40, t.T8);
+	__m128i M48 = _mm_and_si128(M39, t.U7);
+	__m128i M49 = _mm_and_si128(M43, t.T16);
+	__m128i M50 = _mm_and_si128(M38, t.T9);
+	__m128i M51 = _mm_and_si128(M37, t.T17);
+	__m128i M52 = _mm_and_si128(M42, t.T15);
+	__m128i M53 = _mm_and_si128(M45, t.T27);
+	__m128i M54 = _mm_and_si128(M41, t.T10);
+	__m128i M55 = _mm_and_si128(M44, t.T13);
+	__m128i M56 = _mm_and_si128(M40, t.T23);
+	__m128i M57 = _mm_and_si128(M39, t.T19);
+	__m128i M58 = _mm_and_si128(M43, t.T3);
+	__m128i M59 = _mm_and_si128(M38, t.T22);
+	__m128i M60 = _mm_and_si128(M37, t.T20);
+	__m128i M61 = _mm_and_si128(M42, t.T1);
+	__m128i M62 = _mm_and_si128(M45, t.T4);
+	__m128i M63 = _mm_and_si128(M41, t.T2);
+
+
+	return { M46, M47, M48, M49, M50, M51, M52, M53, M54, M55, M56, M57, M58, M59, M60, M61, M62, M63 };
+}
+
+//S-box of every byte with the Boyar-Peralta circuit (113 gates). U0 and S0 are the most significant bits.
+static AES_BS_TARGET inline void SubBytes(__m128i* q) {
+	const __m128i ones = _mm_set1_epi32(-1);
+
+	const __m128i U0 = q[7], U1 = q[6], U2 = q[5], U3 = q[4];
+	const __m128i U4 = q[3], U5 = q[2], U6 = q[1], U7 = q[0];
+
+	//Top linear layer
+	__m128i T1 = _mm_xor_si128(U0, U3);
+	__m128i T2 = _mm_xor_si128(U0, U5);
+	__m128i T3 = _mm_xor_si128(U0, U6);
+	__m128i T4 = _mm_xor_si128(U3, U5);
+	__m128i T5 = _mm_xor_si128(U4, U6);
+	__m128i T6 = _mm_xor_si128(T1, T5);
+	__m128i T7 = _mm_xor_si128(U1, U2);
+	__m128i T8 = _mm_xor_si128(U7, T6);
+	__m128i T9 = _mm_xor_si128(U7, T7);
+	__m128i T10 = _mm_xor_si128(T6, T7);
+	__m128i T11 = _mm_xor_si128(U1, U5);
+	__m128i T12 = _mm_xor_si128(U2, U5);
+	__m128i T13 = _mm_xor_si128(T3, T4);
+	__m128i T14 = _mm_xor_si128(T6, T11);
+	__m128i T15 = _mm_xor_si128(T5, T11);
+	__m128i T16 = _mm_xor_si128(T5, T12);
+	__m128i T17 = _mm_xor_si128(T9, T16);
+	__m128i T18 = _mm_xor_si128(U3, U7);
+	__m128i T19 = _mm_xor_si128(T7, T18);
+	__m128i T20 = _mm_xor_si128(T1, T19);
+	__m128i T21 = _mm_xor_si128(U6, U7);
+	__m128i T22 = _mm_xor_si128(T7, T21);
+	__m128i T23 = _mm_xor_si128(T2, T22);
+	__m128i T24 = _mm_xor_si128(T2, T10);
+	__m128i T25 = _mm_xor_si128(T20, T17);
+	__m128i T26 = _mm_xor_si128(T3, T16);
+	__m128i T27 = _mm_xor_si128(T1, T12);
+
+	BitsliceSboxMiddle m = InvertMiddle({ T1, T2, T3, T4, T6, T8, T9, T10, T13, T14, T15, T16, T17, T19, T20, T22, T23, T24, T25, T26, T27, U7 });
+
+	//Bottom linear layer
+	__m128i L0 = _mm_xor_si128(m.M61, m.M62);
+	__m128i L1 = _mm_xor_si128(m.M50, m.M56);
+	__m128i L2 = _mm_xor_si128(m.M46, m.M48);
+	__m128i L3 = _mm_xor_si128(m.M47, m.M55);
+	__m128i L4 = _mm_xor_si128(m.M54, m.M58);
+	__m128i L5 = _mm_xor_si128(m.M49, m.M61);
+	__m128i L6 = _mm_xor_si128(m.M62, L5);
+	__m128i L7 = _mm_xor_si128(m.M46, L3);
+	__m128i L8 = _mm_xor_si128(m.M51, m.M59);
+	__m128i L9 = _mm_xor_si128(m.M52, m.M53);
+	__m128i L10 = _mm_xor_si128(m.M53, L4);
+	__m128i L11 = _mm_xor_si128(m.M60, L2);
+	__m128i L12 = _mm_xor_si128(m.M48, m.M51);
+	__m128i L13 = _mm_xor_si128(m.M50, L0);
+	__m128i L14 = _mm_xor_si128(m.M52, m.M61);
+	__m128i L15 = _mm_xor_si128(m.M55, L1);
+	__m128i L16 = _mm_xor_si128(m.M56, L0);
+	__m128i L17 = _mm_xor_si128(m.M57, L1);
+	__m128i L18 = _mm_xor_si128(m.M58, L8);
+	__m128i L19 = _mm_xor_si128(m.M63, L4);
+	__m128i L20 = _mm_xor_si128(L0, L1);
+	__m128i L21 = _mm_xor_si128(L1, L7);
+	__m128i L22 = _mm_xor_si128(L3, L12);
+	__m128i L23 = _mm_xor_si128(L18, L2);
+	__m128i L24 = _mm_xor_si128(L15, L9);
+	__m128i L25 = _mm_xor_si128(L6, L10);
+	__m128i L26 = _mm_xor_si128(L7, L9);
+	__m128i L27 = _mm_xor_si128(L8, L10);
+	__m128i L28 = _mm_xor_si128(L11, L14);
+	__m128i L29 = _mm_xor_si128(L11, L17);
+
+	q[7] = _mm_xor_si128(L6, L24);
+	q[6] = _mm_xor_si128(_mm_xor_si128(L16, L26), ones);
+	q[5] = _mm_xor_si128(_mm_xor_si128(L19, L28), ones);
+	q[4] = _mm_xor_si128(L6, L21);
+	q[3] = _mm_xor_si128(L20, L22);
+	q[2] = _mm_xor_si128(L25, L29);
+	q[1] = _mm_xor_si128(_mm_xor_si128(L13, L27), ones);
+	q[0] = _mm_xor_si128(_mm_xor_si128(L6, L23), ones);
+}
+
+/*
+ *	Note:	Inverse S-box
+ *
+ *			InvSBox(x) = Inverse(A^-1 * (x ^ 0x63)), where A is the linear part of the
+ *			S-box affine transform. The 0x63 is folded into the decryption round keys
+ *			by SliceKeys(), A^-1 into the top linear layer and no affine transform is
+ *			left after the inversion, so the inverse costs the same middle layer and
+ *			about as many XORs as the forward S-box. Both linear layers were derived
+ *			from the Boyar-Peralta ones and checked against the inverse S-box table.
+*/
+
+//Inverse S-box of every byte, q holds x ^ 0x63. Z0 is the least significant bit.
+static AES_BS_TARGET inline void SubBytesInv(__m128i* q) {
+	const __m128i Z0 = q[0], Z1 = q[1], Z2 = q[2], Z3 = q[3];
+	const __m128i Z4 = q[4], Z5 = q[5], Z6 = q[6], Z7 = q[7];
+
+	//Top linear layer, the inverse affine transform folded in
+	__m128i X1 = _mm_xor_si128(Z0, Z6);
+	__m128i X2 = _mm_xor_si128(Z1, X1);
+	__m128i T1 = _mm_xor_si128(Z3, Z4);
+	__m128i T13 = _mm_xor_si128(Z7, X2);
+	__m128i T22 = _mm_xor_si128(Z4, Z6);
+	__m128i X3 = _mm_xor_si128(Z2, T13);
+	__m128i X4 = _mm_xor_si128(Z2, Z5);
+	__m128i T2 = _mm_xor_si128(Z6, Z7);
+	__m128i X5 = _mm_xor_si128(Z1, T1);
+	__m128i T19 = _mm_xor_si128(Z4, X2);
+	__m128i X6 = _mm_xor_si128(Z1, Z3);
+	__m128i X7 = _mm_xor_si128(Z4, Z5);
+	__m128i X8 = _mm_xor_si128(Z3, X1);
+	__m128i T6 = _mm_xor_si128(T22, X4);
+	__m128i T17 = _mm_xor_si128(Z5, T19);
+	__m128i T24 = _mm_xor_si128(Z0, Z3);
+	__m128i T3 = _mm_xor_si128(Z0, X5);
+	__m128i U7 = _mm_xor_si128(Z7, X4);
+	__m128i T20 = _mm_xor_si128(Z3, X2);
+	__m128i T8 = _mm_xor_si128(Z7, T22);
+	__m128i X9 = _mm_xor_si128(Z5, X6);
+	__m128i T27 = _mm_xor_si128(Z2, X5);
+	__m128i T25 = _mm_xor_si128(Z5, T1);
+	__m128i T14 = _mm_xor_si128(Z3, X3);
+	__m128i T4 = _mm_xor_si128(T1, T2);
+	__m128i T23 = _mm_xor_si128(Z4, Z7);
+	__m128i T16 = _mm_xor_si128(Z6, X9);
+	__m128i T9 = _mm_xor_si128(Z0, T1);
+	__m128i T10 = _mm_xor_si128(Z7, X8);
+	__m128i T26 = _mm_xor_si128(X1, X7);
+	__m128i T15 = _mm_xor_si128(Z4, X3);
+
+	BitsliceSboxMiddle m = InvertMiddle({ T1, T2, T3, T4, T6, T8, T9, T10, T13, T14, T15, T16, T17, T19, T20, T22, T23, T24, T25, T26, T27, U7 });
+
+	//Bottom linear layer, the inverse needs no affine transform
+	__m128i Y1 = _mm_xor_si128(m.M52, m.M61);
+	__m128i Y2 = _mm_xor_si128(m.M59, Y1);
+	__m128i Y3 = _mm_xor_si128(m.M58, Y2);
+	__m128i Y4 = _mm_xor_si128(m.M62, Y3);
+	__m128i Y5 = _mm_xor_si128(m.M49, m.M50);
+	__m128i Y6 = _mm_xor_si128(m.M54, Y4);
+	__m128i Y7 = _mm_xor_si128(m.M48, m.M56);
+	__m128i Y8 = _mm_xor_si128(m.M47, Y5);
+	__m128i Y9 = _mm_xor_si128(m.M50, m.M51);
+	__m128i Y10 = _mm_xor_si128(m.M55, m.M63);
+	__m128i Y11 = _mm_xor_si128(m.M54, Y7);
+	__m128i Y12 = _mm_xor_si128(m.M60, Y11);
+	__m128i Y13 = _mm_xor_si128(m.M46, Y6);
+	__m128i Y14 = _mm_xor_si128(Y8, Y12);
+	__m128i Y15 = _mm_xor_si128(m.M57, Y14);
+	__m128i Y16 = _mm_xor_si128(m.M62, Y1);
+	__m128i Y17 = _mm_xor_si128(m.M47, Y9);
+	__m128i Y18 = _mm_xor_si128(m.M46, Y9);
+	__m128i Y19 = _mm_xor_si128(m.M63, Y3);
+	__m128i Y20 = _mm_xor_si128(Y2, Y10);
+	__m128i Y21 = _mm_xor_si128(m.M58, Y16);
+	__m128i Y22 = _mm_xor_si128(m.M49, Y6);
+	__m128i Y23 = _mm_xor_si128(m.M61, Y10);
+	__m128i Y24 = _mm_xor_si128(Y7, Y19);
+	__m128i Y25 = _mm_xor_si128(m.M53, m.M57);
+	__m128i Y26 = _mm_xor_si128(m.M53, Y4);
+	__m128i Y27 = _mm_xor_si128(Y24, Y25);
+	q[6] = _mm_xor_si128(Y14, Y20);
+	q[7] = _mm_xor_si128(m.M51, Y22);
+	q[2] = _mm_xor_si128(Y13, Y17);
+	q[4] = _mm_xor_si128(m.M48, Y13);
+	q[0] = _mm_xor_si128(m.M57, Y23);
+	q[1] = _mm_xor_si128(Y5, Y26);
+	q[5] = _mm_xor_si128(Y15, Y21);
+	q[3] = _mm_xor_si128(Y18, Y27);
+}
+
+//Row r of a plane is byte r of every 32-bit lane, row r moves r lanes to the left
+static AES_BS_TARGET inline void ShiftRows(__m128i* q) {
+	const __m128i row0 = _mm_set1_epi32(0x000000FF);
+	const __m128i row1 = _mm_set1_epi32(0x0000FF00);
+	const __m128i row2 = _mm_set1_epi32(0x00FF0000);
+	const __m128i row3 = _mm_set1_epi32((int)0xFF000000);
+	for (uint8_t i = 0; i < 8; i++) {
+		__m128i x = q[i];
+		q[i] = _mm_or_si128(
+			_mm_or_si128(_mm_and_si128(x, row0), _mm_and_si128(_mm_shuffle_epi32(x, _MM_SHUFFLE(0, 3, 2, 1)), row1)),
+			_mm_or_si128(_mm_and_si128(_mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)), row2), _mm_and_si128(_mm_shuffle_epi32(x, _MM_SHUFFLE(2, 1, 0, 3)), row3)));
+	}
+}
+
+//Row r moves r lanes to the right
+static AES_BS_TARGET inline void ShiftRowsInv(__m128i* q) {
+	const __m128i row0 = _mm_set1_epi32(0x000000FF);
+	const __m128i row1 = _mm_set1_epi32(0x0000FF00);
+	const __m128i row2 = _mm_set1_epi32(0x00FF0000);
+	const __m128i row3 = _mm_set1_epi32((int)0xFF000000);
+	for (uint8_t i = 0; i < 8; i++) {
+		__m128i x = q[i];
+		q[i] = _mm_or_si128(
+			_mm_or_si128(_mm_and_si128(x, row0), _mm_and_si128(_mm_shuffle_epi32(x, _MM_SHUFFLE(2, 1, 0, 3)), row1)),
+			_mm_or_si128(_mm_and_si128(_mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)), row2), _mm_and_si128(_mm_shuffle_epi32(x, _MM_SHUFFLE(0, 3, 2, 1)), row3)));
+	}
+}
+
+//Move row r + 1 of every column into row r
+static AES_BS_TARGET inline __m128i RotateRows1(__m128i x) {
+	return _mm_or_si128(_mm_srli_epi32(x, 8), _mm_slli_epi32(x, 24));
+}
+
+//Move row r + 2 of every column into row r
+static AES_BS_TARGET inline __m128i RotateRows2(__m128i x) {
+	return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+//Multiply every byte by x in GF(2^8), planes are bits so this is a shift with the reduction folded in
+static AES_BS_TARGET inline void XTime(__m128i* q) {
+	__m128i top = q[7];
+	q[7] = q[6];
+	q[6] = q[5];
+	q[5] = q[4];
+	q[4] = _mm_xor_si128(q[3], top);
+	q[3] = _mm_xor_si128(q[2], top);
+	q[2] = q[1];
+	q[1] = _mm_xor_si128(q[0], top);
+	q[0] = top;
+}
+
+//out_r = 2 * (a_r ^ a_r+1) ^ a_r+1 ^ a_r+2 ^ a_r+3
+static AES_BS_TARGET inline void MixColumns(__m128i* q) {
+	__m128i r1[8], t[8];
+	for (uint8_t i = 0; i < 8; i++) {
+		r1[i] = RotateRows1(q[i]);
+		t[i] = _mm_xor_si128(q[i], r1[i]);
+		q[i] = _mm_xor_si128(r1[i], RotateRows2(t[i]));
+	}
+	XTime(t);
+	for (uint8_t i = 0; i < 8; i++)
+		q[i] = _mm_xor_si128(q[i], t[i]);
+}
+
+//InvMixColumns is MixColumns after a_r ^= 4 * (a_r ^ a_r+2)
+static AES_BS_TARGET inline void MixColumnsInv(__m128i* q) {
+	__m128i w[8];
+	for (uint8_t i = 0; i < 8; i++)
+		w[i] = _mm_xor_si128(q[i], RotateRows2(q[i]));
+	XTime(w);
+	XTime(w);
+	for (uint8_t i = 0; i < 8; i++)
+		q[i] = _mm_xor_si128(q[i], w[i]);
+	MixColumns(q);
+}
+
+//Encrypt 8 blocks
+template <uint8_t ROUNDS>
+static AES_BS_TARGET void Encrypt8(const __m128i (*sk)[8], const uint8_t* src, uint8_t* dst) {
+	__m128i q[8];
+	for (uint8_t b = 0; b < AES_BS_BLOCKS; b++)
+		q[b] = _mm_loadu_si128((const __m128i*)(src + b * 16));
+	Ortho(q);
+
+	AddRoundKey(q, sk[0]);
+	#pragma GCC unroll 13
+	for (uint8_t i = 1; i < ROUNDS; i++) {
+		SubBytes(q);
+		ShiftRows(q);
+		MixColumns(q);
+		AddRoundKey(q, sk[i]);
+	}
+	SubBytes(q);
+	ShiftRows(q);
+	AddRoundKey(q, sk[ROUNDS]);
+
+	Ortho(q);
+	for (uint8_t b = 0; b < AES_BS_BLOCKS; b++)
+		_mm_storeu_si128((__m128i*)(dst + b * 16), q[b]);
+}
+
+//Decrypt 8 blocks with the equivalent inverse cipher
+template <uint8_t ROUNDS>
+static AES_BS_TARGET void Decrypt8(const __m128i (*sk)[8], const uint8_t* src, uint8_t* dst) {
+	__m128i q[8];
+	for (uint8_t b = 0; b < AES_BS_BLOCKS; b++)
+		q[b] = _mm_loadu_si128((const __m128i*)(src + b * 16));
+	Ortho(q);
+
+	AddRoundKey(q, sk[ROUNDS]);
+	#pragma GCC unroll 13
+	for (uint8_t i = ROUNDS - 1; i > 0; i--) {
+		ShiftRowsInv(q);
+		SubBytesInv(q);
+		MixColumnsInv(q);
+		AddRoundKey(q, sk[i]);
+	}
+	ShiftRowsInv(q);
+	SubBytesInv(q);
+	AddRoundKey(q, sk[0]);
+
+	Ortho(q);
+	for (uint8_t b = 0; b < AES_BS_BLOCKS; b++)
+		_mm_storeu_si128((__m128i*)(dst + b * 16), q[b]);
+}
+
+//
+template <uint8_t ROUNDS>
+static AES_BS_TARGET void BitsliceEncryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) {
+	__m128i sk[AES_MAX_ROUNDS + 1][8];
+	SliceKeys<ROUNDS>(keyset, false, sk);
+
+	for (; count >= AES_BS_BLOCKS; count -= AES_BS_BLOCKS) {
+		Encrypt8<ROUNDS>(sk, src, dst);
+		src += AES_BS_BLOCKS * 16;
+		dst += AES_BS_BLOCKS * 16;
+	}
+
+	//Fill up the last pass with zero blocks
+	if (count) {
+		uint8_t tail[AES_BS_BLOCKS * 16] = { 0 };
+		memcpy(tail, src, count * 16);
+		Encrypt8<ROUNDS>(sk, tail, tail);
+		memcpy(dst, tail, count * 16);
+	}
+}
+
+//
+template <uint8_t ROUNDS>
+static AES_BS_TARGET void BitsliceDecryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) {
+	__m128i sk[AES_MAX_ROUNDS + 1][8];
+	SliceKeys<ROUNDS>(keyset, true, sk);
+
+	for (; count >= AES_BS_BLOCKS; count -= AES_BS_BLOCKS) {
+		Decrypt8<ROUNDS>(sk, src, dst);
+		src += AES_BS_BLOCKS * 16;
+		dst += AES_BS_BLOCKS * 16;
+	}
+
+	//Fill up the last pass with zero blocks
+	if (count) {
+		uint8_t tail[AES_BS_BLOCKS * 16] = { 0 };
+		memcpy(tail, src, count * 16);
+		Decrypt8<ROUNDS>(sk, tail, tail);
+		memcpy(dst, tail, count * 16);
+	}
+}
+
+/*
+ * ************************************
+ * ************************************
+ *			AES_KERNEL_BITSLICE
+ * ************************************
+ * ************************************
+*/
+
+//
+const char* AES_KERNEL_BITSLICE::GetName() const {
+	return "bitslice";
+}
+
+//
+bool AES_KERNEL_BITSLICE::IsSupported() const {
+	return (GetCpuFeatures() & AES_CPU_SSE2) != 0;
+}
+
+//
+AES_BS_TARGET void AES_KERNEL_BITSLICE::EncryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const {
+	AES_ROUNDS_DISPATCH(keyset, BitsliceEncryptBlocks, keyset, src, dst, count);
+}
+
+//
+AES_BS_TARGET void AES_KERNEL_BITSLICE::DecryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const {
+	AES_ROUNDS_DISPATCH(keyset, BitsliceDecryptBlocks, keyset, src, dst, count);
+}
+
+#endif
@@ -0,0 +1,358 @@
+///
+///     Code by:    Peter Mikulas
+///                 2023
+///
+
+#include <cstring>
+#include <fstream>
+
+#ifdef __GNUC__
+#include <cpuid.h>
+#endif
+
+#include "aes_config.h"
+#include "aes.h"
+
+//Load 4 bytes of a block as a little-endian column word
+static inline uint32_t LoadColumn(const uint8_t* src) {
+	return (uint32_t)src[0] | (uint32_t)src[1] << 8 | (uint32_t)src[2] << 16 | (uint32_t)src[3] << 24;
+}
+
+//Store a little-endian column word into 4 bytes of a block
+static inline void StoreColumn(uint8_t* dst, uint32_t word) {
+	dst[0] = (uint8_t)word;
+	dst[1] = (uint8_t)(word >> 8);
+	dst[2] = (uint8_t)(word >> 16);
+	dst[3] = (uint8_t)(word >> 24);
+}
+
+//Load 8 bytes as a big-endian word, GHASH numbers its bits from the first byte
+static inline uint64_t LoadBig64(const uint8_t* src) {
+	uint64_t word = 0;
+	for (uint8_t i = 0; i < 8; i++)
+		word = word << 8 | src[i];
+	return word;
+}
+
+//Store a big-endian word into 8 bytes
+static inline void StoreBig64(uint8_t* dst, uint64_t word) {
+	for (uint8_t i = 0; i < 8; i++)
+		dst[i] = (uint8_t)(word >> (56 - 8 * i));
+}
+
+//Reduction of the 4 bits shifted out of a GHASH value, already folded with the GCM polynomial
+static const uint64_t ghashRem4[16] = {
+	0x0000ULL << 48, 0x1C20ULL << 48, 0x3840ULL << 48, 0x2460ULL << 48,
+	0x7080ULL << 48, 0x6CA0ULL << 48, 0x48C0ULL << 48, 0x54E0ULL << 48,
+	0xE100ULL << 48, 0xFD20ULL << 48, 0xD940ULL << 48, 0xC560ULL << 48,
+	0x9180ULL << 48, 0x8DA0ULL << 48, 0xA9C0ULL << 48, 0xB5E0ULL << 48
+};
+
+//Shift a GHASH value 4 bits towards the higher powers of x and reduce
+static inline void GhashShift4(uint64_t& high, uint64_t& low) {
+	uint8_t rem = low & 0x0F;
+	low = (high << 60) | (low >> 4);
+	high = (high >> 4) ^ ghashRem4[rem];
+}
+
+//Encrypt a block with the T-table engine
+template <uint8_t ROUNDS>
+static inline void TableEncrypt(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst) {
+	//Initial round key
+	const uint32_t* rk = keyset->GetRoundKey(0);
+	uint32_t s0 = LoadColumn(src) ^ rk[0];
+	uint32_t s1 = LoadColumn(src + 4) ^ rk[1];
+	uint32_t s2 = LoadColumn(src + 8) ^ rk[2];
+	uint32_t s3 = LoadColumn(src + 12) ^ rk[3];
+	uint32_t t0, t1, t2, t3;
+
+	//SubBytes, ShiftRows and MixColumns with 4 lookups per column
+	#pragma GCC unroll 13
+	for (uint8_t i = 1; i < ROUNDS; i++) {
+		rk = keyset->GetRoundKey(i);
+		t0 = Te0[s0 & 0xFF] ^ Te1[(s1 >> 8) & 0xFF] ^ Te2[(s2 >> 16) & 0xFF] ^ Te3[s3 >> 24] ^ rk[0];
+		t1 = Te0[s1 & 0xFF] ^ Te1[(s2 >> 8) & 0xFF] ^ Te2[(s3 >> 16) & 0xFF] ^ Te3[s0 >> 24] ^ rk[1];
+		t2 = Te0[s2 & 0xFF] ^ Te1[(s3 >> 8) & 0xFF] ^ Te2[(s0 >> 16) & 0xFF] ^ Te3[s1 >> 24] ^ rk[2];
+		t3 = Te0[s3 & 0xFF] ^ Te1[(s0 >> 8) & 0xFF] ^ Te2[(s1 >> 16) & 0xFF] ^ Te3[s2 >> 24] ^ rk[3];
+		s0 = t0;
+		s1 = t1;
+		s2 = t2;
+		s3 = t3;
+	}
+
+	//Final round without MixColumns
+	rk = keyset->GetRoundKey(ROUNDS);
+	t0 = ((uint32_t)Te4[s0 & 0xFF] | (uint32_t)Te4[(s1 >> 8) & 0xFF] << 8 | (uint32_t)Te4[(s2 >> 16) & 0xFF] << 16 | (uint32_t)Te4[s3 >> 24] << 24) ^ rk[0];
+	t1 = ((uint32_t)Te4[s1 & 0xFF] | (uint32_t)Te4[(s2 >> 8) & 0xFF] << 8 | (uint32_t)Te4[(s3 >> 16) & 0xFF] << 16 | (uint32_t)Te4[s0 >> 24] << 24) ^ rk[1];
+	t2 = ((uint32_t)Te4[s2 & 0xFF] | (uint32_t)Te4[(s3 >> 8) & 0xFF] << 8 | (uint32_t)Te4[(s0 >> 16) & 0xFF] << 16 | (uint32_t)Te4[s1 >> 24] << 24) ^ rk[2];
+	t3 = ((uint32_t)Te4[s3 & 0xFF] | (uint32_t)Te4[(s0 >> 8) & 0xFF] << 8 | (uint32_t)Te4[(s1 >> 16) & 0xFF] << 16 | (uint32_t)Te4[s2 >> 24] << 24) ^ rk[3];
+
+	StoreColumn(dst, t0);
+	StoreColumn(dst + 4, t1);
+	StoreColumn(dst + 8, t2);
+	StoreColumn(dst + 12, t3);
+}
+
+//
+//Decrypt a block with the Td-table engine
+template <uint8_t ROUNDS>
+static inline void TableDecrypt(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst) {
+	//Last round key first
+	const uint32_t* rk = keyset->GetDecryptRoundKey(ROUNDS);
+	uint32_t s0 = LoadColumn(src) ^ rk[0];
+	uint32_t s1 = LoadColumn(src + 4) ^ rk[1];
+	uint32_t s2 = LoadColumn(src + 8) ^ rk[2];
+	uint32_t s3 = LoadColumn(src + 12) ^ rk[3];
+	uint32_t t0, t1, t2, t3;
+
+	//InvShiftRows, InvSubBytes and InvMixColumns with 4 lookups per column (equivalent inverse cipher).
+	//The decryption schedule already has InvMixColumns applied to the round keys.
+	#pragma GCC unroll 13
+	for (uint8_t i = ROUNDS - 1; i > 0; i--) {
+		rk = keyset->GetDecryptRoundKey(i);
+		t0 = Td0[s0 & 0xFF] ^ Td1[(s3 >> 8) & 0xFF] ^ Td2[(s2 >> 16) & 0xFF] ^ Td3[s1 >> 24] ^ rk[0];
+		t1 = Td0[s1 & 0xFF] ^ Td1[(s0 >> 8) & 0xFF] ^ Td2[(s3 >> 16) & 0xFF] ^ Td3[s2 >> 24] ^ rk[1];
+		t2 = Td0[s2 & 0xFF] ^ Td1[(s1 >> 8) & 0xFF] ^ Td2[(s0 >> 16) & 0xFF] ^ Td3[s3 >> 24] ^ rk[2];
+		t3 = Td0[s3 & 0xFF] ^ Td1[(s2 >> 8) & 0xFF] ^ Td2[(s1 >> 16) & 0xFF] ^ Td3[s0 >> 24] ^ rk[3];
+		s0 = t0;
+		s1 = t1;
+		s2 = t2;
+		s3 = t3;
+	}
+
+	//Final round without InvMixColumns
+	rk = keyset->GetDecryptRoundKey(0);
+	t0 = ((uint32_t)Td4[s0 & 0xFF] | (uint32_t)Td4[(s3 >> 8) & 0xFF] << 8 | (uint32_t)Td4[(s2 >> 16) & 0xFF] << 16 | (uint32_t)Td4[s1 >> 24] << 24) ^ rk[0];
+	t1 = ((uint32_t)Td4[s1 & 0xFF] | (uint32_t)Td4[(s0 >> 8) & 0xFF] << 8 | (uint32_t)Td4[(s3 >> 16) & 0xFF] << 16 | (uint32_t)Td4[s2 >> 24] << 24) ^ rk[1];
+	t2 = ((uint32_t)Td4[s2 & 0xFF] | (uint32_t)Td4[(s1 >> 8) & 0xFF] << 8 | (uint32_t)Td4[(s0 >> 16) & 0xFF] << 16 | (uint32_t)Td4[s3 >> 24] << 24) ^ rk[2];
+	t3 = ((uint32_t)Td4[s3 & 0xFF] | (uint32_t)Td4[(s2 >> 8) & 0xFF] << 8 | (uint32_t)Td4[(s1 >> 16) & 0xFF] << 16 | (uint32_t)Td4[s0 >> 24] << 24) ^ rk[3];
+
+	StoreColumn(dst, t0);
+	StoreColumn(dst + 4, t1);
+	StoreColumn(dst + 8, t2);
+	StoreColumn(dst + 12, t3);
+}
+
+//Every column of a block is already independent, the loop only saves the virtual call per block
+template <uint8_t ROUNDS>
+static void TableEncryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		TableEncrypt<ROUNDS>(keyset, src + i * 16, dst + i * 16);
+}
+
+//
+template <uint8_t ROUNDS>
+static void TableDecryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		TableDecrypt<ROUNDS>(keyset, src + i * 16, dst + i * 16);
+}
+
+/*
+ * ************************************
+ * ************************************
+ *				AES_KERNEL
+ * ************************************
+ * ************************************
+*/
+
+#ifdef AES_KERNEL_X86
+static const AES_KERNEL_VAES vaesKernel;
+static const AES_KERNEL_NI niKernel;
+static const AES_KERNEL_VPERM vpermKernel;
+static const AES_KERNEL_BITSLICE bitsliceKernel;
+#endif
+static const AES_KERNEL_TABLE tableKernel;
+
+//Every backend, fastest first. The table backend runs everywhere and must stay last.
+//Bitslice comes before table although its batch decryption is still about 15% slower (InvMixColumns costs more than
+//MixColumns), its batches do not index memory with secret data and that is worth more than the speed.
+static const AES_KERNEL* const kernels[] = {
+#ifdef AES_KERNEL_X86
+	&vaesKernel,
+	&niKernel,
+	&vpermKernel,
+	&bitsliceKernel,
+#endif
+	&tableKernel
+};
+
+//
+const AES_KERNEL* AES_KERNEL::Select() {
+	//Probed on the first call only, the initialization of a function-local static is thread-safe
+	static const AES_KERNEL* const selected = [] {
+		for (const AES_KERNEL* kernel : kernels)
+			if (kernel->IsSupported())
+				return kernel;
+		return kernels[sizeof(kernels) / sizeof(kernels[0]) - 1];
+	}();
+
+	return selected;
+}
+
+//
+const AES_KERNEL* AES_KERNEL::Find(const char* name) {
+	if (!name)
+		return nullptr;
+
+	for (const AES_KERNEL* kernel : kernels)
+		if (!strcmp(kernel->GetName(), name))
+			return kernel->IsSupported() ? kernel : nullptr;
+
+	return nullptr;
+}
+
+//
+void AES_KERNEL::EncryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const {
+	for (size_t i = 0; i < count; i++) {
+		if (dst != src)
+			memcpy(dst + i * 16, src + i * 16, 16);
+		EncryptBlock(keyset, dst + i * 16);
+	}
+}
+
+//
+void AES_KERNEL::DecryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const {
+	for (size_t i = 0; i < count; i++) {
+		if (dst != src)
+			memcpy(dst + i * 16, src + i * 16, 16);
+		DecryptBlock(keyset, dst + i * 16);
+	}
+}
+
+//
+void AES_KERNEL::GhashInit(const uint8_t* h, AES_GHASH_KEY* key) const {
+	uint64_t high = LoadBig64(h);
+	uint64_t low = LoadBig64(h + 8);
+
+	//Entry 8 is H, entries 4, 2 and 1 are H multiplied by x, x^2 and x^3
+	key->table[0][0] = key->table[0][1] = 0;
+	for (uint8_t i = 8; i; i >>= 1) {
+		key->table[i][0] = high;
+		key->table[i][1] = low;
+		uint64_t reduce = 0xE100000000000000ULL & (0 - (low & 1));
+		low = (high << 63) | (low >> 1);
+		high = (high >> 1) ^ reduce;
+	}
+
+	//Every other entry is the sum of its bits
+	for (uint8_t i = 2; i < 16; i <<= 1)
+		for (uint8_t j = 1; j < i; j++) {
+			key->table[i + j][0] = key->table[i][0] ^ key->table[j][0];
+			key->table[i + j][1] = key->table[i][1] ^ key->table[j][1];
+		}
+}
+
+//
+void AES_KERNEL::GhashBlocks(const AES_GHASH_KEY* key, uint8_t* hash, const uint8_t* src, size_t count) const {
+	uint8_t x[16];
+	memcpy(x, hash, 16);
+
+	for (size_t i = 0; i < count; i++, src += 16) {
+		for (uint8_t j = 0; j < 16; j++)
+			x[j] ^= src[j];
+
+		//Horner's rule over the nibbles, starting from the last byte
+		uint64_t high = key->table[x[15] & 0x0F][0];
+		uint64_t low = key->table[x[15] & 0x0F][1];
+		GhashShift4(high, low);
+		high ^= key->table[x[15] >> 4][0];
+		low ^= key->table[x[15] >> 4][1];
+
+		for (int8_t j = 14; j >= 0; j--) {
+			GhashShift4(high, low);
+			high ^= key->table[x[j] & 0x0F][0];
+			low ^= key->table[x[j] & 0x0F][1];
+			GhashShift4(high, low);
+			high ^= key->table[x[j] >> 4][0];
+			low ^= key->table[x[j] >> 4][1];
+		}
+
+		StoreBig64(x, high);
+		StoreBig64(x + 8, low);
+	}
+
+	memcpy(hash, x, 16);
+}
+
+//Run CPUID and collect the AES_CPU_FEATURE bits
+static uint32_t QueryCpuFeatures() {
+	uint32_t features = 0;
+
+#if defined(AES_KERNEL_X86) && defined(__GNUC__)
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return features;
+
+	if (edx & bit_SSE2)
+		features |= AES_CPU_SSE2;
+	if (ecx & bit_SSSE3)
+		features |= AES_CPU_SSSE3;
+	if (ecx & bit_AES)
+		features |= AES_CPU_AESNI;
+	if (ecx & bit_PCLMUL)
+		features |= AES_CPU_PCLMUL;
+
+	//AVX-512 state has to be enabled by the OS in XCR0 (SSE, AVX, opmask and both ZMM halves)
+	bool zmmEnabled = false;
+	if (ecx & bit_OSXSAVE) {
+		unsigned int xcr0Low, xcr0High;
+		__asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+		zmmEnabled = (xcr0Low & 0xE6) == 0xE6;
+	}
+
+	if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+		if ((ebx & bit_AVX512F) && zmmEnabled)
+			features |= AES_CPU_AVX512F;
+		if (ecx & bit_VAES)
+			features |= AES_CPU_VAES;
+	}
+#endif
+
+	return features;
+}
+
+//
+uint32_t AES_KERNEL::GetCpuFeatures() {
+	//The features cannot change while running, CPUID runs once
+	static const uint32_t features = QueryCpuFeatures();
+	return features;
+}
+
+/*
+ * ************************************
+ * ************************************
+ *			AES_KERNEL_TABLE
+ * ************************************
+ * ************************************
+*/
+
+//
+const char* AES_KERNEL_TABLE::GetName() const {
+	return "table";
+}
+
+//
+bool AES_KERNEL_TABLE::IsSupported() const {
+	return true;
+}
+
+//
+void AES_KERNEL_TABLE::EncryptBlock(const AES_KEYSET* keyset, uint8_t* block) const {
+	AES_ROUNDS_DISPATCH(keyset, TableEncrypt, keyset, block, block);
+}
+
+//
+void AES_KERNEL_TABLE::DecryptBlock(const AES_KEYSET* keyset, uint8_t* block) const {
+	AES_ROUNDS_DISPATCH(keyset, TableDecrypt, keyset, block, block);
+}
+
+//
+void AES_KERNEL_TABLE::EncryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const {
+	AES_ROUNDS_DISPATCH(keyset, TableEncryptBlocks, keyset, src, dst, count);
+}
+
+//
+void AES_KERNEL_TABLE::DecryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const {
+	AES_ROUNDS_DISPATCH(keyset, TableDecryptBlocks, keyset, src, dst, count);
+}
@@ -0,0 +1,270 @@
+///
+///     Code by:    Peter Mikulas
+///                 2023
+///
+
+#ifndef AES_KERNEL_H
+#define AES_KERNEL_H
+
+#include <cstdint>
+#include <cstddef>
+
+class AES_KEYSET;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AES_KERNEL_X86
+#endif
+
+/*
+ *	Note:	The round functions of the backends are templates on the round count (10, 12 or 14),
+ *			so every key size gets its own fully unrolled code. AES_ROUNDS_DISPATCH picks the
+ *			instance matching the keyset once per call.
+*/
+#define AES_ROUNDS_DISPATCH(keyset, func, ...)		\
+	switch ((keyset)->GetRounds()) {				\
+	case 12: func<12>(__VA_ARGS__); break;			\
+	case 14: func<14>(__VA_ARGS__); break;			\
+	default: func<10>(__VA_ARGS__); break;			\
+	}
+
+/**
+ * 	@brief CPU features the cipher backends depend on
+*/
+enum AES_CPU_FEATURE {
+	AES_CPU_SSE2    = 0x01,
+	AES_CPU_AESNI   = 0x02,
+	AES_CPU_AVX512F = 0x04,		//Only set if the OS also saves the ZMM registers
+	AES_CPU_VAES    = 0x08,
+	AES_CPU_SSSE3   = 0x10,
+	AES_CPU_PCLMUL  = 0x20
+};
+
+/**
+ * 	@brief Precomputed GHASH key. The layout belongs to the backend that built it: a 4 bit multiplication table of H or the powers of H.
+*/
+struct AES_GHASH_KEY {
+	alignas(16) uint64_t table[16][2];
+};
+
+/**
+ * 	@brief Block cipher backend. Each implementation has a single instance, the best supported one is picked at runtime.
+*/
+class AES_KERNEL {
+public:
+
+	/**
+	 * 	@brief Get the backend's name
+	 * 
+	 * 	@returns Backend name in c string
+	*/
+	virtual const char* GetName(void) const = 0;
+	//*OK
+
+	/**
+	 * 	@brief Check if the backend can run on this CPU
+	 * 
+	 * 	@returns true: backend is usable | false: required instructions are missing
+	*/
+	virtual bool IsSupported(void) const = 0;
+	//*OK
+
+	/**
+	* 	@brief Encrypt a single 16 byte long block
+	*
+	* 	@param keyset  Key stages to encrypt with
+	* 	@param block  Array containing the data to be encrypted
+	*/
+	virtual void EncryptBlock(const AES_KEYSET* keyset, uint8_t* block) const = 0;
+	//*OK
+
+	/**
+	* 	@brief Decrypt a single 16 byte long block
+	*
+	* 	@param keyset  Key stages to decrypt with
+	* 	@param block  Array containing the data to be decrypted
+	*/
+	virtual void DecryptBlock(const AES_KEYSET* keyset, uint8_t* block) const = 0;
+	//*OK
+
+	/**
+	* 	@brief Encrypt independent blocks. Backends interleave several blocks to hide the round latency.
+	*
+	* 	@param keyset  Key stages to encrypt with
+	* 	@param src  Source blocks
+	* 	@param dst  Destination blocks (can be the same as src)
+	* 	@param count  Number of 16 byte long blocks
+	*/
+	virtual void EncryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const;
+	//*OK
+
+	/**
+	* 	@brief Decrypt independent blocks. Backends interleave several blocks to hide the round latency.
+	*
+	* 	@param keyset  Key stages to decrypt with
+	* 	@param src  Source blocks
+	* 	@param dst  Destination blocks (can be the same as src)
+	* 	@param count  Number of 16 byte long blocks
+	*/
+	virtual void DecryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const;
+	//*OK
+
+	/**
+	* 	@brief Build the GHASH key of GCM. The default is the portable 4 bit table method.
+	*
+	* 	@param h  Hash subkey, the encrypted all-zero block
+	* 	@param key  Precomputed key to fill, only valid with the same backend
+	*/
+	virtual void GhashInit(const uint8_t* h, AES_GHASH_KEY* key) const;
+	//*OK
+
+	/**
+	* 	@brief Absorb whole blocks into a GHASH value: hash = (hash ^ block) * H for every block
+	*
+	* 	@param key  Precomputed key from GhashInit() of the same backend
+	* 	@param hash  16 byte long hash value, updated in place
+	* 	@param src  Source blocks
+	* 	@param count  Number of 16 byte long blocks
+	*/
+	virtual void GhashBlocks(const AES_GHASH_KEY* key, uint8_t* hash, const uint8_t* src, size_t count) const;
+	//*OK
+
+	/**
+	 * 	@brief Destructor
+	*/
+	virtual ~AES_KERNEL() {}
+	//*OK
+
+	/**
+	 * 	@brief Select the fastest backend supported by this CPU. The CPU is only queried once.
+	 * 
+	 * 	@returns Pointer to the selected backend
+	*/
+	static const AES_KERNEL* Select(void);
+	//*OK
+
+	/**
+	 * 	@brief Find a backend by name
+	 * 
+	 * 	@param name  Backend name
+	 * 
+	 * 	@returns Pointer to the backend or nullptr if it is unknown or not supported by this CPU
+	*/
+	static const AES_KERNEL* Find(const char* name);
+	//*OK
+
+	/**
+	 * 	@brief Query CPU features with CPUID, only on the first call
+	 * 
+	 * 	@returns Bitmask of AES_CPU_FEATURE values
+	*/
+	static uint32_t GetCpuFeatures(void);
+	//*OK
+
+};
+
+/**
+ * 	@brief Portable T-table backend
+*/
+class AES_KERNEL_TABLE : public AES_KERNEL {
+public:
+
+	const char* GetName(void) const;
+
+	bool IsSupported(void) const;
+
+	void EncryptBlock(const AES_KEYSET* keyset, uint8_t* block) const;
+
+	void DecryptBlock(const AES_KEYSET* keyset, uint8_t* block) const;
+
+	void EncryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const;
+
+	void DecryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const;
+
+};
+
+#ifdef AES_KERNEL_X86
+
+/**
+ * 	@brief AES-NI backend (AESENC/AESDEC), GHASH with PCLMULQDQ when the CPU has it
+*/
+class AES_KERNEL_NI : public AES_KERNEL {
+public:
+
+	const char* GetName(void) const;
+
+	bool IsSupported(void) const;
+
+	void EncryptBlock(const AES_KEYSET* keyset, uint8_t* block) const;
+
+	void DecryptBlock(const AES_KEYSET* keyset, uint8_t* block) const;
+
+	void EncryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const;
+
+	void DecryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const;
+
+	void GhashInit(const uint8_t* h, AES_GHASH_KEY* key) const;
+
+	void GhashBlocks(const AES_GHASH_KEY* key, uint8_t* hash, const uint8_t* src, size_t count) const;
+
+};
+
+/**
+ * 	@brief Constant-time bitsliced SSE2 backend for 8 blocks at once. Single blocks use the T-tables.
+*/
+class AES_KERNEL_BITSLICE : public AES_KERNEL_TABLE {
+public:
+
+	const char* GetName(void) const;
+
+	bool IsSupported(void) const;
+
+	void EncryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const;
+
+	void DecryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const;
+
+};
+
+/**
+ * 	@brief Constant-time SSSE3 backend, computes the S-box with PSHUFB nibble lookups for single blocks. Multiple blocks are bitsliced.
+*/
+class AES_KERNEL_VPERM : public AES_KERNEL_BITSLICE {
+public:
+
+	const char* GetName(void) const;
+
+	bool IsSupported(void) const;
+
+	void EncryptBlock(const AES_KEYSET* keyset, uint8_t* block) const;
+
+	void DecryptBlock(const AES_KEYSET* keyset, uint8_t* block) const;
+
+	/**
+	 * 	@brief Convert both key schedules into the state bases of this backend, once per key. Does nothing without SSSE3.
+	 * 
+	 * 	@param keyset  Keyset with both schedules calculated
+	 * 	@param encKeys  Stages for encryption, the middle ones in the tower basis with the S-box constant folded in
+	 * 	@param decKeys  Stages for decryption, the middle ones in the decryption state basis
+	*/
+	static void ConvertKeys(const AES_KEYSET* keyset, uint32_t (*encKeys)[4], uint32_t (*decKeys)[4]);
+
+};
+
+/**
+ * 	@brief VAES backend, runs AESENC/AESDEC on 4 blocks per ZMM register. Single blocks use AES-NI.
+*/
+class AES_KERNEL_VAES : public AES_KERNEL_NI {
+public:
+
+	const char* GetName(void) const;
+
+	bool IsSupported(void) const;
+
+	void EncryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const;
+
+	void DecryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const;
+
+};
+
+#endif
+
+#endif
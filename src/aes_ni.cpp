@@ -0,0 +1,289 @@
+///
+///     Code by:    Peter Mikulas
+///                 2023
+///
+
+#include <fstream>
+
+#include "aes.h"
+
+#ifdef AES_KERNEL_X86
+
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+
+/*
+ *	Note:	The AES-NI functions are compiled for the "aes" target one by one, so the
+ *			rest of the program still runs on CPUs without these instructions.
+ *			AES_KERNEL::Select() only hands this backend out when CPUID reports AES-NI.
+*/
+
+#define AES_NI_TARGET __attribute__((target("aes,sse2")))
+
+//Blocks processed side by side, enough to keep the AES unit busy for its whole latency
+#define AES_NI_INTERLEAVE 8
+
+//GHASH uses PCLMULQDQ and PSHUFB, which CPUID reports separately from AES-NI
+#define AES_NI_CLMUL_TARGET __attribute__((target("pclmul,ssse3,sse2")))
+
+//Blocks folded into a single GHASH reduction, the key holds H^1 - H^AES_NI_GHASH_AGGREGATE
+#define AES_NI_GHASH_AGGREGATE 4
+
+//Load the encryption round keys. Round keys are stored as little-endian column words, which is the byte order AESENC expects.
+template <uint8_t ROUNDS>
+static AES_NI_TARGET inline void LoadEncryptKeys(const AES_KEYSET* keyset, __m128i* rk) {
+	for (uint8_t i = 0; i <= ROUNDS; i++)
+		rk[i] = _mm_loadu_si128((const __m128i*)keyset->GetRoundKey(i));
+}
+
+//Load the decryption round keys. AESDEC adds the round key after InvMixColumns, which is the layout of the decryption schedule.
+template <uint8_t ROUNDS>
+static AES_NI_TARGET inline void LoadDecryptKeys(const AES_KEYSET* keyset, __m128i* rk) {
+	for (uint8_t i = 0; i <= ROUNDS; i++)
+		rk[i] = _mm_loadu_si128((const __m128i*)keyset->GetDecryptRoundKey(i));
+}
+
+//Encrypt a single block with the round keys already in registers
+template <uint8_t ROUNDS>
+static AES_NI_TARGET inline __m128i EncryptOne(__m128i state, const __m128i* rk) {
+	state = _mm_xor_si128(state, rk[0]);
+	#pragma GCC unroll 13
+	for (uint8_t i = 1; i < ROUNDS; i++)
+		state = _mm_aesenc_si128(state, rk[i]);
+	return _mm_aesenclast_si128(state, rk[ROUNDS]);
+}
+
+//Decrypt a single block with the round keys already in registers
+template <uint8_t ROUNDS>
+static AES_NI_TARGET inline __m128i DecryptOne(__m128i state, const __m128i* rk) {
+	state = _mm_xor_si128(state, rk[ROUNDS]);
+	#pragma GCC unroll 13
+	for (uint8_t i = ROUNDS - 1; i > 0; i--)
+		state = _mm_aesdec_si128(state, rk[i]);
+	return _mm_aesdeclast_si128(state, rk[0]);
+}
+
+//
+template <uint8_t ROUNDS>
+static AES_NI_TARGET void NiEncryptBlock(const AES_KEYSET* keyset, uint8_t* block) {
+	__m128i rk[AES_MAX_ROUNDS + 1];
+	LoadEncryptKeys<ROUNDS>(keyset, rk);
+	_mm_storeu_si128((__m128i*)block, EncryptOne<ROUNDS>(_mm_loadu_si128((const __m128i*)block), rk));
+}
+
+//
+template <uint8_t ROUNDS>
+static AES_NI_TARGET void NiDecryptBlock(const AES_KEYSET* keyset, uint8_t* block) {
+	__m128i rk[AES_MAX_ROUNDS + 1];
+	LoadDecryptKeys<ROUNDS>(keyset, rk);
+	_mm_storeu_si128((__m128i*)block, DecryptOne<ROUNDS>(_mm_loadu_si128((const __m128i*)block), rk));
+}
+
+//
+template <uint8_t ROUNDS>
+static AES_NI_TARGET void NiEncryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) {
+	__m128i rk[AES_MAX_ROUNDS + 1];
+	LoadEncryptKeys<ROUNDS>(keyset, rk);
+
+	__m128i b[AES_NI_INTERLEAVE];
+
+	//Every round is issued for all blocks before the next round starts
+	for (; count >= AES_NI_INTERLEAVE; count -= AES_NI_INTERLEAVE) {
+		#pragma GCC unroll 8
+		for (uint8_t j = 0; j < AES_NI_INTERLEAVE; j++)
+			b[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + j * 16)), rk[0]);
+
+		#pragma GCC unroll 13
+		for (uint8_t i = 1; i < ROUNDS; i++) {
+			#pragma GCC unroll 8
+			for (uint8_t j = 0; j < AES_NI_INTERLEAVE; j++)
+				b[j] = _mm_aesenc_si128(b[j], rk[i]);
+		}
+
+		#pragma GCC unroll 8
+		for (uint8_t j = 0; j < AES_NI_INTERLEAVE; j++)
+			_mm_storeu_si128((__m128i*)(dst + j * 16), _mm_aesenclast_si128(b[j], rk[ROUNDS]));
+
+		src += AES_NI_INTERLEAVE * 16;
+		dst += AES_NI_INTERLEAVE * 16;
+	}
+
+	for (; count; count--) {
+		_mm_storeu_si128((__m128i*)dst, EncryptOne<ROUNDS>(_mm_loadu_si128((const __m128i*)src), rk));
+		src += 16;
+		dst += 16;
+	}
+}
+
+//
+template <uint8_t ROUNDS>
+static AES_NI_TARGET void NiDecryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) {
+	__m128i rk[AES_MAX_ROUNDS + 1];
+	LoadDecryptKeys<ROUNDS>(keyset, rk);
+
+	__m128i b[AES_NI_INTERLEAVE];
+
+	for (; count >= AES_NI_INTERLEAVE; count -= AES_NI_INTERLEAVE) {
+		#pragma GCC unroll 8
+		for (uint8_t j = 0; j < AES_NI_INTERLEAVE; j++)
+			b[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + j * 16)), rk[ROUNDS]);
+
+		#pragma GCC unroll 13
+		for (uint8_t i = ROUNDS - 1; i > 0; i--) {
+			#pragma GCC unroll 8
+			for (uint8_t j = 0; j < AES_NI_INTERLEAVE; j++)
+				b[j] = _mm_aesdec_si128(b[j], rk[i]);
+		}
+
+		#pragma GCC unroll 8
+		for (uint8_t j = 0; j < AES_NI_INTERLEAVE; j++)
+			_mm_storeu_si128((__m128i*)(dst + j * 16), _mm_aesdeclast_si128(b[j], rk[0]));
+
+		src += AES_NI_INTERLEAVE * 16;
+		dst += AES_NI_INTERLEAVE * 16;
+	}
+
+	for (; count; count--) {
+		_mm_storeu_si128((__m128i*)dst, DecryptOne<ROUNDS>(_mm_loadu_si128((const __m128i*)src), rk));
+		src += 16;
+		dst += 16;
+	}
+}
+
+//Check for PCLMULQDQ once, the GHASH members fall back to the portable tables without it
+static bool HasClmul() {
+	static const bool clmul = (AES_KERNEL::GetCpuFeatures() & (AES_CPU_PCLMUL | AES_CPU_SSSE3)) == (AES_CPU_PCLMUL | AES_CPU_SSSE3);
+	return clmul;
+}
+
+//Reverse the byte order, so bit 0 of GHASH (the top bit of the first byte) becomes the top bit of the register
+static AES_NI_CLMUL_TARGET inline __m128i ByteReverse(__m128i x) {
+	return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+//Add the 256 bit carry-less product of a and b to the low, middle and high accumulators
+static AES_NI_CLMUL_TARGET inline void ClmulAccumulate(__m128i a, __m128i b, __m128i& low, __m128i& mid, __m128i& high) {
+	low = _mm_xor_si128(low, _mm_clmulepi64_si128(a, b, 0x00));
+	high = _mm_xor_si128(high, _mm_clmulepi64_si128(a, b, 0x11));
+	mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(a, b, 0x10));
+	mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(a, b, 0x01));
+}
+
+//Reduce an accumulated product modulo x^128 + x^7 + x^2 + x + 1. The bit reflected product is one bit short, so it is shifted left first.
+static AES_NI_CLMUL_TARGET inline __m128i GhashReduce(__m128i low, __m128i mid, __m128i high) {
+	low = _mm_xor_si128(low, _mm_slli_si128(mid, 8));
+	high = _mm_xor_si128(high, _mm_srli_si128(mid, 8));
+
+	//Shift [high:low] left by 1
+	__m128i carryLow = _mm_srli_epi32(low, 31);
+	__m128i carryHigh = _mm_srli_epi32(high, 31);
+	low = _mm_slli_epi32(low, 1);
+	high = _mm_slli_epi32(high, 1);
+	high = _mm_or_si128(high, _mm_srli_si128(carryLow, 12));
+	high = _mm_or_si128(high, _mm_slli_si128(carryHigh, 4));
+	low = _mm_or_si128(low, _mm_slli_si128(carryLow, 4));
+
+	//First phase of the reduction
+	__m128i t = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(low, 31), _mm_slli_epi32(low, 30)), _mm_slli_epi32(low, 25));
+	__m128i spill = _mm_srli_si128(t, 4);
+	low = _mm_xor_si128(low, _mm_slli_si128(t, 12));
+
+	//Second phase
+	t = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(low, 1), _mm_srli_epi32(low, 2)), _mm_srli_epi32(low, 7));
+	t = _mm_xor_si128(t, spill);
+	return _mm_xor_si128(high, _mm_xor_si128(low, t));
+}
+
+//Multiply two byte reversed GHASH values
+static AES_NI_CLMUL_TARGET inline __m128i GhashMultiply(__m128i a, __m128i b) {
+	__m128i low = _mm_setzero_si128(), mid = _mm_setzero_si128(), high = _mm_setzero_si128();
+	ClmulAccumulate(a, b, low, mid, high);
+	return GhashReduce(low, mid, high);
+}
+
+/*
+ * ************************************
+ * ************************************
+ *				AES_KERNEL_NI
+ * ************************************
+ * ************************************
+*/
+
+//
+const char* AES_KERNEL_NI::GetName() const {
+	return "aesni";
+}
+
+//
+bool AES_KERNEL_NI::IsSupported() const {
+	const uint32_t required = AES_CPU_SSE2 | AES_CPU_AESNI;
+	return (GetCpuFeatures() & required) == required;
+}
+
+//
+AES_NI_TARGET void AES_KERNEL_NI::EncryptBlock(const AES_KEYSET* keyset, uint8_t* block) const {
+	AES_ROUNDS_DISPATCH(keyset, NiEncryptBlock, keyset, block);
+}
+
+//
+AES_NI_TARGET void AES_KERNEL_NI::DecryptBlock(const AES_KEYSET* keyset, uint8_t* block) const {
+	AES_ROUNDS_DISPATCH(keyset, NiDecryptBlock, keyset, block);
+}
+
+//
+AES_NI_TARGET void AES_KERNEL_NI::EncryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const {
+	AES_ROUNDS_DISPATCH(keyset, NiEncryptBlocks, keyset, src, dst, count);
+}
+
+//
+AES_NI_TARGET void AES_KERNEL_NI::DecryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const {
+	AES_ROUNDS_DISPATCH(keyset, NiDecryptBlocks, keyset, src, dst, count);
+}
+
+//
+AES_NI_CLMUL_TARGET void AES_KERNEL_NI::GhashInit(const uint8_t* h, AES_GHASH_KEY* key) const {
+	if (!HasClmul()) {
+		AES_KERNEL::GhashInit(h, key);
+		return;
+	}
+
+	//Entry i holds H^(i + 1)
+	__m128i hash = ByteReverse(_mm_loadu_si128((const __m128i*)h));
+	__m128i power = hash;
+	for (uint8_t i = 0; i < AES_NI_GHASH_AGGREGATE; i++) {
+		_mm_store_si128((__m128i*)key->table[i], power);
+		power = GhashMultiply(power, hash);
+	}
+}
+
+//
+AES_NI_CLMUL_TARGET void AES_KERNEL_NI::GhashBlocks(const AES_GHASH_KEY* key, uint8_t* hash, const uint8_t* src, size_t count) const {
+	if (!HasClmul()) {
+		AES_KERNEL::GhashBlocks(key, hash, src, count);
+		return;
+	}
+
+	__m128i powers[AES_NI_GHASH_AGGREGATE];
+	for (uint8_t i = 0; i < AES_NI_GHASH_AGGREGATE; i++)
+		powers[i] = _mm_load_si128((const __m128i*)key->table[i]);
+
+	__m128i x = ByteReverse(_mm_loadu_si128((const __m128i*)hash));
+	size_t i = 0;
+
+	//(x ^ b0) * H^4 ^ b1 * H^3 ^ b2 * H^2 ^ b3 * H, with a single reduction
+	for (; i + AES_NI_GHASH_AGGREGATE <= count; i += AES_NI_GHASH_AGGREGATE) {
+		__m128i low = _mm_setzero_si128(), mid = _mm_setzero_si128(), high = _mm_setzero_si128();
+		x = _mm_xor_si128(x, ByteReverse(_mm_loadu_si128((const __m128i*)(src + i * 16))));
+		ClmulAccumulate(x, powers[AES_NI_GHASH_AGGREGATE - 1], low, mid, high);
+		for (uint8_t j = 1; j < AES_NI_GHASH_AGGREGATE; j++)
+			ClmulAccumulate(ByteReverse(_mm_loadu_si128((const __m128i*)(src + (i + j) * 16))), powers[AES_NI_GHASH_AGGREGATE - 1 - j], low, mid, high);
+		x = GhashReduce(low, mid, high);
+	}
+
+	for (; i < count; i++)
+		x = GhashMultiply(_mm_xor_si128(x, ByteReverse(_mm_loadu_si128((const __m128i*)(src + i * 16)))), powers[0]);
+
+	_mm_storeu_si128((__m128i*)hash, ByteReverse(x));
+}
+
+#endif
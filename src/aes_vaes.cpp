@@ -0,0 +1,180 @@
+///
+///     Code by:    Peter Mikulas
+///                 2023
+///
+
+#include <fstream>
+
+#include "aes.h"
+
+#ifdef AES_KERNEL_X86
+
+#include <immintrin.h>
+
+/*
+ *	Note:	Like the AES-NI backend, these functions are compiled for their own target
+ *			and only reached when CPUID reports VAES and an OS-enabled AVX-512 state.
+*/
+
+#define AES_VAES_TARGET __attribute__((target("aes,vaes,avx512f")))
+
+//ZMM registers processed side by side, 4 blocks each
+#define AES_VAES_INTERLEAVE 4
+
+//Copy a round key into all 4 lanes of a ZMM register
+static AES_VAES_TARGET inline __m512i BroadcastKey(__m128i key) {
+	return _mm512_maskz_broadcast_i32x4(0xFFFF, key);
+}
+
+//Broadcast the encryption round keys to all 4 lanes
+template <uint8_t ROUNDS>
+static AES_VAES_TARGET inline void LoadEncryptKeys(const AES_KEYSET* keyset, __m512i* rk) {
+	for (uint8_t i = 0; i <= ROUNDS; i++)
+		rk[i] = BroadcastKey(_mm_loadu_si128((const __m128i*)keyset->GetRoundKey(i)));
+}
+
+//Broadcast the decryption schedule to all 4 lanes
+template <uint8_t ROUNDS>
+static AES_VAES_TARGET inline void LoadDecryptKeys(const AES_KEYSET* keyset, __m512i* rk) {
+	for (uint8_t i = 0; i <= ROUNDS; i++)
+		rk[i] = BroadcastKey(_mm_loadu_si128((const __m128i*)keyset->GetDecryptRoundKey(i)));
+}
+
+//
+template <uint8_t ROUNDS>
+static AES_VAES_TARGET void VaesEncryptBlocks(const AES_KERNEL_NI* kernel, const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) {
+	__m512i rk[AES_MAX_ROUNDS + 1];
+	LoadEncryptKeys<ROUNDS>(keyset, rk);
+
+	__m512i b[AES_VAES_INTERLEAVE];
+
+	//16 blocks per round
+	for (; count >= AES_VAES_INTERLEAVE * 4; count -= AES_VAES_INTERLEAVE * 4) {
+		#pragma GCC unroll 4
+		for (uint8_t j = 0; j < AES_VAES_INTERLEAVE; j++)
+			b[j] = _mm512_xor_si512(_mm512_loadu_si512(src + j * 64), rk[0]);
+
+		#pragma GCC unroll 13
+		for (uint8_t i = 1; i < ROUNDS; i++) {
+			#pragma GCC unroll 4
+			for (uint8_t j = 0; j < AES_VAES_INTERLEAVE; j++)
+				b[j] = _mm512_aesenc_epi128(b[j], rk[i]);
+		}
+
+		#pragma GCC unroll 4
+		for (uint8_t j = 0; j < AES_VAES_INTERLEAVE; j++)
+			_mm512_storeu_si512(dst + j * 64, _mm512_aesenclast_epi128(b[j], rk[ROUNDS]));
+
+		src += AES_VAES_INTERLEAVE * 64;
+		dst += AES_VAES_INTERLEAVE * 64;
+	}
+
+	//The remaining 4 - 12 blocks side by side
+	size_t groups = count / 4;
+	if (groups) {
+		for (uint8_t j = 0; j < groups; j++)
+			b[j] = _mm512_xor_si512(_mm512_loadu_si512(src + j * 64), rk[0]);
+
+		#pragma GCC unroll 13
+		for (uint8_t i = 1; i < ROUNDS; i++) {
+			for (uint8_t j = 0; j < groups; j++)
+				b[j] = _mm512_aesenc_epi128(b[j], rk[i]);
+		}
+
+		for (uint8_t j = 0; j < groups; j++)
+			_mm512_storeu_si512(dst + j * 64, _mm512_aesenclast_epi128(b[j], rk[ROUNDS]));
+
+		src += groups * 64;
+		dst += groups * 64;
+		count -= groups * 4;
+	}
+
+	//Less than 4 blocks left
+	if (count)
+		kernel->AES_KERNEL_NI::EncryptBlocks(keyset, src, dst, count);
+}
+
+//
+template <uint8_t ROUNDS>
+static AES_VAES_TARGET void VaesDecryptBlocks(const AES_KERNEL_NI* kernel, const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) {
+	__m512i rk[AES_MAX_ROUNDS + 1];
+	LoadDecryptKeys<ROUNDS>(keyset, rk);
+
+	__m512i b[AES_VAES_INTERLEAVE];
+
+	//16 blocks per round
+	for (; count >= AES_VAES_INTERLEAVE * 4; count -= AES_VAES_INTERLEAVE * 4) {
+		#pragma GCC unroll 4
+		for (uint8_t j = 0; j < AES_VAES_INTERLEAVE; j++)
+			b[j] = _mm512_xor_si512(_mm512_loadu_si512(src + j * 64), rk[ROUNDS]);
+
+		#pragma GCC unroll 13
+		for (uint8_t i = ROUNDS - 1; i > 0; i--) {
+			#pragma GCC unroll 4
+			for (uint8_t j = 0; j < AES_VAES_INTERLEAVE; j++)
+				b[j] = _mm512_aesdec_epi128(b[j], rk[i]);
+		}
+
+		#pragma GCC unroll 4
+		for (uint8_t j = 0; j < AES_VAES_INTERLEAVE; j++)
+			_mm512_storeu_si512(dst + j * 64, _mm512_aesdeclast_epi128(b[j], rk[0]));
+
+		src += AES_VAES_INTERLEAVE * 64;
+		dst += AES_VAES_INTERLEAVE * 64;
+	}
+
+	//The remaining 4 - 12 blocks side by side
+	size_t groups = count / 4;
+	if (groups) {
+		for (uint8_t j = 0; j < groups; j++)
+			b[j] = _mm512_xor_si512(_mm512_loadu_si512(src + j * 64), rk[ROUNDS]);
+
+		#pragma GCC unroll 13
+		for (uint8_t i = ROUNDS - 1; i > 0; i--) {
+			for (uint8_t j = 0; j < groups; j++)
+				b[j] = _mm512_aesdec_epi128(b[j], rk[i]);
+		}
+
+		for (uint8_t j = 0; j < groups; j++)
+			_mm512_storeu_si512(dst + j * 64, _mm512_aesdeclast_epi128(b[j], rk[0]));
+
+		src += groups * 64;
+		dst += groups * 64;
+		count -= groups * 4;
+	}
+
+	//Less than 4 blocks left
+	if (count)
+		kernel->AES_KERNEL_NI::DecryptBlocks(keyset, src, dst, count);
+}
+
+/*
+ * ************************************
+ * ************************************
+ *				AES_KERNEL_VAES
+ * ************************************
+ * ************************************
+*/
+
+//
+const char* AES_KERNEL_VAES::GetName() const {
+	return "vaes";
+}
+
+//
+bool AES_KERNEL_VAES::IsSupported() const {
+	const uint32_t required = AES_CPU_SSE2 | AES_CPU_AESNI | AES_CPU_AVX512F | AES_CPU_VAES;
+	return (GetCpuFeatures() & required) == required;
+}
+
+//
+AES_VAES_TARGET void AES_KERNEL_VAES::EncryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const {
+	AES_ROUNDS_DISPATCH(keyset, VaesEncryptBlocks, this, keyset, src, dst, count);
+}
+
+//
+AES_VAES_TARGET void AES_KERNEL_VAES::DecryptBlocks(const AES_KEYSET* keyset, const uint8_t* src, uint8_t* dst, size_t count) const {
+	AES_ROUNDS_DISPATCH(keyset, VaesDecryptBlocks, this, keyset, src, dst, count);
+}
+
+#endif
@@ -0,0 +1,255 @@
+///
+///     Code by:    Peter Mikulas
+///                 2023
+///
+
+#include <fstream>
+
+#include "aes.h"
+
+#ifdef AES_KERNEL_X86
+
+#include <tmmintrin.h>
+
+/*
+ *	Note:	Vector permute kernel
+ *
+ *			The S-box is computed with 16-entry PSHUFB lookups on nibbles, so a whole
+ *			round is a handful of register operations and no lookup ever touches
+ *			memory with a data-dependent address.
+ *
+ *			The state is kept in GF(16)[s] / (s^2 + 2s + 2), X = k + i*s, where i is
+ *			the high and k the low nibble of a byte. With j = i ^ k the inverse of X
+ *			is a linear combination of 1/io and 1/jo, where
+ *
+ *				io = 1 / (1/i + 2/k) + j
+ *				jo = 1 / (1/j + 2/k) + i
+ *
+ *			The output tables take io and jo straight to the S-box result times the
+ *			MixColumns coefficients, already in the basis the next round expects, so
+ *			the basis change only happens on the way in and out of the cipher. The
+ *			round keys are converted once per key and kept in the keyset. Division by zero yields 0x80 and
+ *			PSHUFB returns 0 for indices with the top bit set, which handles the zero
+ *			cases without branches.
+*/
+
+#define AES_VPERM_TARGET __attribute__((target("ssse3")))
+
+#define AES_VPERM_TABLE(name) static const uint8_t name[16] __attribute__((aligned(16)))
+
+//1/x in GF(16) (x^4 + x + 1) and 2/x, 1/0 is marked with 0x80
+AES_VPERM_TABLE(vpInv)       = { 0x80, 0x01, 0x09, 0x0E, 0x0D, 0x0B, 0x07, 0x06, 0x0F, 0x02, 0x0C, 0x05, 0x0A, 0x04, 0x03, 0x08 };
+AES_VPERM_TABLE(vpInvA)      = { 0x80, 0x02, 0x01, 0x0F, 0x09, 0x05, 0x0E, 0x0C, 0x0D, 0x04, 0x0B, 0x0A, 0x07, 0x08, 0x06, 0x03 };
+
+//AES basis to tower basis, low and high nibble
+AES_VPERM_TABLE(vpEncInLo)   = { 0x00, 0x01, 0x1C, 0x1D, 0x2D, 0x2C, 0x31, 0x30, 0x27, 0x26, 0x3B, 0x3A, 0x0A, 0x0B, 0x16, 0x17 };
+AES_VPERM_TABLE(vpEncInHi)   = { 0x00, 0x86, 0xFD, 0x7B, 0x8E, 0x08, 0x73, 0xF5, 0x77, 0xF1, 0x8A, 0x0C, 0xF9, 0x7F, 0x04, 0x82 };
+
+//1 and 2 times the S-box in the tower basis, without the 0x63 constant
+AES_VPERM_TABLE(vpEncMid1U)  = { 0x00, 0xC3, 0x4F, 0x0C, 0xFC, 0x7C, 0x43, 0x80, 0xCF, 0x33, 0x3F, 0x70, 0xBF, 0xB3, 0xF0, 0x8C };
+AES_VPERM_TABLE(vpEncMid1T)  = { 0x00, 0xE6, 0x72, 0xB7, 0xE5, 0xC6, 0xC5, 0x23, 0x51, 0xB4, 0x03, 0x71, 0x20, 0x97, 0x52, 0x94 };
+AES_VPERM_TABLE(vpEncMid2U)  = { 0x00, 0x7C, 0x20, 0xCF, 0x92, 0x01, 0xEF, 0x93, 0xB3, 0x21, 0xEE, 0xCE, 0x7D, 0xB2, 0x5D, 0x5C };
+AES_VPERM_TABLE(vpEncMid2T)  = { 0x00, 0xD1, 0xE5, 0xF7, 0xE6, 0x25, 0x12, 0xC3, 0x26, 0xC0, 0x37, 0xD2, 0xF4, 0x03, 0x11, 0x34 };
+
+//S-box in the AES basis for the last round, without the 0x63 constant
+AES_VPERM_TABLE(vpEncOutU)   = { 0x00, 0xCB, 0xD7, 0xB0, 0x21, 0x8D, 0x67, 0xAC, 0x7B, 0x5A, 0xEA, 0x3D, 0x46, 0xF6, 0x91, 0x1C };
+AES_VPERM_TABLE(vpEncOutT)   = { 0x00, 0x9F, 0x61, 0x16, 0xC2, 0x2A, 0x77, 0xE8, 0x89, 0x4B, 0x5D, 0x3C, 0xB5, 0xA3, 0xD4, 0xFE };
+
+//Inverse affine transform followed by the change to the tower basis (the decryption state basis)
+AES_VPERM_TABLE(vpDecInLo)   = { 0x2C, 0x99, 0xF0, 0x45, 0xF7, 0x42, 0x2B, 0x9E, 0x38, 0x8D, 0xE4, 0x51, 0xE3, 0x56, 0x3F, 0x8A };
+AES_VPERM_TABLE(vpDecInHi)   = { 0x00, 0xA7, 0xA8, 0x0F, 0xED, 0x4A, 0x45, 0xE2, 0xD1, 0x76, 0x79, 0xDE, 0x3C, 0x9B, 0x94, 0x33 };
+
+//14, 11, 13 and 9 times the inverse S-box in the decryption state basis
+AES_VPERM_TABLE(vpDecMid14U) = { 0x00, 0xEB, 0xA6, 0xB9, 0x7B, 0x8F, 0x1F, 0xF4, 0x52, 0x29, 0x90, 0x36, 0x64, 0xDD, 0xC2, 0x4D };
+AES_VPERM_TABLE(vpDecMid14T) = { 0x00, 0xFD, 0xDF, 0x65, 0x9D, 0xDA, 0xBA, 0x47, 0x98, 0x05, 0x60, 0xBF, 0x27, 0x42, 0xF8, 0x22 };
+AES_VPERM_TABLE(vpDecMid11U) = { 0x00, 0xC2, 0x4D, 0xEB, 0xDD, 0xB9, 0xA6, 0x64, 0x29, 0xF4, 0x1F, 0x52, 0x7B, 0x90, 0x36, 0x8F };
+AES_VPERM_TABLE(vpDecMid11T) = { 0x00, 0xF8, 0x22, 0xFD, 0x42, 0x65, 0xDF, 0x27, 0x05, 0x47, 0xBA, 0x98, 0x9D, 0x60, 0xBF, 0xDA };
+AES_VPERM_TABLE(vpDecMid13U) = { 0x00, 0x7C, 0x1B, 0x3D, 0x15, 0x4F, 0x26, 0x5A, 0x41, 0x54, 0x69, 0x72, 0x33, 0x0E, 0x28, 0x67 };
+AES_VPERM_TABLE(vpDecMid13T) = { 0x00, 0x77, 0xB2, 0xB0, 0xB6, 0xC3, 0x02, 0x75, 0xC7, 0x71, 0xC1, 0x73, 0xB4, 0x04, 0x06, 0xC5 };
+AES_VPERM_TABLE(vpDecMid9U)  = { 0x00, 0x27, 0xBF, 0x47, 0xDA, 0x05, 0xF8, 0xDF, 0x60, 0xBA, 0xFD, 0x42, 0x22, 0x65, 0x9D, 0x98 };
+AES_VPERM_TABLE(vpDecMid9T)  = { 0x00, 0x01, 0x8C, 0x2E, 0xA8, 0x0B, 0xA2, 0xA3, 0x2F, 0x87, 0xA9, 0x25, 0x0A, 0x24, 0x86, 0x8D };
+
+//Inverse S-box in the AES basis for the last round
+AES_VPERM_TABLE(vpDecOutU)   = { 0x00, 0x3B, 0xE4, 0xC8, 0x03, 0x14, 0x2C, 0x17, 0xF3, 0xF0, 0x38, 0xDC, 0x2F, 0xE7, 0xCB, 0xDF };
+AES_VPERM_TABLE(vpDecOutT)   = { 0x00, 0x24, 0x91, 0x19, 0x23, 0x8F, 0x88, 0xAC, 0x3D, 0x1E, 0x07, 0x96, 0xAB, 0xB2, 0x3A, 0xB5 };
+
+//Byte shuffles, state byte c * 4 + r is row r of column c. vpEncMixN is ShiftRows followed by moving
+//row r + N into row r, vpDecMixN is the same with InvShiftRows.
+AES_VPERM_TABLE(vpEncMix0)   = { 0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12, 1, 6, 11 };
+AES_VPERM_TABLE(vpEncMix1)   = { 5, 10, 15, 0, 9, 14, 3, 4, 13, 2, 7, 8, 1, 6, 11, 12 };
+AES_VPERM_TABLE(vpEncMix2)   = { 10, 15, 0, 5, 14, 3, 4, 9, 2, 7, 8, 13, 6, 11, 12, 1 };
+AES_VPERM_TABLE(vpEncMix3)   = { 15, 0, 5, 10, 3, 4, 9, 14, 7, 8, 13, 2, 11, 12, 1, 6 };
+AES_VPERM_TABLE(vpDecMix0)   = { 0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3 };
+AES_VPERM_TABLE(vpDecMix1)   = { 13, 10, 7, 0, 1, 14, 11, 4, 5, 2, 15, 8, 9, 6, 3, 12 };
+AES_VPERM_TABLE(vpDecMix2)   = { 10, 7, 0, 13, 14, 11, 4, 1, 2, 15, 8, 5, 6, 3, 12, 9 };
+AES_VPERM_TABLE(vpDecMix3)   = { 7, 0, 13, 10, 11, 4, 1, 14, 15, 8, 5, 2, 3, 12, 9, 6 };
+
+/*
+ * ************************************
+ * ************************************
+ *		Vector permute primitives
+ * ************************************
+ * ************************************
+*/
+
+//
+static AES_VPERM_TARGET inline __m128i Load(const uint8_t* table) {
+	return _mm_load_si128((const __m128i*)table);
+}
+
+//
+static AES_VPERM_TARGET inline __m128i Lookup(const uint8_t* table, __m128i index) {
+	return _mm_shuffle_epi8(Load(table), index);
+}
+
+//
+static AES_VPERM_TARGET inline __m128i Shuffle(__m128i x, const uint8_t* order) {
+	return _mm_shuffle_epi8(x, Load(order));
+}
+
+//Apply a nibble-indexed linear map to every byte
+static AES_VPERM_TARGET inline __m128i Transform(__m128i x, const uint8_t* lo, const uint8_t* hi) {
+	const __m128i mask = _mm_set1_epi8(0x0F);
+	return _mm_xor_si128(Lookup(lo, _mm_and_si128(x, mask)), Lookup(hi, _mm_and_si128(_mm_srli_epi32(x, 4), mask)));
+}
+
+//Tower field inversion core
+static AES_VPERM_TARGET inline void Invert(__m128i x, __m128i& io, __m128i& jo) {
+	const __m128i mask = _mm_set1_epi8(0x0F);
+
+	__m128i i = _mm_and_si128(_mm_srli_epi32(x, 4), mask);
+	__m128i k = _mm_and_si128(x, mask);
+	__m128i j = _mm_xor_si128(i, k);
+	__m128i ak = Lookup(vpInvA, k);
+	__m128i iak = _mm_xor_si128(Lookup(vpInv, i), ak);
+	__m128i jak = _mm_xor_si128(Lookup(vpInv, j), ak);
+	io = _mm_xor_si128(Lookup(vpInv, iak), j);
+	jo = _mm_xor_si128(Lookup(vpInv, jak), i);
+}
+
+//Round keys for EncryptState, the middle ones in the tower basis with the S-box constant folded in
+static AES_VPERM_TARGET void ConvertEncryptKeys(const AES_KEYSET* keyset, __m128i* rk) {
+	const uint8_t rounds = keyset->GetRounds();
+	const __m128i constant = _mm_set1_epi8(0x63);
+	rk[0] = _mm_loadu_si128((const __m128i*)keyset->GetRoundKey(0));
+	for (uint8_t i = 1; i < rounds; i++)
+		rk[i] = Transform(_mm_xor_si128(_mm_loadu_si128((const __m128i*)keyset->GetRoundKey(i)), constant), vpEncInLo, vpEncInHi);
+	rk[rounds] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)keyset->GetRoundKey(rounds)), constant);
+}
+
+//Round keys for DecryptState, the middle ones from the decryption schedule in the decryption state basis
+static AES_VPERM_TARGET void ConvertDecryptKeys(const AES_KEYSET* keyset, __m128i* rk) {
+	const uint8_t rounds = keyset->GetRounds();
+	rk[0] = _mm_loadu_si128((const __m128i*)keyset->GetDecryptRoundKey(0));
+	for (uint8_t i = 1; i < rounds; i++)
+		rk[i] = Transform(_mm_loadu_si128((const __m128i*)keyset->GetDecryptRoundKey(i)), vpDecInLo, vpDecInHi);
+	rk[rounds] = _mm_loadu_si128((const __m128i*)keyset->GetDecryptRoundKey(rounds));
+}
+
+//
+template <uint8_t ROUNDS>
+static AES_VPERM_TARGET inline __m128i EncryptState(const __m128i* rk, __m128i state) {
+	__m128i io, jo;
+
+	state = Transform(_mm_xor_si128(state, rk[0]), vpEncInLo, vpEncInHi);
+
+	#pragma GCC unroll 13
+	for (uint8_t i = 1; i < ROUNDS; i++) {
+		Invert(state, io, jo);
+
+		__m128i s1 = _mm_xor_si128(Lookup(vpEncMid1U, io), Lookup(vpEncMid1T, jo));
+		__m128i s2 = _mm_xor_si128(Lookup(vpEncMid2U, io), Lookup(vpEncMid2T, jo));
+		__m128i s3 = _mm_xor_si128(s1, s2);
+
+		//ShiftRows and MixColumns: 2 * a_r ^ 3 * a_r+1 ^ a_r+2 ^ a_r+3
+		state = _mm_xor_si128(
+			_mm_xor_si128(Shuffle(s2, vpEncMix0), Shuffle(s3, vpEncMix1)),
+			_mm_xor_si128(_mm_xor_si128(Shuffle(s1, vpEncMix2), Shuffle(s1, vpEncMix3)), rk[i]));
+	}
+
+	Invert(state, io, jo);
+	state = _mm_xor_si128(Lookup(vpEncOutU, io), Lookup(vpEncOutT, jo));
+	return _mm_xor_si128(Shuffle(state, vpEncMix0), rk[ROUNDS]);
+}
+
+//Equivalent inverse cipher: InvSubBytes, InvShiftRows, InvMixColumns, AddRoundKey
+template <uint8_t ROUNDS>
+static AES_VPERM_TARGET inline __m128i DecryptState(const __m128i* rk, __m128i state) {
+	__m128i io, jo;
+
+	state = Transform(_mm_xor_si128(state, rk[ROUNDS]), vpDecInLo, vpDecInHi);
+
+	#pragma GCC unroll 13
+	for (uint8_t i = ROUNDS - 1; i > 0; i--) {
+		Invert(state, io, jo);
+
+		__m128i s14 = _mm_xor_si128(Lookup(vpDecMid14U, io), Lookup(vpDecMid14T, jo));
+		__m128i s11 = _mm_xor_si128(Lookup(vpDecMid11U, io), Lookup(vpDecMid11T, jo));
+		__m128i s13 = _mm_xor_si128(Lookup(vpDecMid13U, io), Lookup(vpDecMid13T, jo));
+		__m128i s9 = _mm_xor_si128(Lookup(vpDecMid9U, io), Lookup(vpDecMid9T, jo));
+
+		//InvShiftRows and InvMixColumns: 14 * a_r ^ 11 * a_r+1 ^ 13 * a_r+2 ^ 9 * a_r+3
+		state = _mm_xor_si128(
+			_mm_xor_si128(Shuffle(s14, vpDecMix0), Shuffle(s11, vpDecMix1)),
+			_mm_xor_si128(_mm_xor_si128(Shuffle(s13, vpDecMix2), Shuffle(s9, vpDecMix3)), rk[i]));
+	}
+
+	Invert(state, io, jo);
+	state = _mm_xor_si128(Lookup(vpDecOutU, io), Lookup(vpDecOutT, jo));
+	return _mm_xor_si128(Shuffle(state, vpDecMix0), rk[0]);
+}
+
+//
+template <uint8_t ROUNDS>
+static AES_VPERM_TARGET void VpermEncryptBlock(const AES_KEYSET* keyset, uint8_t* block) {
+	const __m128i* rk = (const __m128i*)keyset->GetVpermRoundKeys(false);
+	_mm_storeu_si128((__m128i*)block, EncryptState<ROUNDS>(rk, _mm_loadu_si128((const __m128i*)block)));
+}
+
+//
+template <uint8_t ROUNDS>
+static AES_VPERM_TARGET void VpermDecryptBlock(const AES_KEYSET* keyset, uint8_t* block) {
+	const __m128i* rk = (const __m128i*)keyset->GetVpermRoundKeys(true);
+	_mm_storeu_si128((__m128i*)block, DecryptState<ROUNDS>(rk, _mm_loadu_si128((const __m128i*)block)));
+}
+
+/*
+ * ************************************
+ * ************************************
+ *			AES_KERNEL_VPERM
+ * ************************************
+ * ************************************
+*/
+
+//
+const char* AES_KERNEL_VPERM::GetName() const {
+	return "vperm";
+}
+
+//
+bool AES_KERNEL_VPERM::IsSupported() const {
+	const uint32_t required = AES_CPU_SSE2 | AES_CPU_SSSE3;
+	return (GetCpuFeatures() & required) == required;
+}
+
+//
+AES_VPERM_TARGET void AES_KERNEL_VPERM::EncryptBlock(const AES_KEYSET* keyset, uint8_t* block) const {
+	AES_ROUNDS_DISPATCH(keyset, VpermEncryptBlock, keyset, block);
+}
+
+//
+AES_VPERM_TARGET void AES_KERNEL_VPERM::DecryptBlock(const AES_KEYSET* keyset, uint8_t* block) const {
+	AES_ROUNDS_DISPATCH(keyset, VpermDecryptBlock, keyset, block);
+}
+
+//
+void AES_KERNEL_VPERM::ConvertKeys(const AES_KEYSET* keyset, uint32_t (*encKeys)[4], uint32_t (*decKeys)[4]) {
+	const uint32_t required = AES_CPU_SSE2 | AES_CPU_SSSE3;
+	if ((GetCpuFeatures() & required) != required)
+		return;
+
+	ConvertEncryptKeys(keyset, (__m128i*)encKeys);
+	ConvertDecryptKeys(keyset, (__m128i*)decKeys);
+}
+
+#endif
@@ -11,7 +11,7 @@
 enum AES_OP { AES_ENCRYPT = 0, AES_DECRYPT = 1 };
 
 //  AES method
-enum AES_METHOD { AES_M_ECB, AES_M_CBC, AES_M_CFB, AES_M_OFB };
+enum AES_METHOD { AES_M_ECB, AES_M_CBC, AES_M_CFB, AES_M_OFB, AES_M_CTR, AES_M_GCM, AES_M_XTS };
 
 //  AES source type
 enum AES_SRC { AES_S_FILE = 0, AES_S_TEXT = 1 };
@@ -22,12 +22,17 @@ enum AES_SRC { AES_S_FILE = 0, AES_S_TEXT = 1 };
 struct RuntimeConfig {
     AES_OP mode = AES_ENCRYPT;
     AES_METHOD method = AES_M_CBC;
+    AES_KEYSIZE keySize = AES_KEY_128;
     AES_SRC sourceType = AES_S_FILE;
     char* source = nullptr;
     char* dst = nullptr;
     uint8_t* key = nullptr;
     uint8_t* iv = nullptr;
+    unsigned threads = 0;           //Worker threads, 0 uses every hardware thread
+    size_t segment = 0;             //CBC segment size in bytes, 0 for plain CBC
+    AES_FILE_IO fileIO = AES_IO_STREAM;     //File I/O backend
     bool writeToScreen = false;     //for JPorta
+    bool verbose = false;           //Print diagnostics, e.g. the selected cipher backend
 };
 
 /**
@@ -69,11 +74,23 @@ void PrintHelp(void) {
     std::cout << " -t\t\t\tEncrypt text from console" << std::endl;
     std::cout << " -f\t\t\tEncrypt file" << std::endl;
     std::cout << " -o\t\t\tOutput filename" << std::endl;
+    std::cout << " -j N\t\t\tWorker threads for the parallel modes (default: every hardware thread)" << std::endl;
+    std::cout << " -c N\t\t\tEncrypt CBC in independent N KiB segments on every worker thread, decrypting reads them from the file" << std::endl;
+    std::cout << " -v\t\t\tPrint diagnostics (selected cipher backend)" << std::endl;
     std::cout << " -h, --help\t\tPrint help menu" << std::endl;
     std::cout << " --ecb\t\t\tSet AES mode to ECB" << std::endl;
     std::cout << " --cbc\t\t\tSet AES mode to CBC (default)" << std::endl;
     std::cout << " --cfb\t\t\tSet AES mode to CFB" << std::endl;
     std::cout << " --ofb\t\t\tSet AES mode to OFB" << std::endl;
+    std::cout << " --ctr\t\t\tSet AES mode to CTR (multi-threaded)" << std::endl;
+    std::cout << " --gcm\t\t\tSet AES mode to GCM (authenticated)" << std::endl;
+    std::cout << " --xts\t\t\tSet AES mode to XTS (disk images, 4 KiB sectors), the key holds two keys of the key size" << std::endl;
+    std::cout << " --mmap\t\t\tRead and write files through memory mappings" << std::endl;
+    std::cout << " --uring\t\tRead and write files asynchronously with io_uring (Linux), falls back to normal file I/O" << std::endl;
+    std::cout << " --direct\t\tRead and write files with O_DIRECT, past the page cache" << std::endl;
+    std::cout << " --aes128\t\tUse a 128 bit key, up to 16 key characters (default)" << std::endl;
+    std::cout << " --aes192\t\tUse a 192 bit key, up to 24 key characters" << std::endl;
+    std::cout << " --aes256\t\tUse a 256 bit key, up to 32 key characters" << std::endl;
 }
 
 /**
@@ -101,19 +118,37 @@ void ExecAES(RuntimeConfig* config) {
         switch (config->method)
         {
         case AES_M_ECB:
-            aes = new AES_ECB(config->key);
+            aes = new AES_ECB(config->key, config->keySize);
             break;
 
         case AES_M_CBC:
-            aes = new AES_CBC(config->key);
+            aes = new AES_CBC(config->key, nullptr, config->keySize);
             break;
 
         case AES_M_CFB:
-            aes = new AES_CFB(config->key);
+            aes = new AES_CFB(config->key, nullptr, config->keySize);
             break;
 
         case AES_M_OFB:
-            aes = new AES_OFB(config->key);
+            aes = new AES_OFB(config->key, nullptr, config->keySize);
+            break;
+
+        case AES_M_CTR:
+            aes = new AES_CTR(config->key, nullptr, config->keySize);
+            break;
+
+        case AES_M_GCM:
+            aes = new AES_GCM(config->key, nullptr, config->keySize);
+            break;
+
+        case AES_M_XTS:
+            //The tweak key follows the data key, a shorter key would leave it (partly) zero
+            if (!config->key || strlen((const char*)config->key) < 2 * (size_t)config->keySize)
+                throw("XTS needs a key of twice the key size, the data key followed by the tweak key!");
+
+            aes = new AES_XTS(config->key, config->keySize);
+            if (!static_cast<AES_XTS*>(aes)->HasDistinctKeys())
+                throw("XTS needs a different data and tweak key, give a longer key!");
             break;
         
         default:
@@ -121,6 +156,22 @@ void ExecAES(RuntimeConfig* config) {
             throw("Unknown AES method was selected!");
         }
 
+        aes->SetThreadCount(config->threads);
+
+        if (!aes->SetFileIO(config->fileIO))
+            throw("The selected file I/O is not supported on this platform!");
+
+        //Segmented CBC, decrypting takes the size from the header of the encrypted file
+        if (config->segment) {
+            if (config->method != AES_M_CBC)
+                throw("Segments are only supported in CBC mode!");
+            if (!static_cast<AES_CBC*>(aes)->SetSegmentSize(config->segment))
+                throw("Invalid segment size!");
+        }
+
+        if (config->verbose)
+            std::cerr << "Cipher backend: " << aes->GetKernelName() << std::endl;
+
         //Decrypt
         if (config->mode) {
             
@@ -270,7 +321,7 @@ void ArgCLI(int argc, char** argv) {
                     
                     //If not set read and store the key
                     config.key = new uint8_t[strlen(argv[argCntr + 1]) + 1];
-                    memcpy(config.key, argv[argCntr + 1], strlen(argv[argCntr + 1]));
+                    memcpy(config.key, argv[argCntr + 1], strlen(argv[argCntr + 1]) + 1);
                     argCntr += 2;
                     break;
 
@@ -320,6 +371,42 @@ void ArgCLI(int argc, char** argv) {
                     config.writeToScreen = true;
                     argCntr++;
                     break;
+
+                case 'v':
+                    config.verbose = true;
+                    argCntr++;
+                    break;
+
+                //Worker thread count
+                case 'j': {
+                    //Stop if no count was given
+                    if (argc <= argCntr + 1)
+                        throw("No thread count was given!");
+
+                    char* end = nullptr;
+                    unsigned long threads = strtoul(argv[argCntr + 1], &end, 10);
+                    if (!*argv[argCntr + 1] || *end || threads > 1024)
+                        throw("Invalid thread count!");
+
+                    config.threads = (unsigned)threads;
+                    argCntr += 2;
+                    break;
+                }
+
+                case 'c': {
+                    //Stop if no size was given
+                    if (argc <= argCntr + 1)
+                        throw("No segment size was given!");
+
+                    char* end = nullptr;
+                    unsigned long segment = strtoul(argv[argCntr + 1], &end, 10);
+                    if (!*argv[argCntr + 1] || *end || !segment || segment > 0xFFFFFFF0 / 1024)
+                        throw("Invalid segment size!");
+
+                    config.segment = (size_t)segment * 1024;
+                    argCntr += 2;
+                    break;
+                }
                 
                 case '-':
 
@@ -331,6 +418,24 @@ void ArgCLI(int argc, char** argv) {
                         config.method = AES_M_CFB;
                     else if (!strcmp(argv[argCntr], "--ofb"))
                         config.method = AES_M_OFB;
+                    else if (!strcmp(argv[argCntr], "--ctr"))
+                        config.method = AES_M_CTR;
+                    else if (!strcmp(argv[argCntr], "--gcm"))
+                        config.method = AES_M_GCM;
+                    else if (!strcmp(argv[argCntr], "--xts"))
+                        config.method = AES_M_XTS;
+                    else if (!strcmp(argv[argCntr], "--mmap"))
+                        config.fileIO = AES_IO_MMAP;
+                    else if (!strcmp(argv[argCntr], "--uring"))
+                        config.fileIO = AES_IO_URING;
+                    else if (!strcmp(argv[argCntr], "--direct"))
+                        config.fileIO = AES_IO_DIRECT;
+                    else if (!strcmp(argv[argCntr], "--aes128"))
+                        config.keySize = AES_KEY_128;
+                    else if (!strcmp(argv[argCntr], "--aes192"))
+                        config.keySize = AES_KEY_192;
+                    else if (!strcmp(argv[argCntr], "--aes256"))
+                        config.keySize = AES_KEY_256;
                     else 
                         throw("Invalid arguments given!");
 
@@ -391,7 +496,7 @@ void ArgCLI(int argc, char** argv) {
 int GUI() {
 
     RuntimeConfig config;
-    config.key = new uint8_t[17];
+    config.key = new uint8_t[2 * AES_KEY_128 + 1];  //XTS takes two keys
     config.source = new char[257];  //File path length limit
     //config.source[0] = 0;
 
@@ -405,7 +510,7 @@ int GUI() {
     const char* menuOptions[] = { "Encrypt", "Decrypt", "Set Secret Key", "Clear Secret Key", "Exit" };
     int numOptions = sizeof(menuOptions) / sizeof(menuOptions[0]);
 
-    const char* methodOptions[] = { "AES ECB", "AES CBC", "AES CFB", "AES OFB"};
+    const char* methodOptions[] = { "AES ECB", "AES CBC", "AES CFB", "AES OFB", "AES CTR", "AES GCM", "AES XTS"};
     int numMethods = sizeof(methodOptions) / sizeof(methodOptions[0]);
 
     bool runLoop = true;
@@ -435,7 +540,7 @@ int GUI() {
                 break;
 
             case 2:
-                PasswordPrompt((char*)config.key, 16, "Secret key:", false);
+                PasswordPrompt((char*)config.key, 2 * AES_KEY_128, "Secret key:", false);
                 break;
 
             case 3:
@@ -0,0 +1,187 @@
+///
+///     Known answer tests: FIPS-197, SP 800-38A and SP 800-38D vectors on every block cipher backend of this CPU
+///
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "aes.h"
+
+static int failures = 0;
+
+static void Check(bool condition, const std::string& name) {
+	if (!condition) {
+		std::cerr << "[FAIL] " << name << std::endl;
+		failures++;
+	}
+}
+
+//Hex string to bytes, the vectors are written like in the standards
+static std::vector<uint8_t> Hex(const char* hex) {
+	std::vector<uint8_t> bytes;
+	for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+		unsigned value = 0;
+		sscanf(hex + i, "%2x", &value);
+		bytes.push_back((uint8_t)value);
+	}
+	return bytes;
+}
+
+//The library reads keys like strings, the key bytes are ended with a zero
+static std::vector<uint8_t> Key(const char* hex) {
+	std::vector<uint8_t> key = Hex(hex);
+	key.push_back(0);
+	return key;
+}
+
+static AES_KEYSIZE KeySize(const char* hex) {
+	return (AES_KEYSIZE)(strlen(hex) / 2);
+}
+
+/**
+ * 	@brief Encrypt the plaintext in one call, then decrypt it in two calls split at a block boundary to check the chaining
+*/
+static void CheckStream(AES_BASE& cipher, const char* kernel, const char* name, const uint8_t* iv, const char* plain, const char* expected) {
+	std::string label = std::string(kernel) + " " + name;
+	std::vector<uint8_t> text = Hex(plain);
+	std::vector<uint8_t> cipherText = Hex(expected);
+
+	if (!cipher.SetKernel(kernel)) {
+		Check(false, label + ": backend refused");
+		return;
+	}
+
+	cipher.SetIV(iv);
+	Check(cipher.EncryptStream(text.data(), text.size()) && text == cipherText, label + " encrypt");
+
+	size_t half = (text.size() > 16 ? text.size() / 32 * 16 : 0);
+	cipher.SetIV(iv);
+	Check((!half || cipher.DecryptStream(text.data(), half)) && cipher.DecryptStream(text.data() + half, text.size() - half) && text == Hex(plain), label + " decrypt");
+}
+
+//SP 800-38A F.1 to F.5: the same four blocks under the three keys
+static const char* plain38A = "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e5130c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710";
+static const char* keys38A[3] = {
+	"2b7e151628aed2a6abf7158809cf4f3c",
+	"8e73b0f7da0e6452c810f32b809079e562f8ead2522c6b7b",
+	"603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4"
+};
+
+static const char* ecb38A[3] = {
+	"3ad77bb40d7a3660a89ecaf32466ef97f5d3d58503b9699de785895a96fdbaaf43b1cd7f598ece23881b00e3ed0306887b0c785e27e8ad3f8223207104725dd4",
+	"bd334f1d6e45f25ff712a214571fa5cc974104846d0ad3ad7734ecb3ecee4eefef7afd2270e2e60adce0ba2face6444e9a4b41ba738d6c72fb16691603c18e0e",
+	"f3eed1bdb5d2a03c064b5a7e3db181f8591ccb10d410ed26dc5ba74a31362870b6ed21b99ca6f4f9f153e7b1beafed1d23304b7a39f9f3ff067d8d8f9e24ecc7"
+};
+
+static const char* cbc38A[3] = {
+	"7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b273bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7",
+	"4f021db243bc633d7178183a9fa071e8b4d9ada9ad7dedf4e5e738763f69145a571b242012fb7ae07fa9baac3df102e008b0e27988598881d920a9e64f5615cd",
+	"f58c4c04d6e5f1ba779eabfb5f7bfbd69cfc4e967edb808d679f777bc6702c7d39f23369a9d9bacfa530e26304231461b2eb05e2c39be9fcda6c19078c6a9d1b"
+};
+
+static const char* cfb38A[3] = {
+	"3b3fd92eb72dad20333449f8e83cfb4ac8a64537a0b3a93fcde3cdad9f1ce58b26751f67a3cbb140b1808cf187a4f4dfc04b05357c5d1c0eeac4c66f9ff7f2e6",
+	"cdc80d6fddf18cab34c25909c99a417467ce7f7f81173621961a2b70171d3d7a2e1e8a1dd59b88b1c8e60fed1efac4c9c05f9f9ca9834fa042ae8fba584b09ff",
+	"dc7e84bfda79164b7ecd8486985d386039ffed143b28b1c832113c6331e5407bdf10132415e54b92a13ed0a8267ae2f975a385741ab9cef82031623d55b1e471"
+};
+
+static const char* ofb38A[3] = {
+	"3b3fd92eb72dad20333449f8e83cfb4a7789508d16918f03f53c52dac54ed8259740051e9c5fecf64344f7a82260edcc304c6528f659c77866a510d9c1d6ae5e",
+	"cdc80d6fddf18cab34c25909c99a4174fcc28b8d4c63837c09e81700c11004018d9a9aeac0f6596f559c6d4daf59a5f26d9f200857ca6c3e9cac524bd9acc92a",
+	"dc7e84bfda79164b7ecd8486985d38604febdc6740d20b3ac88f6ad82a4fb08d71ab47a086e86eedf39d1c5bba97c4080126141d67f37be8538f5a8be740e484"
+};
+
+static const char* ctr38A[3] = {
+	"874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3009cee",
+	"1abc932417521ca24f2b0459fe7e6e0b090339ec0aa6faefd5ccc2c6f4ce8e941e36b26bd1ebc670d1bd1d665620abf74f78a7f6d29809585a97daec58c6b050",
+	"601ec313775789a5b7a7f504bbf3d228f443e3ca4d62b59aca84e990cacaf5c52b0930daa23de94ce87017ba2d84988ddfc9c58db67aada613c2dd08457941a6"
+};
+
+/**
+ * 	@brief SP 800-38D (GCM spec test cases 1 to 3, 9 and 15), no associated data
+*/
+static void CheckGcm(const char* kernel, const char* name, const char* keyHex, const char* nonceHex, const char* plain, const char* expected, const char* tagHex) {
+	std::string label = std::string(kernel) + " " + name;
+	std::vector<uint8_t> key = Key(keyHex);
+	std::vector<uint8_t> iv = Hex(nonceHex);
+	iv.resize(16);
+
+	//An all-zero key is the empty string
+	AES_GCM gcm(key[0] ? key.data() : nullptr, iv.data(), KeySize(keyHex));
+	if (!gcm.SetKernel(kernel)) {
+		Check(false, label + ": backend refused");
+		return;
+	}
+
+	std::vector<uint8_t> text = Hex(plain);
+	uint8_t tag[16];
+	if (!text.empty())
+		Check(gcm.EncryptStream(text.data(), text.size()) && text == Hex(expected), label + " encrypt");
+	gcm.GetTag(tag);
+	Check(!memcmp(tag, Hex(tagHex).data(), 16), label + " tag");
+
+	if (text.empty())
+		return;
+
+	size_t half = (text.size() > 16 ? text.size() / 32 * 16 : 0);
+	gcm.SetIV(iv.data());
+	Check((!half || gcm.DecryptStream(text.data(), half)) && gcm.DecryptStream(text.data() + half, text.size() - half) && text == Hex(plain), label + " decrypt");
+}
+
+int main() {
+	const char* kernels[] = { "vaes", "aesni", "vperm", "bitslice", "table" };
+	const std::vector<uint8_t> iv38A = Hex("000102030405060708090a0b0c0d0e0f");
+	const std::vector<uint8_t> counter38A = Hex("f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff");
+	const char* sizes[3] = { "128", "192", "256" };
+	std::string tested;
+
+	for (const char* kernel : kernels) {
+		if (!AES_KERNEL::Find(kernel))
+			continue;
+		tested += std::string(" ") + kernel;
+
+		//FIPS-197 Appendix B
+		std::vector<uint8_t> fipsKey = Key(keys38A[0]);
+		AES_ECB fips(fipsKey.data(), AES_KEY_128);
+		CheckStream(fips, kernel, "FIPS-197 B", nullptr, "3243f6a8885a308d313198a2e0370734", "3925841d02dc09fbdc118597196a0b32");
+
+		for (int i = 0; i < 3; i++) {
+			std::vector<uint8_t> key = Key(keys38A[i]);
+			AES_KEYSIZE keySize = KeySize(keys38A[i]);
+
+			AES_ECB ecb(key.data(), keySize);
+			CheckStream(ecb, kernel, (std::string("ECB-AES") + sizes[i]).c_str(), nullptr, plain38A, ecb38A[i]);
+
+			AES_CBC cbc(key.data(), iv38A.data(), keySize);
+			CheckStream(cbc, kernel, (std::string("CBC-AES") + sizes[i]).c_str(), iv38A.data(), plain38A, cbc38A[i]);
+
+			AES_CFB cfb(key.data(), iv38A.data(), keySize);
+			CheckStream(cfb, kernel, (std::string("CFB128-AES") + sizes[i]).c_str(), iv38A.data(), plain38A, cfb38A[i]);
+
+			AES_OFB ofb(key.data(), iv38A.data(), keySize);
+			CheckStream(ofb, kernel, (std::string("OFB-AES") + sizes[i]).c_str(), iv38A.data(), plain38A, ofb38A[i]);
+
+			AES_CTR ctr(key.data(), counter38A.data(), keySize);
+			CheckStream(ctr, kernel, (std::string("CTR-AES") + sizes[i]).c_str(), counter38A.data(), plain38A, ctr38A[i]);
+		}
+
+		const char* zero128 = "00000000000000000000000000000000";
+		const char* nonce = "cafebabefacedbaddecaf888";
+		const char* plainGcm = "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b391aafd255";
+
+		CheckGcm(kernel, "GCM test case 1", zero128, "000000000000000000000000", "", "", "58e2fccefa7e3061367f1d57a4e7455a");
+		CheckGcm(kernel, "GCM test case 2", zero128, "000000000000000000000000", zero128, "0388dace60b6a392f328c2b971b2fe78", "ab6e47d42cec13bdf53a67b21257bddf");
+		CheckGcm(kernel, "GCM test case 3", "feffe9928665731c6d6a8f9467308308", nonce, plainGcm,
+			"42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091473f5985", "4d5c2af327cd64a62cf35abd2ba6fab4");
+		CheckGcm(kernel, "GCM test case 9", "feffe9928665731c6d6a8f9467308308feffe9928665731c", nonce, plainGcm,
+			"3980ca0b3c00e841eb06fac4872a2757859e1ceaa6efd984628593b40ca1e19c7d773d00c144c525ac619d18c84a3f4718e2448b2fe324d9ccda2710acade256", "9924a7c8587336bfb118024db8674a14");
+		CheckGcm(kernel, "GCM test case 15", "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308", nonce, plainGcm,
+			"522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662898015ad", "b094dac5d93471bdec1a502270e3cc6c");
+	}
+
+	std::cout << (failures ? "Known answer tests failed on:" : "Known answer tests passed on:") << tested << std::endl;
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+///
+///     XTS checks: IEEE 1619 / SP 800-38E need a tweak key different from the data key, and the IEEE 1619 test vectors
+///
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "aes.h"
+
+static int failures = 0;
+
+static void Check(bool condition, const std::string& name) {
+	if (!condition) {
+		std::cerr << "[FAIL] " << name << std::endl;
+		failures++;
+	}
+}
+
+//Hex string to bytes, the vectors are written like in the standard
+static std::vector<uint8_t> Hex(const char* hex) {
+	std::vector<uint8_t> bytes;
+	for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+		unsigned value = 0;
+		sscanf(hex + i, "%2x", &value);
+		bytes.push_back((uint8_t)value);
+	}
+	return bytes;
+}
+
+/**
+ * 	@brief One IEEE 1619 data unit encrypted as a stream from the start of its sector, then decrypted back
+*/
+static void CheckVector(const char* kernel, const char* name, const char* keys, uint64_t dataUnit, const char* plain, const char* expected) {
+	std::string label = std::string(kernel) + " IEEE 1619 " + name;
+	std::vector<uint8_t> key = Hex(keys);
+	key.push_back(0);
+
+	AES_XTS xts(key.data(), (AES_KEYSIZE)(key.size() / 2));
+	if (!xts.SetKernel(kernel)) {
+		Check(false, label + ": backend refused");
+		return;
+	}
+
+	std::vector<uint8_t> text = Hex(plain);
+	xts.Seek(dataUnit);
+	Check(xts.EncryptStream(text.data(), text.size()) && text == Hex(expected), label + " encrypt");
+	xts.Seek(dataUnit);
+	Check(xts.DecryptStream(text.data(), text.size()) && text == Hex(plain), label + " decrypt");
+}
+
+//IEEE 1619 vectors 4 to 6: three 512 byte data units under one key pair, each vector encrypts the ciphertext of the one before
+static const char* vector4 =
+	"27a7479befa1d476489f308cd4cfa6e2a96e4bbe3208ff25287dd3819616e89cc78cf7f5e543445f8333d8fa7f56000005279fa5d8b5e4ad40e736ddb4d35412"
+	"328063fd2aab53e5ea1e0a9f332500a5df9487d07a5c92cc512c8866c7e860ce93fdf166a24912b422976146ae20ce846bb7dc9ba94a767aaef20c0d61ad0265"
+	"5ea92dc4c4e41a8952c651d33174be51a10c421110e6d81588ede82103a252d8a750e8768defffed9122810aaeb99f9172af82b604dc4b8e51bcb08235a6f434"
+	"1332e4ca60482a4ba1a03b3e65008fc5da76b70bf1690db4eae29c5f1badd03c5ccf2a55d705ddcd86d449511ceb7ec30bf12b1fa35b913f9f747a8afd1b130e"
+	"94bff94effd01a91735ca1726acd0b197c4e5b03393697e126826fb6bbde8ecc1e08298516e2c9ed03ff3c1b7860f6de76d4cecd94c8119855ef5297ca67e9f3"
+	"e7ff72b1e99785ca0a7e7720c5b36dc6d72cac9574c8cbbc2f801e23e56fd344b07f22154beba0f08ce8891e643ed995c94d9a69c9f1b5f499027a78572aeebd"
+	"74d20cc39881c213ee770b1010e4bea718846977ae119f7a023ab58cca0ad752afe656bb3c17256a9f6e9bf19fdd5a38fc82bbe872c5539edb609ef4f79c203e"
+	"bb140f2e583cb2ad15b4aa5b655016a8449277dbd477ef2c8d6c017db738b18deb4a427d1923ce3ff262735779a418f20a282df920147beabe421ee5319d0568";
+
+static const char* vector5 =
+	"264d3ca8512194fec312c8c9891f279fefdd608d0c027b60483a3fa811d65ee59d52d9e40ec5672d81532b38b6b089ce951f0f9c35590b8b978d175213f329bb"
+	"1c2fd30f2f7f30492a61a532a79f51d36f5e31a7c9a12c286082ff7d2394d18f783e1a8e72c722caaaa52d8f065657d2631fd25bfd8e5baad6e527d763517501"
+	"c68c5edc3cdd55435c532d7125c8614deed9adaa3acade5888b87bef641c4c994c8091b5bcd387f3963fb5bc37aa922fbfe3df4e5b915e6eb514717bdd2a7407"
+	"9a5073f5c4bfd46adf7d282e7a393a52579d11a028da4d9cd9c77124f9648ee383b1ac763930e7162a8d37f350b2f74b8472cf09902063c6b32e8c2d9290cefb"
+	"d7346d1c779a0df50edcde4531da07b099c638e83a755944df2aef1aa31752fd323dcb710fb4bfbb9d22b925bc3577e1b8949e729a90bbafeacf7f7879e7b114"
+	"7e28ba0bae940db795a61b15ecf4df8db07b824bb062802cc98a9545bb2aaeed77cb3fc6db15dcd7d80d7d5bc406c4970a3478ada8899b329198eb61c193fb62"
+	"75aa8ca340344a75a862aebe92eee1ce032fd950b47d7704a3876923b4ad62844bf4a09c4dbe8b4397184b7471360c9564880aedddb9baa4af2e75394b08cd32"
+	"ff479c57a07d3eab5d54de5f9738b8d27f27a9f0ab11799d7b7ffefb2704c95c6ad12c39f1e867a4b7b1d7818a4b753dfd2a89ccb45e001a03a867b187f225dd";
+
+static const char* vector6 =
+	"fa762a3680b76007928ed4a4f49a9456031b704782e65e16cecb54ed7d017b5e18abd67b338e81078f21edb7868d901ebe9c731a7c18b5e6dec1d6a72e078ac9"
+	"a4262f860beefa14f4e821018272e411a951502b6e79066e84252c3346f3aa62344351a291d4bedc7a07618bdea2af63145cc7a4b8d4070691ae890cd65733e7"
+	"946e9021a1dffc4c59f159425ee6d50ca9b135fa6162cea18a939838dc000fb386fad086acce5ac07cb2ece7fd580b00cfa5e98589631dc25e8e2a3daf2ffdec"
+	"26531659912c9d8f7a15e5865ea8fb5816d6207052bd7128cd743c12c8118791a4736811935eb982a532349e31dd401e0b660a568cb1a4711f552f55ded59f1f"
+	"15bf7196b3ca12a91e488ef59d64f3a02bf45239499ac6176ae321c4a211ec545365971c5d3f4f09d4eb139bfdf2073d33180b21002b65cc9865e76cb24cd92c"
+	"874c24c18350399a936ab3637079295d76c417776b94efce3a0ef7206b15110519655c956cbd8b2489405ee2b09a6b6eebe0c53790a12a8998378b33a5b71159"
+	"625f4ba49d2a2fdba59fbf0897bc7aabd8d707dc140a80f0f309f835d3da54ab584e501dfa0ee977fec543f74186a802b9a37adb3e8291eca04d66520d229e60"
+	"401e7282bef486ae059aa70696e0e305d777140a7a883ecdcb69b9ff938e8a4231864c69ca2c2043bed007ff3e605e014bcf518138dc3a25c5e236171a2d01d6";
+
+static void CheckVectors(const char* kernel) {
+	const char* keys1 = "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0bfbebdbcbbbab9b8b7b6b5b4b3b2b1b0";
+	std::string units;
+	for (int i = 0; i < 512; i++) {
+		char hex[3];
+		snprintf(hex, sizeof(hex), "%02x", i & 0xFF);
+		units += hex;
+	}
+
+	//Whole blocks
+	CheckVector(kernel, "vector 2", "1111111111111111111111111111111122222222222222222222222222222222", 0x3333333333,
+		"4444444444444444444444444444444444444444444444444444444444444444", "c454185e6a16936e39334038acef838bfb186fff7480adc4289382ecd6d394f0");
+	CheckVector(kernel, "vector 3", "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f022222222222222222222222222222222", 0x3333333333,
+		"4444444444444444444444444444444444444444444444444444444444444444", "af85336b597afc1a900b2eb21ec949d292df4c047e0b21532186a5971a227a89");
+
+	//A partial last block is handled with ciphertext stealing
+	CheckVector(kernel, "vector 15", keys1, 0x123456789a, "000102030405060708090a0b0c0d0e0f10", "6c1625db4671522d3d7599601de7ca09ed");
+	CheckVector(kernel, "vector 16", keys1, 0x123456789a, "000102030405060708090a0b0c0d0e0f1011", "d069444b7a7e0cab09e24447d24deb1fedbf");
+	CheckVector(kernel, "vector 17", keys1, 0x123456789a, "000102030405060708090a0b0c0d0e0f101112", "e5df1351c0544ba1350b3363cd8ef4beedbf9d");
+	CheckVector(kernel, "vector 18", keys1, 0x123456789a, "000102030405060708090a0b0c0d0e0f10111213", "9d84c813f719aa2c7be3f66171c7c5c2edbf9dac");
+
+	std::string label = std::string(kernel) + " IEEE 1619 vectors 4 to 6";
+	std::vector<uint8_t> key = Hex("2718281828459045235360287471352631415926535897932384626433832795");
+	key.push_back(0);
+
+	AES_XTS xts(key.data(), AES_KEY_128);
+	if (!xts.SetKernel(kernel) || !xts.SetSectorSize(512)) {
+		Check(false, label + ": setup refused");
+		return;
+	}
+
+	//Vector 4 as one sector
+	std::vector<uint8_t> data = Hex(units.c_str());
+	Check(xts.EncryptSector(data.data(), 0) && data == Hex(vector4), label + " sector 0");
+
+	//Vectors 5 and 6 as one stream over two sectors after a seek
+	std::vector<uint8_t> stream = Hex((std::string(vector4) + vector5).c_str());
+	xts.Seek(1);
+	Check(xts.EncryptStream(stream.data(), stream.size()) && stream == Hex((std::string(vector5) + vector6).c_str()), label + " stream from sector 1");
+	xts.Seek(1);
+	Check(xts.DecryptStream(stream.data(), stream.size()) && stream == Hex((std::string(vector4) + vector5).c_str()), label + " stream decrypt from sector 1");
+}
+
+int main() {
+	uint8_t sector[AES_XTS_SECTOR] = { 0 };
+
+	//An empty key zero-pads both halves to the same key
+	AES_XTS empty((const uint8_t*)"", AES_KEY_128);
+	Check(!empty.HasDistinctKeys(), "empty key accepted");
+	Check(!empty.EncryptStream(sector, sizeof(sector)), "empty key encrypted a stream");
+	Check(!empty.EncryptSector(sector, 0), "empty key encrypted a sector");
+
+	//Both halves spelled out the same
+	AES_XTS same((const uint8_t*)"0123456789abcdef0123456789abcdef", AES_KEY_128);
+	Check(!same.HasDistinctKeys(), "equal halves accepted");
+	Check(!same.DecryptStream(sector, sizeof(sector)), "equal halves decrypted a stream");
+
+	//Shared keysets, the same one twice and two equal ones
+	auto keyset = std::make_shared<const AES_KEYSET>((const uint8_t*)"0123456789abcdef", AES_KEY_128);
+	auto copy = std::make_shared<const AES_KEYSET>((const uint8_t*)"0123456789abcdef", AES_KEY_128);
+	auto tweak = std::make_shared<const AES_KEYSET>((const uint8_t*)"fedcba9876543210", AES_KEY_128);
+	Check(!AES_XTS(keyset, keyset).HasDistinctKeys(), "same keyset accepted");
+	Check(!AES_XTS(keyset, copy).HasDistinctKeys(), "equal keysets accepted");
+
+	//Distinct keys round trip
+	AES_XTS good(keyset, tweak);
+	Check(good.HasDistinctKeys(), "distinct keysets refused");
+	Check(!AES_XTS((const uint8_t*)"data key", AES_KEY_256).HasDistinctKeys(), "short key with a zero tweak key accepted");
+	Check(!AES_XTS((const uint8_t*)"0123456789abcdef0123456789abcde", AES_KEY_128).HasDistinctKeys(), "key one character short accepted");
+	Check(AES_XTS((const uint8_t*)"0123456789abcdef0123456789abcdeF", AES_KEY_128).HasDistinctKeys(), "full length key refused");
+
+	uint8_t plain[AES_XTS_SECTOR];
+	for (size_t i = 0; i < sizeof(plain); i++)
+		plain[i] = (uint8_t)(i * 7);
+	memcpy(sector, plain, sizeof(sector));
+
+	Check(good.EncryptSector(sector, 3) && memcmp(sector, plain, sizeof(sector)), "sector not encrypted");
+	Check(good.DecryptSector(sector, 3) && !memcmp(sector, plain, sizeof(sector)), "sector round trip");
+
+	for (const char* kernel : { "vaes", "aesni", "vperm", "bitslice", "table" })
+		if (AES_KERNEL::Find(kernel))
+			CheckVectors(kernel);
+
+	std::cout << (failures ? "XTS checks failed" : "XTS checks passed") << std::endl;
+	return failures ? 1 : 0;
+}